@@ -323,7 +323,7 @@ static int Meta_read(Cache *cf)
      * Allocate memory for all segments, and read them in
      */
     cf->seg = CALLOC(cf->segbc, sizeof(Seg));
-    long nmemb = fread(cf->seg, sizeof(Seg), cf->segbc, fp);
+    long nmemb = fread((void *)cf->seg, sizeof(Seg), cf->segbc, fp);
 
     /*
      * We shouldn't have gone past the end of the file
@@ -352,6 +352,12 @@ static int Meta_read(Cache *cf)
         return EBADMSG;
     }
 
+    long seg_cached = 0;
+    for (long i = 0; i < cf->segbc; i++) {
+        seg_cached += !!cf->seg[i];
+    }
+    atomic_store(&cf->seg_cached, seg_cached);
+
     return 0;
 }
 
@@ -412,7 +418,7 @@ static int Meta_write(Cache *cf)
     fwrite(&write_content_length, sizeof(off_t), 1, fp);
     fwrite(&cf->blksz, sizeof(int), 1, fp);
     fwrite(&cf->segbc, sizeof(long), 1, fp);
-    fwrite(cf->seg, sizeof(Seg), cf->segbc, fp);
+    fwrite((const void *)cf->seg, sizeof(Seg), cf->segbc, fp);
 
     /*
      * Error checking for fwrite
@@ -510,51 +516,35 @@ static long Data_read(Cache *cf, uint8_t *buf, off_t len, off_t offset)
         return -EINVAL;
     }
 
-    lprintf(cache_lock_debug, "thread %lx: locking seek_lock;\n",
-            (unsigned long)pthread_self());
-    PTHREAD_MUTEX_LOCK(&cf->seek_lock);
-
-    long byte_read = 0;
-
     if (offset < 0 || offset >= total_len) {
-        goto end;
+        return 0;
     } else if (len > total_len - offset) {
         len = total_len - offset;
     }
 
-    /*
-     * Seek to the right location
-     */
-    if (fseeko(cf->dfp, offset, SEEK_SET)) {
-        /*
-         * fseeko failed
-         */
-        lprintf(error, "fseeko(): %s\n", strerror(errno));
-        byte_read = -EIO;
-        goto end;
-    }
-
-    byte_read = fread(buf, sizeof(uint8_t), len, cf->dfp);
-    if (byte_read != len) {
-        if (feof(cf->dfp)) {
+    long byte_read = 0;
+    while (byte_read < len) {
+        ssize_t n = pread(cf->dfd, buf + byte_read, len - byte_read,
+                          offset + byte_read);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             /*
-             * reached EOF
+             * filesystem error
              */
-            lprintf(error, "fread(): reached the end of the file!\n");
+            lprintf(error, "pread(): %s\n", strerror(errno));
+            return byte_read ? byte_read : -EIO;
         }
-        if (ferror(cf->dfp)) {
+        if (n == 0) {
             /*
-             * filesystem error
+             * reached EOF
              */
-            lprintf(error, "fread(): encountered error!\n");
+            lprintf(error, "pread(): reached the end of the file!\n");
+            break;
         }
+        byte_read += n;
     }
-
-end:
-
-    lprintf(cache_lock_debug, "thread %lx: unlocking seek_lock;\n",
-            (unsigned long)pthread_self());
-    PTHREAD_MUTEX_UNLOCK(&cf->seek_lock);
     return byte_read;
 }
 
@@ -576,39 +566,27 @@ static long Data_write(Cache *cf, const uint8_t *buf, off_t len, off_t offset)
         return -EINVAL;
     }
 
-    lprintf(cache_lock_debug, "thread %lx: locking seek_lock;\n",
-            (unsigned long)pthread_self());
-    PTHREAD_MUTEX_LOCK(&cf->seek_lock);
-
     long byte_written = 0;
-
-    if (fseeko(cf->dfp, offset, SEEK_SET)) {
-        /*
-         * fseeko failed
-         */
-        lprintf(error, "fseeko(): %s\n", strerror(errno));
-        byte_written = -EIO;
-        goto end;
+    while (byte_written < len) {
+        ssize_t n = pwrite(cf->dfd, buf + byte_written, len - byte_written,
+                           offset + byte_written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /*
+             * filesystem error
+             */
+            lprintf(error, "pwrite(): %s\n", strerror(errno));
+            break;
+        }
+        byte_written += n;
     }
 
-    byte_written = fwrite(buf, sizeof(uint8_t), len, cf->dfp);
-
     if (byte_written != len) {
-        lprintf(error, "fwrite(): requested %ld, returned %ld!\n", len,
+        lprintf(error, "pwrite(): requested %ld, returned %ld!\n", len,
                 byte_written);
     }
-
-    if (ferror(cf->dfp)) {
-        /*
-         * filesystem error
-         */
-        lprintf(error, "fwrite(): encountered error!\n");
-    }
-
-end:
-    lprintf(cache_lock_debug, "thread %lx: unlocking seek_lock;\n",
-            (unsigned long)pthread_self());
-    PTHREAD_MUTEX_UNLOCK(&cf->seek_lock);
     return byte_written;
 }
 
@@ -715,7 +693,7 @@ static void Cache_waiter_decrement(Cache *cf)
 static Cache *Cache_alloc(void)
 {
     Cache *cf = CALLOC(1, sizeof(Cache));
-    PTHREAD_MUTEX_INIT(&cf->seek_lock, NULL);
+    cf->dfd = -1;
     PTHREAD_MUTEX_INIT(&cf->w_lock, NULL);
     PTHREAD_MUTEX_INIT(&cf->dl_lock, NULL);
     cf->active_dls = NULL;
@@ -769,7 +747,6 @@ static void Cache_free(Cache *cf)
     }
     PTHREAD_MUTEX_UNLOCK(&cf->dl_lock);
 
-    PTHREAD_MUTEX_DESTROY(&cf->seek_lock);
     PTHREAD_MUTEX_DESTROY(&cf->w_lock);
     PTHREAD_MUTEX_DESTROY(&cf->dl_lock);
     PTHREAD_COND_DESTROY(&cf->shutdown_cond);
@@ -838,17 +815,19 @@ void Cache_delete(const char *fn)
             return;
         }
         fn = link->sonic.id;
-    } else if (CONFIG.mode == NORMAL) {
+    } else if (CONFIG.mode == NORMAL || CONFIG.mode == MANIFEST) {
         if (!link) {
             return;
         }
-        cache_key = url_to_cache_path(link->f_url);
+        char *url = Link_get_url(link);
+        cache_key = url_to_cache_path(url);
         if (!cache_key) {
-            lprintf(error, "Failed to derive cache key from URL: %s\n",
-                    link->f_url);
+            lprintf(error, "Failed to derive cache key from URL: %s\n", url);
+            FREE(url);
             LinkTable_unref(link->parent_table);
             return;
         }
+        FREE(url);
         fn = cache_key;
     }
 
@@ -880,12 +859,12 @@ void Cache_delete(const char *fn)
 static int Data_open(Cache *cf)
 {
     char *datafn = path_append(DATA_DIR, cf->path);
-    cf->dfp = fopen(datafn, "r+");
-    if (!cf->dfp) {
+    cf->dfd = open(datafn, O_RDWR | O_CLOEXEC);
+    if (cf->dfd == -1) {
         /*
          * Failed to open the data file
          */
-        lprintf(error, "fopen(%s): %s\n", datafn, strerror(errno));
+        lprintf(error, "open(%s): %s\n", datafn, strerror(errno));
         FREE(datafn);
         return -1;
     }
@@ -952,8 +931,10 @@ int Cache_create(const char *path)
     char *fn = NULL;
     char *fn_alloc = NULL;
 
-    if (CONFIG.mode == NORMAL) {
-        fn_alloc = url_to_cache_path(this_link->f_url);
+    if (CONFIG.mode == NORMAL || CONFIG.mode == MANIFEST) {
+        char *url = Link_get_url(this_link);
+        fn_alloc = url_to_cache_path(url);
+        FREE(url);
         fn = fn_alloc;
     } else if (CONFIG.mode == SINGLE) {
         fn = curl_easy_unescape(NULL, this_link->linkname, 0, NULL);
@@ -1015,7 +996,7 @@ int Cache_create(const char *path)
         lprintf(fatal, "Cache file creation failed for %s\n", path);
     }
 
-    if (CONFIG.mode == NORMAL) {
+    if (CONFIG.mode == NORMAL || CONFIG.mode == MANIFEST) {
         FREE(fn_alloc);
     } else if (CONFIG.mode == SINGLE) {
         curl_free(fn);
@@ -1058,17 +1039,19 @@ Cache *Cache_open(const char *fn)
     const char *actual_fn = fn;
     if (CONFIG.mode == SONIC) {
         actual_fn = link->sonic.id;
-    } else if (CONFIG.mode == NORMAL) {
-        actual_fn_alloc = url_to_cache_path(link->f_url);
+    } else if (CONFIG.mode == NORMAL || CONFIG.mode == MANIFEST) {
+        char *url = Link_get_url(link);
+        actual_fn_alloc = url_to_cache_path(url);
         if (!actual_fn_alloc) {
-            lprintf(error, "Failed to derive cache path from URL: %s\n",
-                    link->f_url);
+            lprintf(error, "Failed to derive cache path from URL: %s\n", url);
+            FREE(url);
             lprintf(cache_lock_debug, "thread %lx: unlocking cf_lock;\n",
                     (unsigned long)pthread_self());
             PTHREAD_MUTEX_UNLOCK(&cf_lock);
             LinkTable_unref(link->parent_table);
             return NULL;
         }
+        FREE(url);
         actual_fn = actual_fn_alloc;
     }
 
@@ -1160,9 +1143,9 @@ Cache *Cache_open(const char *fn)
             fclose(cf->mfp);
             cf->mfp = NULL;
         }
-        if (cf->dfp) {
-            fclose(cf->dfp);
-            cf->dfp = NULL;
+        if (cf->dfd != -1) {
+            close(cf->dfd);
+            cf->dfd = -1;
         }
         Cache_free(cf);
         Cache_delete(fn);
@@ -1214,7 +1197,7 @@ void Cache_close(Cache *cf)
         lprintf(error, "cannot close metadata: %s.\n", strerror(errno));
     }
 
-    if (cf->dfp && fclose(cf->dfp)) {
+    if (cf->dfd != -1 && close(cf->dfd)) {
         lprintf(error, "cannot close data file %s.\n", strerror(errno));
     }
 
@@ -1242,7 +1225,8 @@ static int Seg_exist(Cache *cf, off_t offset)
     if (byte < 0 || byte >= cf->segbc) {
         return 0;
     }
-    return cf->seg[byte];
+    /* Pairs with Seg_set(), the data of the segment is visible from here */
+    return atomic_load_explicit(&cf->seg[byte], memory_order_acquire);
 }
 
 /**
@@ -1250,7 +1234,7 @@ static int Seg_exist(Cache *cf, off_t offset)
  * \param[in] cf the cache in-memory data structure
  * \param[in] offset the starting position of the segment.
  * \param[in] i 1 for exist, 0 for doesn't exist
- * \note Call this after downloading a segment.
+ * \note Call this after the segment has been written to the data file.
  */
 static void Seg_set(Cache *cf, off_t offset, int i)
 {
@@ -1261,7 +1245,10 @@ static void Seg_set(Cache *cf, off_t offset, int i)
     if (byte < 0 || byte >= cf->segbc) {
         return;
     }
-    cf->seg[byte] = i;
+    Seg old = atomic_exchange_explicit(&cf->seg[byte], i, memory_order_release);
+    if (!old != !i) {
+        atomic_fetch_add(&cf->seg_cached, i ? 1 : -1);
+    }
 }
 
 /**
@@ -1387,8 +1374,10 @@ static void Cache_bgdl_launcher(Cache *cf, off_t dl_offset)
  * duplicate downloads:
  *
  * 1. Mutual Exclusion & Locking:
- *    - `w_lock` guards writing to the cache files (`dfp`/`mfp`) and checking
- * segment existence.
+ *    - A segment which is already cached is read with `pread()` without
+ * taking any lock, see `Seg_exist()`.
+ *    - `w_lock` guards writing to the cache files (`dfd`/`mfp`), and checking
+ * segment existence on the download path.
  *    - `dl_lock` guards access to `active_dls`, which tracks currently active
  * downloads.
  *    - Ordering: ALWAYS lock `w_lock` before `dl_lock` to avoid deadlocks.
@@ -1412,6 +1401,8 @@ static void Cache_bgdl_launcher(Cache *cf, off_t dl_offset)
  * fallback path to verify that the download is still not tracked before
  * allocating a new node.
  */
+static void Cache_readahead(Cache *cf, off_t dl_offset);
+
 static long Cache_read_segment(Cache *cf, char *const output_buf,
                                const off_t len, const off_t offset_start)
 {
@@ -1430,6 +1421,11 @@ static long Cache_read_segment(Cache *cf, char *const output_buf,
     int ret;
 
 retry:
+    if (Seg_exist(cf, dl_offset)) {
+        send = Data_read(cf, (uint8_t *)output_buf, len, offset_start);
+        goto bgdl;
+    }
+
     PTHREAD_MUTEX_LOCK(&cf->w_lock);
     if (Seg_exist(cf, dl_offset)) {
         send = Data_read(cf, (uint8_t *)output_buf, len, offset_start);
@@ -1591,14 +1587,23 @@ sync_dl:
     FREE(recv_buf);
     PTHREAD_MUTEX_UNLOCK(&cf->w_lock);
 
-bgdl: {
+bgdl:
+    Cache_readahead(cf, dl_offset);
+    return send;
 }
+
+/**
+ * \brief Start downloading the segment after the one at dl_offset
+ * \details The download runs in the background, if the segment is not cached,
+ * is not being downloaded, and a background worker is free.
+ */
+static void Cache_readahead(Cache *cf, off_t dl_offset)
+{
+    int ret;
     off_t next_dl_offset = dl_offset + cf->blksz;
     int next_seg_missing = 0;
     if ((uintmax_t)next_dl_offset < (uintmax_t)cf->link->content_length) {
-        PTHREAD_MUTEX_LOCK(&cf->w_lock);
         next_seg_missing = !Seg_exist(cf, next_dl_offset);
-        PTHREAD_MUTEX_UNLOCK(&cf->w_lock);
     }
     if (next_seg_missing) {
         ret = SEM_TRYWAIT(&cf->bgt_sem);
@@ -1620,8 +1625,6 @@ bgdl: {
             }
         }
     }
-
-    return send;
 }
 
 long Cache_read(Cache *cf, char *const output_buf, off_t len,
@@ -1670,3 +1673,41 @@ long Cache_read(Cache *cf, char *const output_buf, off_t len,
     }
     return send;
 }
+
+int Cache_data_fd(Cache *cf, off_t offset, size_t *len)
+{
+    if (!cf || !cf->link || offset < 0
+        || (size_t)offset >= cf->link->content_length) {
+        return -1;
+    }
+
+    size_t remaining = cf->link->content_length - (size_t)offset;
+    if (*len > remaining) {
+        *len = remaining;
+    }
+    if (*len == 0) {
+        return -1;
+    }
+
+    if (Cache_complete(cf)) {
+        return cf->dfd;
+    }
+
+    off_t last = offset + (off_t)*len - 1;
+    for (off_t seg = offset / cf->blksz * cf->blksz; seg <= last;
+         seg += cf->blksz) {
+        if (!Seg_exist(cf, seg)) {
+            return -1;
+        }
+    }
+    Cache_readahead(cf, last / cf->blksz * cf->blksz);
+    return cf->dfd;
+}
+
+int Cache_complete(Cache *cf)
+{
+    /* Pairs with Seg_set(), every segment is visible from here */
+    return cf->segbc > 0
+           && atomic_load_explicit(&cf->seg_cached, memory_order_acquire)
+                  == cf->segbc;
+}
@@ -30,6 +30,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -71,8 +72,12 @@ struct Cache {
     /** \brief How many times the cache has been opened */
     int cache_opened;
 
-    /** \brief the FILE pointer for the data file*/
-    FILE *dfp;
+    /**
+     * \brief the file descriptor of the data file
+     * \details It is only accessed with pread() and pwrite(), which do not
+     * move a shared file offset, so it needs no lock.
+     */
+    int dfd;
     /** \brief the FILE pointer for the metadata */
     FILE *mfp;
     /** \brief the path to the local cache file */
@@ -83,11 +88,16 @@ struct Cache {
     int blksz;
     /** \brief segment array byte count */
     long segbc;
-    /** \brief the detail of each segment */
-    Seg *seg;
+    /**
+     * \brief the detail of each segment
+     * \details A segment is only marked as present once its data has been
+     * written, and is never unmarked while the file is open, so a reader
+     * which sees it present reads the data file without taking any lock.
+     */
+    _Atomic(Seg) *seg;
+    /** \brief the number of segments which have been cached */
+    atomic_long seg_cached;
 
-    /** \brief mutex lock for seek operation */
-    pthread_mutex_t seek_lock;
     /** \brief mutex lock for write operation */
     pthread_mutex_t w_lock;
 
@@ -197,6 +207,29 @@ void Cache_delete(const char *fn);
  */
 long Cache_read(Cache *cf, char *output_buf, off_t len, off_t offset_start);
 
+/**
+ * \brief Find cached data in the data file
+ * \details If every segment covering the requested range has been cached, the
+ * data can be read straight from the data file, without being copied through
+ * Cache_read(). The data file stays open until the cache is closed.
+ * \param[in] cf the cache in-memory data structure
+ * \param[in] offset the start of the range
+ * \param[in,out] len the requested length, shortened if it goes past the end
+ * of the file
+ * \return the file descriptor of the data file, or -1 if some of the range has
+ * not been cached
+ * \note Called by fs_read()
+ */
+int Cache_data_fd(Cache *cf, off_t offset, size_t *len);
+
+/**
+ * \brief Check whether every segment of a file has been cached
+ * \details Once this is true, the data file holds the whole file, and stays
+ * unchanged until the cache is closed.
+ * \return 1 if the whole file has been cached, 0 otherwise
+ */
+int Cache_complete(Cache *cf);
+
 /**
  * \brief Searches the active downloads linked list for a matching offset.
  * \param[in] cf The cache instance.
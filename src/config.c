@@ -79,6 +79,18 @@ void Config_init(void)
 
     CONFIG.invalid_refresh = 0;
 
+    CONFIG.json_listing = 0;
+
+    CONFIG.manifest_url = NULL;
+
+    CONFIG.crawl = 0;
+
+    CONFIG.crawl_depth = 0;
+
+    CONFIG.crawl_conns = DEFAULT_CRAWL_CONNS;
+
+    CONFIG.crawl_rate = 0;
+
     /*--------------- Cache related ---------------*/
     CONFIG.cache_enabled = 0;
 
@@ -89,6 +101,10 @@ void Config_init(void)
     CONFIG.cache_min_size = -1;
     CONFIG.cache_max_size = -1;
 
+    CONFIG.snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+
+    CONFIG.dir_mem_limit = 0;
+
     /*-------------- Sonic related -------------*/
     CONFIG.sonic_username = NULL;
 
@@ -115,6 +131,7 @@ void Config_cleanup(void)
     }
     FREE(CONFIG.cafile);
     FREE(CONFIG.capath);
+    FREE(CONFIG.manifest_url);
     FREE(CONFIG.cache_dir);
     FREE(CONFIG.sonic_username);
     FREE(CONFIG.sonic_password);
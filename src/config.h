@@ -46,6 +46,16 @@
  */
 #define DEFAULT_REFRESH_TIMEOUT 3600
 
+/**
+ * \brief The default snapshot_interval
+ */
+#define DEFAULT_SNAPSHOT_INTERVAL 300
+
+/**
+ * \brief The default crawl_conns
+ */
+#define DEFAULT_CRAWL_CONNS 4
+
 /**
  * \brief The default HTTP 429 (too many requests) wait time
  */
@@ -72,6 +82,7 @@ typedef enum {
     NORMAL = 1,
     SONIC = 2,
     SINGLE = 3,
+    MANIFEST = 4,
 } OperationMode;
 
 typedef struct {
@@ -118,6 +129,18 @@ typedef struct {
     int invalid_refresh;
     /** \brief Include external (cross-origin) links from directory listings */
     int external_links;
+    /** \brief Only accept JSON directory listings */
+    int json_listing;
+    /** \brief The URL of the manifest, for manifest mode */
+    char *manifest_url;
+    /** \brief Crawl the directory tree at mount time */
+    int crawl;
+    /** \brief The maximum depth to crawl, 0 for unlimited */
+    int crawl_depth;
+    /** \brief The number of directories crawled concurrently */
+    int crawl_conns;
+    /** \brief The maximum number of directories crawled per second */
+    int crawl_rate;
     /*--------------- Cache related ---------------*/
     /** \brief Whether cache mode is enabled */
     int cache_enabled;
@@ -131,6 +154,10 @@ typedef struct {
     off_t cache_min_size;
     /** \brief The maximum file size threshold for caching */
     off_t cache_max_size;
+    /** \brief Save the LinkTable tree every snapshot_interval seconds */
+    int snapshot_interval;
+    /** \brief The memory budget of the LinkTables, in bytes, 0 for unlimited */
+    size_t dir_mem_limit;
     /*-------------- Sonic related -------------*/
     /** \brief The Sonic server username */
     char *sonic_username;
@@ -0,0 +1,395 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+/**
+ * \file crawl.c
+ * \brief Background crawler implementation
+ */
+
+#include "crawl.h"
+
+#include "config.h"
+#include "link.h"
+#include "log.h"
+#include "util.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * \brief The minimum number of seconds between two progress reports
+ */
+#define CRAWL_REPORT_INTERVAL 10
+
+/**
+ * \brief A directory waiting to be crawled
+ */
+typedef struct CrawlItem {
+    char *path;
+    /** \brief The depth of the directory, the root directory is at 0 */
+    int depth;
+    struct CrawlItem *next;
+} CrawlItem;
+
+/**
+ * \brief The state of the crawler, protected by its lock
+ */
+static struct {
+    pthread_mutex_t lock;
+    /** \brief Signalled when an item is queued, or when the crawl ends */
+    pthread_cond_t cond;
+    CrawlItem *head;
+    CrawlItem *tail;
+    int n_queued;
+    /** \brief The number of workers crawling a directory */
+    int n_busy;
+    int n_done;
+    int n_failed;
+    /** \brief Set while a crawl is running */
+    int running;
+    /** \brief Set to abort the crawl */
+    int stop;
+    /** \brief Whether manager needs to be joined */
+    int joinable;
+    pthread_t manager;
+    /** \brief The earliest time the next directory can be crawled */
+    struct timespec next_slot;
+    time_t start;
+    time_t last_report;
+} crawl = { .lock = PTHREAD_MUTEX_INITIALIZER,
+            .cond = PTHREAD_COND_INITIALIZER };
+
+/**
+ * \brief Posted by the SIGUSR1 handler, see Crawler_trigger_worker()
+ */
+static sem_t crawl_trigger;
+static pthread_t crawl_trigger_thread;
+static int crawl_trigger_running;
+static volatile sig_atomic_t crawl_trigger_stop;
+
+/**
+ * \brief Queue a directory
+ * \note The caller must hold crawl.lock.
+ */
+static void Crawler_push(char *path, int depth)
+{
+    CrawlItem *item = CALLOC(1, sizeof(CrawlItem));
+    item->path = path;
+    item->depth = depth;
+    if (crawl.tail) {
+        crawl.tail->next = item;
+    } else {
+        crawl.head = item;
+    }
+    crawl.tail = item;
+    crawl.n_queued++;
+    PTHREAD_COND_BROADCAST(&crawl.cond);
+}
+
+/**
+ * \brief Wait until the rate limit allows another directory to be crawled
+ */
+static void Crawler_wait_slot(void)
+{
+    if (CONFIG.crawl_rate <= 0) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    struct timespec slot = crawl.next_slot;
+    if (slot.tv_sec < now.tv_sec
+        || (slot.tv_sec == now.tv_sec && slot.tv_nsec < now.tv_nsec)) {
+        slot = now;
+    }
+    crawl.next_slot = slot;
+    crawl.next_slot.tv_nsec += 1000000000L / CONFIG.crawl_rate;
+    while (crawl.next_slot.tv_nsec >= 1000000000L) {
+        crawl.next_slot.tv_nsec -= 1000000000L;
+        crawl.next_slot.tv_sec++;
+    }
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slot, NULL)
+           == EINTR) {
+    }
+}
+
+/**
+ * \brief Crawl a directory, and queue its subdirectories
+ * \return 0 on success, -1 if the directory cannot be listed
+ */
+static int Crawler_visit(const CrawlItem *item)
+{
+    LinkTable *linktbl = path_to_LinkTable(item->path);
+    if (!linktbl) {
+        lprintf(warning, "cannot crawl %s\n", item->path);
+        return -1;
+    }
+    /* The LinkTable is saved once its entries have been stat'ed */
+    LinkTable_wait_filled(linktbl);
+
+    if (CONFIG.crawl_depth <= 0 || item->depth < CONFIG.crawl_depth) {
+        Link **links;
+        int size = LinkTable_entries(linktbl, &links);
+        PTHREAD_MUTEX_LOCK(&crawl.lock);
+        for (int i = 1; i < size && !crawl.stop; i++) {
+            Link *link = links[i];
+            if (link->type == LINK_DIR || link->type == LINK_UNINITIALISED_DIR) {
+                Crawler_push(path_append(item->path, link->linkname),
+                             item->depth + 1);
+            }
+        }
+        PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+    }
+    LinkTable_unref(linktbl);
+    return 0;
+}
+
+static void *Crawler_worker(void *arg)
+{
+    (void)arg;
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    for (;;) {
+        while (!crawl.head && crawl.n_busy > 0 && !crawl.stop) {
+            PTHREAD_COND_WAIT(&crawl.cond, &crawl.lock);
+        }
+        /* The crawl is over once nothing is queued or being crawled */
+        if (crawl.stop || !crawl.head) {
+            break;
+        }
+        CrawlItem *item = crawl.head;
+        crawl.head = item->next;
+        if (!crawl.head) {
+            crawl.tail = NULL;
+        }
+        crawl.n_queued--;
+        crawl.n_busy++;
+        PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+
+        Crawler_wait_slot();
+        int res = Crawler_visit(item);
+        FREE(item->path);
+        FREE(item);
+
+        PTHREAD_MUTEX_LOCK(&crawl.lock);
+        crawl.n_busy--;
+        crawl.n_done++;
+        if (res) {
+            crawl.n_failed++;
+        }
+        time_t now = time(NULL);
+        if (now - crawl.last_report >= CRAWL_REPORT_INTERVAL) {
+            crawl.last_report = now;
+            lprintf(info, "crawled %d directories, %d queued\n", crawl.n_done,
+                    crawl.n_queued);
+        }
+        if (!crawl.head && !crawl.n_busy) {
+            PTHREAD_COND_BROADCAST(&crawl.cond);
+        }
+    }
+    PTHREAD_COND_BROADCAST(&crawl.cond);
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+    return NULL;
+}
+
+/**
+ * \brief Run a crawl with CONFIG.crawl_conns workers
+ */
+static void *Crawler_manager(void *arg)
+{
+    (void)arg;
+    int n_threads = CONFIG.crawl_conns > 0 ? CONFIG.crawl_conns : 1;
+    pthread_t *threads = CALLOC(n_threads, sizeof(pthread_t));
+    int n_started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        int res = pthread_create(&threads[n_started], NULL, Crawler_worker,
+                                 NULL);
+        if (res) {
+            lprintf(error, "pthread_create(): %s\n", strerror(res));
+        } else {
+            n_started++;
+        }
+    }
+    if (!n_started) {
+        /* Crawl in this thread rather than not at all */
+        Crawler_worker(NULL);
+    }
+    for (int i = 0; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    FREE(threads);
+
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    while (crawl.head) {
+        CrawlItem *item = crawl.head;
+        crawl.head = item->next;
+        FREE(item->path);
+        FREE(item);
+    }
+    crawl.tail = NULL;
+    crawl.n_queued = 0;
+    lprintf(info, "crawl %s: %d directories in %ld seconds, %d failed\n",
+            crawl.stop ? "stopped" : "finished", crawl.n_done,
+            (long)(time(NULL) - crawl.start), crawl.n_failed);
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+
+    /* Persist the whole tree which has just been built */
+    LinkTree_disk_save();
+
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    crawl.running = 0;
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+    return NULL;
+}
+
+void Crawler_start(void)
+{
+    if (CONFIG.mode != NORMAL && CONFIG.mode != SONIC) {
+        lprintf(warning, "crawling is not supported in this mode\n");
+        return;
+    }
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    if (crawl.running || crawl.stop) {
+        PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+        return;
+    }
+    /* The previous crawl has finished */
+    if (crawl.joinable) {
+        pthread_join(crawl.manager, NULL);
+        crawl.joinable = 0;
+    }
+    crawl.n_busy = 0;
+    crawl.n_done = 0;
+    crawl.n_failed = 0;
+    crawl.start = time(NULL);
+    crawl.last_report = crawl.start;
+    Crawler_push(STRDUP("/"), 0);
+    int res = pthread_create(&crawl.manager, NULL, Crawler_manager, NULL);
+    if (res) {
+        lprintf(error, "pthread_create(): %s\n", strerror(res));
+        FREE(crawl.head->path);
+        FREE(crawl.head);
+        crawl.head = NULL;
+        crawl.tail = NULL;
+        crawl.n_queued = 0;
+    } else {
+        crawl.running = 1;
+        crawl.joinable = 1;
+        lprintf(info, "crawl started\n");
+    }
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+}
+
+void Crawler_wait(void)
+{
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    int joinable = crawl.joinable;
+    crawl.joinable = 0;
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+    if (joinable) {
+        pthread_join(crawl.manager, NULL);
+    }
+}
+
+static void Crawler_signal_handler(int sig)
+{
+    (void)sig;
+    /* sem_post() is async-signal-safe */
+    sem_post(&crawl_trigger);
+}
+
+/**
+ * \brief Start a crawl whenever SIGUSR1 is received
+ */
+static void *Crawler_trigger_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        if (sem_wait(&crawl_trigger)) {
+            continue;
+        }
+        if (crawl_trigger_stop) {
+            break;
+        }
+        Crawler_start();
+    }
+    return NULL;
+}
+
+void Crawler_init(void)
+{
+    if (CONFIG.mode != NORMAL && CONFIG.mode != SONIC) {
+        return;
+    }
+    if (sem_init(&crawl_trigger, 0, 0)) {
+        lprintf(error, "sem_init(): %s\n", strerror(errno));
+        return;
+    }
+    int res = pthread_create(&crawl_trigger_thread, NULL,
+                             Crawler_trigger_worker, NULL);
+    if (res) {
+        lprintf(error, "pthread_create(): %s\n", strerror(res));
+    } else {
+        crawl_trigger_running = 1;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = Crawler_signal_handler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        if (sigaction(SIGUSR1, &sa, NULL)) {
+            lprintf(error, "sigaction(): %s\n", strerror(errno));
+        }
+    }
+
+    if (CONFIG.crawl) {
+        Crawler_start();
+    }
+}
+
+void Crawler_cleanup(void)
+{
+    if (crawl_trigger_running) {
+        signal(SIGUSR1, SIG_DFL);
+        crawl_trigger_stop = 1;
+        sem_post(&crawl_trigger);
+        pthread_join(crawl_trigger_thread, NULL);
+        sem_destroy(&crawl_trigger);
+        crawl_trigger_running = 0;
+    }
+
+    PTHREAD_MUTEX_LOCK(&crawl.lock);
+    crawl.stop = 1;
+    int joinable = crawl.joinable;
+    crawl.joinable = 0;
+    PTHREAD_COND_BROADCAST(&crawl.cond);
+    PTHREAD_MUTEX_UNLOCK(&crawl.lock);
+    if (joinable) {
+        pthread_join(crawl.manager, NULL);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+#ifndef CRAWL_H
+#define CRAWL_H
+/**
+ * \file crawl.h
+ * \brief Background crawler header
+ * \details The crawler walks the remote directory tree breadth first, with a
+ * bounded number of threads. It builds the LinkTable of every directory it
+ * visits, and waits for its entries to be stat'ed, so they are in memory and
+ * saved to the cache before a filesystem walker gets to them. The LinkTables
+ * are built the same way as for path_to_LinkTable(), so a walker that reaches
+ * a directory the crawler is building waits for it rather than building it
+ * again.
+ *
+ * A crawl is started at mount time with --crawl, or at any time by sending
+ * SIGUSR1 to the process.
+ */
+
+/**
+ * \brief Start the crawler
+ * \details This installs the SIGUSR1 handler, and starts a crawl if
+ * CONFIG.crawl is set.
+ * \note This starts a thread, so it must be called after FUSE has forked.
+ */
+void Crawler_init(void);
+
+/**
+ * \brief Start a crawl from the root directory
+ * \details Nothing happens if a crawl is already running.
+ */
+void Crawler_start(void);
+
+/**
+ * \brief Wait for the running crawl to finish
+ */
+void Crawler_wait(void);
+
+/**
+ * \brief Stop the running crawl, and the thread waiting for SIGUSR1
+ */
+void Crawler_cleanup(void);
+
+#endif
@@ -30,61 +30,196 @@
 
 #include "cache.h"
 #include "config.h"
+#include "crawl.h"
 #include "link.h"
 #include "log.h"
+#include "util.h"
 
 /* clang-format off */
 #define BYPASS_FH ((uint64_t)-1)
 /* clang-format on */
 
 /*
- * must be included before including <fuse.h>
+ * must be included before including <fuse_lowlevel.h>
  */
 #if defined(__APPLE__) && defined(__MACH__)
 #define FUSE_DARWIN_ENABLE_EXTENSIONS 0
 #endif
 
-#define FUSE_USE_VERSION 30
-#include <fuse.h>
+#define FUSE_USE_VERSION 32
+#include <fuse_lowlevel.h>
 
 #include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-static void *fs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+#ifdef FUSE_CAP_PASSTHROUGH
+/**
+ * \brief The file handle of a file read through FUSE passthrough
+ * \details Cache pointers are aligned, so their lowest bit is never set.
+ */
+#define PASSTHROUGH_FH(backing_id) (((uint64_t)(backing_id) << 1) | 1)
+/** \brief Whether a file handle is one of PASSTHROUGH_FH() */
+#define FH_IS_PASSTHROUGH(fh) ((fh) != BYPASS_FH && ((fh) & 1))
+/** \brief The backing file ID of a PASSTHROUGH_FH() */
+#define FH_BACKING_ID(fh) ((int)((fh) >> 1))
+
+/** \brief Whether the kernel reads fully cached files by itself */
+static int fs_passthrough;
+#endif
+
+/**
+ * \brief The mount options which httpdirfs handles itself
+ * \details The high-level FUSE API used to handle these for us.
+ */
+struct FsOptions {
+    /** \brief The owner of the files, if set_uid is set */
+    unsigned int uid;
+    int set_uid;
+    /** \brief The group of the files, if set_gid is set */
+    unsigned int gid;
+    int set_gid;
+    /** \brief The permission mask of the files, if set_fmask is set */
+    unsigned int fmask;
+    int set_fmask;
+    /** \brief The permission mask of the directories, if set_dmask is set */
+    unsigned int dmask;
+    int set_dmask;
+    /**
+     * \brief How long the kernel caches names, in seconds, negative for
+     * CONFIG.refresh_timeout
+     */
+    double entry_timeout;
+    /**
+     * \brief How long the kernel caches missing names, in seconds, negative
+     * for CONFIG.refresh_timeout
+     */
+    double negative_timeout;
+    /**
+     * \brief How long the kernel caches attributes, in seconds, negative for
+     * CONFIG.refresh_timeout
+     */
+    double attr_timeout;
+    /** \brief Whether the kernel keeps the pages of a file across opens */
+    int kernel_cache;
+};
+
+static struct FsOptions fs_opts
+    = {.entry_timeout = -1, .negative_timeout = -1, .attr_timeout = -1};
+
+/**
+ * \brief An open directory, the file handle of fs_opendir()
+ * \details The entries are taken when the directory is opened. A refresh
+ * swaps a new array of entries into the LinkTable, but the old one is kept
+ * as long as the LinkTable, so the offsets of fs_readdir() stay stable while
+ * the directory is open.
+ */
+struct FsDir {
+    /** \brief The LinkTable of the directory, the handle holds a reference */
+    LinkTable *linktbl;
+    Link **links;
+    int size;
+};
+
+/** \brief The session, for telling the kernel about refreshed directories */
+static struct fuse_session *fs_session;
+
+/** \brief Protects the open_content_length and open_time of the Links */
+static pthread_mutex_t fs_open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define FS_OPT(templ, field, value)                                            \
+    {templ, offsetof(struct FsOptions, field), value}
+
+static const struct fuse_opt fs_opt_spec[]
+    = {FS_OPT("uid=%u", uid, 0),
+       FS_OPT("uid=", set_uid, 1),
+       FS_OPT("gid=%u", gid, 0),
+       FS_OPT("gid=", set_gid, 1),
+       FS_OPT("umask=%o", fmask, 0),
+       FS_OPT("umask=", set_fmask, 1),
+       FS_OPT("umask=%o", dmask, 0),
+       FS_OPT("umask=", set_dmask, 1),
+       FS_OPT("fmask=%o", fmask, 0),
+       FS_OPT("fmask=", set_fmask, 1),
+       FS_OPT("dmask=%o", dmask, 0),
+       FS_OPT("dmask=", set_dmask, 1),
+       FS_OPT("entry_timeout=%lf", entry_timeout, 0),
+       FS_OPT("negative_timeout=%lf", negative_timeout, 0),
+       FS_OPT("attr_timeout=%lf", attr_timeout, 0),
+       FS_OPT("kernel_cache", kernel_cache, 1),
+       FUSE_OPT_END};
+
+/** \brief print the help of the options in fs_opt_spec */
+static void fs_opt_help(void)
 {
-    (void)conn;
-    (void)cfg;
-    return NULL;
+    printf("    -o kernel_cache        cache files in kernel\n"
+           "    -o umask=M             set file permissions (octal)\n"
+           "    -o fmask=M             set file permissions (octal)\n"
+           "    -o dmask=M             set dir  permissions (octal)\n"
+           "    -o uid=N               set file owner\n"
+           "    -o gid=N               set file group\n"
+           "    -o entry_timeout=T     cache timeout for names "
+           "(refresh-timeout)\n"
+           "    -o negative_timeout=T  cache timeout for deleted names "
+           "(refresh-timeout)\n"
+           "    -o attr_timeout=T      cache timeout for attributes "
+           "(refresh-timeout)\n");
 }
 
-/** \brief release an opened file */
-static int fs_release(const char *path, struct fuse_file_info *fi)
+/**
+ * \brief Get the Link of an inode
+ * \details The inode number of a Link is its address. Each lookup the kernel
+ * remembers holds a reference to the parent table of the Link, so the Link is
+ * not freed until the kernel forgets the inode.
+ */
+static Link *ino_to_Link(fuse_ino_t ino)
 {
-    lprintf(info, "%s\n", path);
-    (void)path;
-    if (CACHE_SYSTEM_INIT && fi->fh && fi->fh != BYPASS_FH) {
-        Cache_close((Cache *)fi->fh);
+    return (Link *)(uintptr_t)ino;
+}
+
+/** \brief Get the inode number of a Link */
+static fuse_ino_t Link_to_ino(const Link *link)
+{
+    return (fuse_ino_t)(uintptr_t)link;
+}
+
+/**
+ * \brief Get the LinkTable of a directory inode
+ * \return the LinkTable with a reference for the caller, or NULL if the inode
+ * is not a directory
+ */
+static LinkTable *ino_to_LinkTable(fuse_ino_t ino)
+{
+    if (ino == FUSE_ROOT_ID) {
+        return path_to_LinkTable("/");
     }
-    return 0;
+    Link *link = ino_to_Link(ino);
+    Link_wait_file_stat(link);
+    if (link->type != LINK_DIR) {
+        return NULL;
+    }
+    return Link_to_LinkTable(link);
 }
 
-/** \brief return the attributes for a single file indicated by path */
-static int fs_getattr(const char *path, struct stat *stbuf,
-                      struct fuse_file_info *ffi_buf)
+/**
+ * \brief Fill in the attributes of an inode
+ * \param[in] link the Link of the inode, or NULL for the root directory
+ * \return 0, or -ENOENT if the Link is neither a file nor a directory
+ */
+static int fs_stat(Link *link, struct stat *stbuf)
 {
-    (void)ffi_buf;
-    int res = 0;
     memset(stbuf, 0, sizeof(struct stat));
 
-    if (!strcmp(path, "/")) {
+    if (!link) {
+        stbuf->st_ino = FUSE_ROOT_ID;
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 1;
     } else {
-        Link *link = path_to_Link(path);
-        if (!link) {
-            return -ENOENT;
-        }
+        Link_wait_file_stat(link);
+        stbuf->st_ino = Link_to_ino(link);
         struct timespec spec = {0};
         spec.tv_sec = link->time;
 #if defined(__APPLE__) && defined(__MACH__)
@@ -107,145 +242,534 @@ static int fs_getattr(const char *path, struct stat *stbuf,
             stbuf->st_blocks = (link->content_length) / 512;
             break;
         default:
-            LinkTable_unref(link->parent_table);
             return -ENOENT;
         }
-        LinkTable_unref(link->parent_table);
     }
-    stbuf->st_uid = getuid();
-    stbuf->st_gid = getgid();
 
-    return res;
+    if (S_ISDIR(stbuf->st_mode) && fs_opts.set_dmask) {
+        stbuf->st_mode = S_IFDIR | (0777 & ~fs_opts.dmask);
+    } else if (S_ISREG(stbuf->st_mode) && fs_opts.set_fmask) {
+        stbuf->st_mode = S_IFREG | (0777 & ~fs_opts.fmask);
+    }
+    stbuf->st_uid = fs_opts.set_uid ? fs_opts.uid : getuid();
+    stbuf->st_gid = fs_opts.set_gid ? fs_opts.gid : getgid();
+
+    return 0;
 }
 
-/** \brief read a file */
-static int fs_read(const char *path, char *buf, size_t size, off_t offset,
-                   struct fuse_file_info *fi)
+/**
+ * \brief Tell the kernel that a directory listing has been refreshed
+ * \details The entries which are still listed keep their Links, so only the
+ * names which have appeared or disappeared are looked up again, and the
+ * attributes and the data of the entries which have changed are dropped.
+ * This keeps long entry and attribute timeouts correct.
+ */
+static void fs_notify_replace(Link *dir_link, LinkTable *linktbl,
+                              const LinkTableDiff *diff)
 {
-    long received;
-    if (CACHE_SYSTEM_INIT) {
-        if (fi->fh == BYPASS_FH) {
-            received = path_download(path, buf, size, offset);
-        } else if (fi->fh) {
-            received = Cache_read((Cache *)fi->fh, buf, size, offset);
+    (void)linktbl;
+    fuse_ino_t parent = dir_link ? Link_to_ino(dir_link) : FUSE_ROOT_ID;
+    /* The kernel does not know most of the names, so the errors are ignored */
+    if (diff->n_added || diff->n_removed) {
+        fuse_lowlevel_notify_inval_inode(fs_session, parent, 0, 0);
+    }
+    for (int i = 0; i < diff->n_added; i++) {
+        const char *name = diff->added[i]->linkname;
+        fuse_lowlevel_notify_inval_entry(fs_session, parent, name,
+                                         strlen(name));
+    }
+    for (int i = 0; i < diff->n_removed; i++) {
+        const char *name = diff->removed[i]->linkname;
+        fuse_lowlevel_notify_inval_entry(fs_session, parent, name,
+                                         strlen(name));
+    }
+    for (int i = 0; i < diff->n_changed; i++) {
+        Link *link = diff->changed[i];
+        /* A Link which has become invalid has to be looked up again */
+        fuse_lowlevel_notify_inval_entry(fs_session, parent, link->linkname,
+                                         strlen(link->linkname));
+        fuse_lowlevel_notify_inval_inode(fs_session, Link_to_ino(link), 0, 0);
+    }
+}
+
+static void fs_init(void *userdata, struct fuse_conn_info *conn)
+{
+    (void)userdata;
+    /* Let fs_read() splice cached data from the data files */
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+        conn->want |= FUSE_CAP_SPLICE_WRITE;
+    }
+#ifdef FUSE_CAP_PASSTHROUGH
+    /* Let the kernel read fully cached files from the data files */
+    if (CACHE_SYSTEM_INIT && (conn->capable & FUSE_CAP_PASSTHROUGH)) {
+        conn->want |= FUSE_CAP_PASSTHROUGH;
+        fs_passthrough = 1;
+    }
+#endif
+    LinkSystem_on_replace(fs_notify_replace);
+    LinkSystem_fill_start();
+    LinkTree_autosave_start();
+    Crawler_init();
+}
+
+/** \brief clean up the filesystem when it is unmounted */
+static void fs_destroy(void *userdata)
+{
+    (void)userdata;
+    LinkSystem_on_replace(NULL);
+    Crawler_cleanup();
+    LinkTree_autosave_stop();
+}
+
+/** \brief look up a directory entry by name */
+static void fs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    LinkTable *linktbl = ino_to_LinkTable(parent);
+    if (!linktbl) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    Link *link = LinkTable_find(linktbl, name);
+    LinkTable_unref(linktbl);
+
+    struct fuse_entry_param e;
+    memset(&e, 0, sizeof(e));
+    if (link && fs_stat(link, &e.attr)) {
+        /*
+         * An invalid Link is stat'ed again once its backoff expires, so the
+         * kernel must not cache that the name does not exist.
+         */
+        LinkTable_unref(link->parent_table);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    if (!link) {
+        if (fs_opts.negative_timeout > 0) {
+            e.entry_timeout = fs_opts.negative_timeout;
+            fuse_reply_entry(req, &e);
         } else {
-            received = 0;
+            fuse_reply_err(req, ENOENT);
         }
+        return;
+    }
+
+    e.ino = Link_to_ino(link);
+    e.attr_timeout = fs_opts.attr_timeout;
+    e.entry_timeout = fs_opts.entry_timeout;
+    /* The kernel holds on to the reference until it forgets the inode */
+    if (fuse_reply_entry(req, &e)) {
+        LinkTable_unref(link->parent_table);
+    }
+}
+
+/** \brief drop the references the kernel held on an inode */
+static void fs_forget_one(fuse_ino_t ino, uint64_t nlookup)
+{
+    if (ino == FUSE_ROOT_ID) {
+        return;
+    }
+    /* The last reference may free the Link */
+    LinkTable *linktbl = ino_to_Link(ino)->parent_table;
+    for (uint64_t i = 0; i < nlookup; i++) {
+        LinkTable_unref(linktbl);
+    }
+}
+
+static void fs_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup)
+{
+    fs_forget_one(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void fs_forget_multi(fuse_req_t req, size_t count,
+                            struct fuse_forget_data *forgets)
+{
+    for (size_t i = 0; i < count; i++) {
+        fs_forget_one(forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
+
+/** \brief return the attributes of an inode */
+static void fs_getattr(fuse_req_t req, fuse_ino_t ino,
+                       struct fuse_file_info *fi)
+{
+    (void)fi;
+    struct stat stbuf;
+    if (fs_stat(ino == FUSE_ROOT_ID ? NULL : ino_to_Link(ino), &stbuf)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_attr(req, &stbuf, fs_opts.attr_timeout);
+}
+
+/** \brief release an opened file */
+static void fs_release(fuse_req_t req, fuse_ino_t ino,
+                       struct fuse_file_info *fi)
+{
+    lprintf(info, "%s\n", ino_to_Link(ino)->linkname);
+#ifdef FUSE_CAP_PASSTHROUGH
+    if (FH_IS_PASSTHROUGH(fi->fh)) {
+        fuse_passthrough_close(req, FH_BACKING_ID(fi->fh));
+        fuse_reply_err(req, 0);
+        return;
+    }
+#endif
+    if (CACHE_SYSTEM_INIT && fi->fh && fi->fh != BYPASS_FH) {
+        Cache_close((Cache *)fi->fh);
+    }
+    fuse_reply_err(req, 0);
+}
+
+/** \brief answer a read which was waiting for Link_download_async() */
+static void fs_read_reply(const char *buf, long recv, void *userdata)
+{
+    fuse_req_t req = userdata;
+    if (recv < 0) {
+        fuse_reply_err(req, (int)-recv);
     } else {
-        received = path_download(path, buf, size, offset);
+        fuse_reply_buf(req, buf, recv);
     }
-    return received;
 }
 
-/** \brief open a file indicated by the path */
-static int fs_open(const char *path, struct fuse_file_info *fi)
+/** \brief read a file */
+static void fs_read(fuse_req_t req, fuse_ino_t ino, size_t size,
+                    off_t offset, struct fuse_file_info *fi)
 {
-    lprintf(info, "%s\n", path);
-    Link *link = path_to_Link(path);
-    if (!link) {
-        return -ENOENT;
+    /*
+     * Uncached reads are parked until the data arrives, so the worker thread
+     * is free to serve other requests in the meantime.
+     */
+    if (!CACHE_SYSTEM_INIT || fi->fh == BYPASS_FH) {
+        Link_download_async(ino_to_Link(ino), size, offset, fs_read_reply,
+                            req);
+        return;
+    }
+    if (!fi->fh) {
+        fuse_reply_buf(req, NULL, 0);
+        return;
+    }
+
+    /*
+     * Cached data is handed to libfuse as a range of the data file, so it
+     * can be spliced to the kernel without being copied through userspace.
+     */
+    size_t len = size;
+    int fd = Cache_data_fd((Cache *)fi->fh, offset, &len);
+    if (fd != -1) {
+        struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(len);
+        bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        bufv.buf[0].fd = fd;
+        bufv.buf[0].pos = offset;
+        fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+        return;
     }
+
+    char *buf = CALLOC(size ? size : 1, sizeof(char));
+    long received = Cache_read((Cache *)fi->fh, buf, size, offset);
+    fs_read_reply(buf, received, req);
+    FREE(buf);
+}
+
+/**
+ * \brief open the cache of a file
+ * \return the file handle
+ */
+static uint64_t fs_open_cache(fuse_req_t req, Link *link,
+                              struct fuse_file_info *fi)
+{
+    (void)req;
+    (void)fi;
+    if (link->content_length == 0) {
+        return 0; /* valid empty file: bypass cache creation */
+    }
+    off_t file_size = (off_t)link->content_length;
+    if (file_size < 0 || (size_t)file_size != link->content_length
+        || (CONFIG.cache_min_size >= 0 && file_size < CONFIG.cache_min_size)
+        || (CONFIG.cache_max_size >= 0 && file_size > CONFIG.cache_max_size)) {
+        /* bypass cache creation due to size thresholds */
+        return BYPASS_FH;
+    }
+    char *path = Link_get_path(link);
+    if (!path) {
+        /* The directory has been refreshed since the kernel looked it up */
+        return BYPASS_FH;
+    }
+    Cache *cf = Cache_open(path);
+    /*
+     * The cache definitely cannot be opened for some reason.
+     */
+    if (!cf) {
+        lprintf(fatal, "Cache file creation failure for %s.\n", path);
+    }
+    FREE(path);
+
+#ifdef FUSE_CAP_PASSTHROUGH
+    if (fs_passthrough && Cache_complete(cf)) {
+        int backing_id = fuse_passthrough_open(req, cf->dfd);
+        if (backing_id > 0) {
+            /* The kernel keeps its own reference to the data file */
+            fi->backing_id = backing_id;
+            Cache_close(cf);
+            return PASSTHROUGH_FH(backing_id);
+        }
+        lprintf(warning, "FUSE passthrough is unavailable: %s\n",
+                strerror(-backing_id));
+        fs_passthrough = 0;
+    }
+#endif
+    return (uint64_t)cf;
+}
+
+/**
+ * \brief Check whether the kernel may keep the pages of a file it has cached
+ * \details The pages are kept if the size and the time of the file are the
+ * same as when it was last opened. Otherwise the kernel is told to drop the
+ * pages and the attributes of the inode. A refresh of the directory keeps the
+ * Link of the file and updates its size and time in place, see
+ * LinkTable_replace(), and fs_open() stats a file of a HTML listing again
+ * first, see Link_restat(), so this notices the file has changed.
+ */
+static int fs_keep_cache(fuse_ino_t ino, Link *link)
+{
+    PTHREAD_MUTEX_LOCK(&fs_open_lock);
+    int opened = link->open_content_length || link->open_time;
+    int unchanged = link->open_content_length == link->content_length
+                    && link->open_time == link->time;
+    link->open_content_length = link->content_length;
+    link->open_time = link->time;
+    PTHREAD_MUTEX_UNLOCK(&fs_open_lock);
+
+    if (opened && !unchanged) {
+        lprintf(debug, "%s has changed\n", link->linkname);
+        fuse_lowlevel_notify_inval_inode(fs_session, ino, 0, 0);
+    }
+    return unchanged || !opened;
+}
+
+/** \brief open a file */
+static void fs_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    Link *link = ino_to_Link(ino);
+    lprintf(info, "%s\n", link->linkname);
     if ((fi->flags & O_RDWR) != O_RDONLY) {
-        LinkTable_unref(link->parent_table);
-        return -EROFS;
+        fuse_reply_err(req, EROFS);
+        return;
     }
+    Link_restat(link);
     if (CACHE_SYSTEM_INIT) {
-        if (link->content_length == 0) {
-            fi->fh = 0; /* valid empty file: bypass cache creation */
-            LinkTable_unref(link->parent_table);
-            return 0;
-        }
-        int bypass_cache = 0;
-        off_t file_size = (off_t)link->content_length;
-        if (file_size < 0 || (size_t)file_size != link->content_length
-            || (CONFIG.cache_min_size >= 0 && file_size < CONFIG.cache_min_size)
-            || (CONFIG.cache_max_size >= 0
-                && file_size > CONFIG.cache_max_size)) {
-            bypass_cache = 1;
-        }
-        if (bypass_cache) {
-            /* bypass cache creation due to size thresholds */
-            fi->fh = BYPASS_FH;
-            LinkTable_unref(link->parent_table);
-            return 0;
-        }
-        fi->fh = (uint64_t)Cache_open(path);
-        /*
-         * The cache definitely cannot be opened for some reason.
-         */
-        if (!fi->fh) {
-            lprintf(fatal, "Cache file creation failure for %s.\n", path);
+        fi->fh = fs_open_cache(req, link, fi);
+    }
+    if (fs_keep_cache(ino, link) || fs_opts.kernel_cache) {
+        fi->keep_cache = 1;
+    }
+    if (fuse_reply_open(req, fi) && CACHE_SYSTEM_INIT && fi->fh
+        && fi->fh != BYPASS_FH) {
+#ifdef FUSE_CAP_PASSTHROUGH
+        if (FH_IS_PASSTHROUGH(fi->fh)) {
+            fuse_passthrough_close(req, FH_BACKING_ID(fi->fh));
+            return;
         }
+#endif
+        Cache_close((Cache *)fi->fh);
     }
-    LinkTable_unref(link->parent_table);
-    return 0;
 }
 
-static int fs_opendir(const char *path, struct fuse_file_info *fi)
+static void fs_opendir(fuse_req_t req, fuse_ino_t ino,
+                       struct fuse_file_info *fi)
 {
-    LinkTable *linktbl = path_to_LinkTable(path);
+    LinkTable *linktbl = ino_to_LinkTable(ino);
     if (!linktbl) {
-        return -ENOENT;
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    struct FsDir *dir = CALLOC(1, sizeof(struct FsDir));
+    dir->linktbl = linktbl;
+    dir->size = LinkTable_entries(linktbl, &dir->links);
+    fi->fh = (uint64_t)dir;
+    if (fuse_reply_open(req, fi)) {
+        LinkTable_unref(linktbl);
+        FREE(dir);
     }
-    fi->fh = (uint64_t)linktbl;
-    return 0;
 }
 
-static int fs_releasedir(const char *path, struct fuse_file_info *fi)
+static void fs_releasedir(fuse_req_t req, fuse_ino_t ino,
+                          struct fuse_file_info *fi)
 {
-    LinkTable *linktbl = (LinkTable *)fi->fh;
-    if (linktbl) {
-        if (strcmp(path, "/") != 0) {
-            LinkTable_mark_orphaned(linktbl);
+    struct FsDir *dir = (struct FsDir *)fi->fh;
+    if (dir) {
+        if (ino != FUSE_ROOT_ID) {
+            LinkTable_mark_orphaned(dir->linktbl);
         }
-        LinkTable_unref(linktbl);
+        LinkTable_unref(dir->linktbl);
+        FREE(dir);
     }
+    fuse_reply_err(req, 0);
+}
+
+/**
+ * \brief add an entry to the reply of fs_readdir()
+ * \return 1 if the buffer is full, in which case the entry is not added
+ */
+static int fs_dirbuf_add(fuse_req_t req, char *buf, size_t size, size_t *used,
+                         const char *name, fuse_ino_t ino, mode_t mode,
+                         off_t next)
+{
+    struct stat stbuf;
+    memset(&stbuf, 0, sizeof(stbuf));
+    stbuf.st_ino = ino;
+    stbuf.st_mode = mode;
+    size_t len = fuse_add_direntry(req, buf + *used, size - *used, name,
+                                   &stbuf, next);
+    if (len > size - *used) {
+        return 1;
+    }
+    *used += len;
     return 0;
 }
 
 /**
- * \brief read the directory indicated by the path
+ * \brief read the directory indicated by the inode
+ * \details The entries are numbered from 1: "." and ".." come first, then the
+ * Links of the LinkTable from index 1. Each entry is added with the number of
+ * the entry after it, so the kernel can ask for the rest of the directory
+ * from there when its buffer is full.
+ * \note A LinkTable is only attached to the tree once its whole listing has
+ * been parsed, so the pages all come from a complete listing. Serving the
+ * first pages while the rest of the listing is still being downloaded is not
+ * implemented.
  */
-static int fs_readdir(const char *path, void *buf, fuse_fill_dir_t dir_add,
-                      off_t offset, struct fuse_file_info *fi,
-                      enum fuse_readdir_flags fr_flags)
+static void fs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+                       off_t offset, struct fuse_file_info *fi)
 {
-    (void)path;
-    (void)offset;
-    (void)fr_flags;
-    LinkTable *linktbl = (LinkTable *)fi->fh;
+    struct FsDir *dir = (struct FsDir *)fi->fh;
 
-    if (!linktbl) {
-        return -ENOENT;
+    if (!dir) {
+        fuse_reply_err(req, ENOENT);
+        return;
     }
 
-
-    /*
-     * start adding the links
-     */
-    dir_add(buf, ".", NULL, 0, 0);
-    dir_add(buf, "..", NULL, 0, 0);
+    char *buf = CALLOC(size ? size : 1, sizeof(char));
+    size_t used = 0;
+    if (offset < 1
+        && fs_dirbuf_add(req, buf, size, &used, ".", ino, S_IFDIR, 1)) {
+        goto end;
+    }
+    /* The kernel does not use the inode number of ".." */
+    if (offset < 2
+        && fs_dirbuf_add(req, buf, size, &used, "..", FUSE_ROOT_ID, S_IFDIR,
+                         2)) {
+        goto end;
+    }
     /* We skip the head link */
-    for (int i = 1; i < linktbl->size; i++) {
-        Link *link = linktbl->links[i];
-        if (link->type != LINK_INVALID) {
-            dir_add(buf, link->linkname, NULL, 0, 0);
+    for (off_t i = offset > 2 ? offset - 2 : 0; i + 1 < dir->size; i++) {
+        Link *link = dir->links[i + 1];
+        LinkType type = link->type;
+        if (type == LINK_INVALID) {
+            continue;
+        }
+        mode_t mode = type == LINK_DIR    ? S_IFDIR
+                      : type == LINK_FILE ? S_IFREG
+                                          : 0;
+        if (fs_dirbuf_add(req, buf, size, &used, link->linkname,
+                          Link_to_ino(link), mode, i + 3)) {
+            break;
         }
     }
 
-    return 0;
+end:
+    fuse_reply_buf(req, buf, used);
+    FREE(buf);
 }
 
-static struct fuse_operations fs_oper = {.getattr = fs_getattr,
-                                         .opendir = fs_opendir,
-                                         .readdir = fs_readdir,
-                                         .releasedir = fs_releasedir,
-                                         .open = fs_open,
-                                         .read = fs_read,
-                                         .init = fs_init,
-                                         .release = fs_release};
+static const struct fuse_lowlevel_ops fs_oper = {
+    .init = fs_init,
+    .destroy = fs_destroy,
+    .lookup = fs_lookup,
+    .forget = fs_forget,
+    .forget_multi = fs_forget_multi,
+    .getattr = fs_getattr,
+    .open = fs_open,
+    .read = fs_read,
+    .release = fs_release,
+    .opendir = fs_opendir,
+    .readdir = fs_readdir,
+    .releasedir = fs_releasedir,
+};
 
 int fuse_local_init(int argc, char **argv)
 {
-    return fuse_main(argc, argv, &fs_oper, NULL);
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts opts;
+    struct fuse_session *se;
+    int res = 1;
+
+    if (fuse_parse_cmdline(&args, &opts)) {
+        return 1;
+    }
+    if (opts.show_help) {
+        printf("FUSE options:\n");
+        fuse_cmdline_help();
+        fs_opt_help();
+        fuse_lowlevel_help();
+        res = 0;
+        goto out;
+    }
+    if (opts.show_version) {
+        printf("FUSE library version %s\n", fuse_pkgversion());
+        fuse_lowlevel_version();
+        res = 0;
+        goto out;
+    }
+    if (fuse_opt_parse(&args, &fs_opts, fs_opt_spec, NULL)) {
+        goto out;
+    }
+    /*
+     * The kernel may cache what it has looked up until the directory is
+     * refreshed, fs_notify_replace() invalidates it when that happens.
+     */
+    double timeout = CONFIG.refresh_timeout > 0 ? CONFIG.refresh_timeout : 0;
+    if (fs_opts.entry_timeout < 0) {
+        fs_opts.entry_timeout = timeout;
+    }
+    if (fs_opts.negative_timeout < 0) {
+        fs_opts.negative_timeout = timeout;
+    }
+    if (fs_opts.attr_timeout < 0) {
+        fs_opts.attr_timeout = timeout;
+    }
+
+    se = fuse_session_new(&args, &fs_oper, sizeof(fs_oper), NULL);
+    if (!se) {
+        goto out;
+    }
+    fs_session = se;
+    if (fuse_set_signal_handlers(se)) {
+        goto destroy;
+    }
+    if (fuse_session_mount(se, opts.mountpoint)) {
+        goto remove_handlers;
+    }
+
+    fuse_daemonize(opts.foreground);
+    if (opts.singlethread) {
+        res = fuse_session_loop(se);
+    } else {
+        struct fuse_loop_config config = {
+            .clone_fd = opts.clone_fd,
+            .max_idle_threads = opts.max_idle_threads,
+        };
+        res = fuse_session_loop_mt(se, &config);
+    }
+    fuse_session_unmount(se);
+
+remove_handlers:
+    fuse_remove_signal_handlers(se);
+destroy:
+    fuse_session_destroy(se);
+out:
+    /* These were allocated by libfuse */
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    return res ? 1 : 0;
 }
@@ -0,0 +1,446 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+/**
+ * \file html.c
+ * \brief Streaming HTML link extractor implementation
+ * \details The states loosely follow the tokenisation section of the HTML
+ * standard, with everything which does not affect the href attributes of the
+ * \<a\> tags left out.
+ */
+
+#include "html.h"
+
+#include "util.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \brief The maximum length of the tag and attribute names we care about
+ */
+#define HTML_NAME_MAX 15
+
+/**
+ * \brief The tokeniser states
+ */
+typedef enum {
+    HTML_TEXT,
+    HTML_TAG_OPEN,
+    HTML_TAG_NAME,
+    HTML_END_TAG_OPEN,
+    HTML_END_TAG,
+    HTML_BEFORE_ATTR_NAME,
+    HTML_ATTR_NAME,
+    HTML_AFTER_ATTR_NAME,
+    HTML_BEFORE_ATTR_VALUE,
+    HTML_ATTR_VALUE_DQ,
+    HTML_ATTR_VALUE_SQ,
+    HTML_ATTR_VALUE_UQ,
+    /** \brief After "<!" */
+    HTML_MARKUP_DECL,
+    /** \brief After "<!--" */
+    HTML_COMMENT,
+    /** \brief Inside "<!...>" or "<?...>" */
+    HTML_BOGUS_COMMENT,
+    /** \brief Inside an element whose content is not markup, e.g. script */
+    HTML_RAWTEXT,
+} HtmlState;
+
+struct HtmlLinks {
+    HtmlHref_cb cb;
+    void *userdata;
+    HtmlState state;
+    /** \brief The lower case name of the current tag */
+    char tag[HTML_NAME_MAX + 1];
+    size_t tag_len;
+    /** \brief The lower case name of the current attribute */
+    char attr[HTML_NAME_MAX + 1];
+    size_t attr_len;
+    /** \brief The value of the current attribute */
+    char value[PATH_MAX + 1];
+    size_t value_len;
+    /** \brief The href of the current \<a\> tag */
+    char href[PATH_MAX + 1];
+    int has_href;
+    /** \brief The tag which ends the current HTML_RAWTEXT section */
+    char raw_end[HTML_NAME_MAX + 1];
+    /**
+     * \brief How much of the terminating sequence of a comment or a raw text
+     * section has been matched
+     */
+    size_t match;
+};
+
+HtmlLinks *HtmlLinks_new(HtmlHref_cb cb, void *userdata)
+{
+    HtmlLinks *parser = CALLOC(1, sizeof(HtmlLinks));
+    parser->cb = cb;
+    parser->userdata = userdata;
+    parser->state = HTML_TEXT;
+    return parser;
+}
+
+void HtmlLinks_free(HtmlLinks *parser)
+{
+    FREE(parser);
+}
+
+static int html_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/**
+ * \brief Append a character to a lower case name buffer
+ * \details Names longer than HTML_NAME_MAX are mangled on purpose, so that
+ * they never match the names we are looking for.
+ */
+static void html_name_append(char *name, size_t *len, char c)
+{
+    if (*len < HTML_NAME_MAX) {
+        name[(*len)++] = (char)tolower((unsigned char)c);
+        name[*len] = '\0';
+    } else {
+        name[0] = '\0';
+    }
+}
+
+static void HtmlLinks_start_tag(HtmlLinks *parser, char c)
+{
+    parser->tag_len = 0;
+    parser->tag[0] = '\0';
+    parser->has_href = 0;
+    html_name_append(parser->tag, &parser->tag_len, c);
+    parser->state = HTML_TAG_NAME;
+}
+
+static void HtmlLinks_start_attr(HtmlLinks *parser, char c)
+{
+    parser->attr_len = 0;
+    parser->attr[0] = '\0';
+    parser->value_len = 0;
+    html_name_append(parser->attr, &parser->attr_len, c);
+    parser->state = HTML_ATTR_NAME;
+}
+
+static void HtmlLinks_value_append(HtmlLinks *parser, char c)
+{
+    /* Over-long values cannot be valid links anyway, they get truncated */
+    if (parser->value_len < PATH_MAX) {
+        parser->value[parser->value_len++] = c;
+    }
+}
+
+/**
+ * \brief Handle the end of an attribute value
+ * \details Only the first href attribute of a tag counts.
+ */
+static void HtmlLinks_attr_end(HtmlLinks *parser)
+{
+    if (!parser->has_href && !strcmp(parser->tag, "a")
+        && !strcmp(parser->attr, "href")) {
+        memcpy(parser->href, parser->value, parser->value_len);
+        parser->href[parser->value_len] = '\0';
+        html_unescape(parser->href);
+        parser->has_href = 1;
+    }
+}
+
+/**
+ * \brief Handle the '>' of a start tag
+ */
+static void HtmlLinks_tag_end(HtmlLinks *parser)
+{
+    parser->state = HTML_TEXT;
+    if (!strcmp(parser->tag, "a")) {
+        if (parser->has_href) {
+            parser->cb(parser->userdata, parser->href);
+        }
+    } else if (!strcmp(parser->tag, "script") || !strcmp(parser->tag, "style")
+               || !strcmp(parser->tag, "textarea")
+               || !strcmp(parser->tag, "title")) {
+        memcpy(parser->raw_end, parser->tag, parser->tag_len + 1);
+        parser->match = 0;
+        parser->state = HTML_RAWTEXT;
+    }
+}
+
+/**
+ * \brief Look for the end tag of a raw text section
+ */
+static void HtmlLinks_rawtext(HtmlLinks *parser, char c)
+{
+    size_t end_len = strlen(parser->raw_end) + 2;
+    if (parser->match == end_len) {
+        /* We have seen "</script", make sure it is not "</scripts" */
+        if (html_is_space(c) || c == '/' || c == '>') {
+            parser->state = c == '>' ? HTML_TEXT : HTML_END_TAG;
+            return;
+        }
+        parser->match = 0;
+    }
+
+    char expected;
+    if (parser->match == 0) {
+        expected = '<';
+    } else if (parser->match == 1) {
+        expected = '/';
+    } else {
+        expected = parser->raw_end[parser->match - 2];
+    }
+    if (tolower((unsigned char)c) == expected) {
+        parser->match++;
+    } else {
+        parser->match = c == '<' ? 1 : 0;
+    }
+}
+
+void HtmlLinks_feed(HtmlLinks *parser, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        switch (parser->state) {
+        case HTML_TEXT:
+            if (c == '<') {
+                parser->state = HTML_TAG_OPEN;
+            }
+            break;
+        case HTML_TAG_OPEN:
+            if (c == '!') {
+                parser->match = 0;
+                parser->state = HTML_MARKUP_DECL;
+            } else if (c == '/') {
+                parser->state = HTML_END_TAG_OPEN;
+            } else if (isalpha((unsigned char)c)) {
+                HtmlLinks_start_tag(parser, c);
+            } else if (c == '?') {
+                parser->state = HTML_BOGUS_COMMENT;
+            } else if (c != '<') {
+                parser->state = HTML_TEXT;
+            }
+            break;
+        case HTML_END_TAG_OPEN:
+            if (c == '>') {
+                parser->state = HTML_TEXT;
+            } else if (isalpha((unsigned char)c)) {
+                parser->state = HTML_END_TAG;
+            } else {
+                parser->state = HTML_BOGUS_COMMENT;
+            }
+            break;
+        case HTML_END_TAG:
+            /* We do not care about the content of end tags */
+            if (c == '>') {
+                parser->state = HTML_TEXT;
+            }
+            break;
+        case HTML_TAG_NAME:
+            if (html_is_space(c) || c == '/') {
+                parser->state = HTML_BEFORE_ATTR_NAME;
+            } else if (c == '>') {
+                HtmlLinks_tag_end(parser);
+            } else {
+                html_name_append(parser->tag, &parser->tag_len, c);
+            }
+            break;
+        case HTML_BEFORE_ATTR_NAME:
+            if (c == '>') {
+                HtmlLinks_tag_end(parser);
+            } else if (!html_is_space(c) && c != '/') {
+                HtmlLinks_start_attr(parser, c);
+            }
+            break;
+        case HTML_ATTR_NAME:
+            if (html_is_space(c)) {
+                parser->state = HTML_AFTER_ATTR_NAME;
+            } else if (c == '/') {
+                parser->state = HTML_BEFORE_ATTR_NAME;
+            } else if (c == '=') {
+                parser->state = HTML_BEFORE_ATTR_VALUE;
+            } else if (c == '>') {
+                HtmlLinks_tag_end(parser);
+            } else {
+                html_name_append(parser->attr, &parser->attr_len, c);
+            }
+            break;
+        case HTML_AFTER_ATTR_NAME:
+            if (c == '=') {
+                parser->state = HTML_BEFORE_ATTR_VALUE;
+            } else if (c == '/') {
+                parser->state = HTML_BEFORE_ATTR_NAME;
+            } else if (c == '>') {
+                HtmlLinks_tag_end(parser);
+            } else if (!html_is_space(c)) {
+                HtmlLinks_start_attr(parser, c);
+            }
+            break;
+        case HTML_BEFORE_ATTR_VALUE:
+            if (c == '"') {
+                parser->state = HTML_ATTR_VALUE_DQ;
+            } else if (c == '\'') {
+                parser->state = HTML_ATTR_VALUE_SQ;
+            } else if (c == '>') {
+                HtmlLinks_attr_end(parser);
+                HtmlLinks_tag_end(parser);
+            } else if (!html_is_space(c)) {
+                HtmlLinks_value_append(parser, c);
+                parser->state = HTML_ATTR_VALUE_UQ;
+            }
+            break;
+        case HTML_ATTR_VALUE_DQ:
+        case HTML_ATTR_VALUE_SQ:
+            if (c == (parser->state == HTML_ATTR_VALUE_DQ ? '"' : '\'')) {
+                HtmlLinks_attr_end(parser);
+                parser->state = HTML_BEFORE_ATTR_NAME;
+            } else {
+                HtmlLinks_value_append(parser, c);
+            }
+            break;
+        case HTML_ATTR_VALUE_UQ:
+            if (html_is_space(c)) {
+                HtmlLinks_attr_end(parser);
+                parser->state = HTML_BEFORE_ATTR_NAME;
+            } else if (c == '>') {
+                HtmlLinks_attr_end(parser);
+                HtmlLinks_tag_end(parser);
+            } else {
+                HtmlLinks_value_append(parser, c);
+            }
+            break;
+        case HTML_MARKUP_DECL:
+            if (c == '-' && parser->match == 0) {
+                parser->match = 1;
+            } else if (c == '-' && parser->match == 1) {
+                parser->match = 0;
+                parser->state = HTML_COMMENT;
+            } else if (c == '>') {
+                parser->state = HTML_TEXT;
+            } else {
+                parser->state = HTML_BOGUS_COMMENT;
+            }
+            break;
+        case HTML_COMMENT:
+            /* parser->match counts the consecutive dashes */
+            if (c == '-') {
+                parser->match++;
+            } else if (c == '>' && parser->match >= 2) {
+                parser->state = HTML_TEXT;
+            } else {
+                parser->match = 0;
+            }
+            break;
+        case HTML_BOGUS_COMMENT:
+            if (c == '>') {
+                parser->state = HTML_TEXT;
+            }
+            break;
+        case HTML_RAWTEXT:
+            HtmlLinks_rawtext(parser, c);
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Encode a code point as UTF-8
+ * \return the number of bytes written
+ */
+static size_t utf8_encode(char *out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+void html_unescape(char *str)
+{
+    static const struct {
+        const char *name;
+        unsigned long cp;
+    } entities[] = {{"amp", '&'},   {"lt", '<'},    {"gt", '>'},
+                    {"quot", '"'},  {"apos", '\''}, {"nbsp", 0xA0}};
+
+    char *out = str;
+    const char *in = str;
+    while (*in) {
+        if (*in != '&') {
+            *out++ = *in++;
+            continue;
+        }
+        const char *semicolon = strchr(in, ';');
+        unsigned long cp = 0;
+        int decoded = 0;
+        if (semicolon && in[1] == '#') {
+            char *end = NULL;
+            if (in[2] == 'x' || in[2] == 'X') {
+                cp = strtoul(in + 3, &end, 16);
+                decoded = end != in + 3 && end == semicolon;
+            } else {
+                cp = strtoul(in + 2, &end, 10);
+                decoded = end != in + 2 && end == semicolon;
+            }
+            if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                /* The standard says these become U+FFFD */
+                cp = 0xFFFD;
+            }
+        } else if (semicolon) {
+            size_t name_len = (size_t)(semicolon - in - 1);
+            for (size_t i = 0; i < sizeof(entities) / sizeof(entities[0]);
+                 i++) {
+                if (strlen(entities[i].name) == name_len
+                    && !strncmp(in + 1, entities[i].name, name_len)) {
+                    cp = entities[i].cp;
+                    decoded = 1;
+                    break;
+                }
+            }
+        }
+        if (decoded) {
+            /* The encoded form is always shorter than the reference */
+            out += utf8_encode(out, cp);
+            in = semicolon + 1;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
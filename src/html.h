@@ -0,0 +1,72 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+#ifndef HTML_H
+#define HTML_H
+
+/**
+ * \file html.h
+ * \brief Streaming HTML link extractor header
+ * \details This is a small HTML tokeniser which only looks for the href
+ * attributes of the \<a\> start tags. It skips comments, as well as the
+ * contents of \<script\>, \<style\>, \<textarea\> and \<title\>, so that
+ * anything which looks like a link in there is ignored. It is fed with
+ * arbitrarily sized chunks of the document, and its memory usage does not
+ * depend on the size of the document.
+ */
+
+#include <stddef.h>
+
+/**
+ * \brief The callback which is invoked for every href attribute
+ * \param[in] href the value of the attribute, with character references
+ * decoded
+ */
+typedef void (*HtmlHref_cb)(void *userdata, const char *href);
+
+typedef struct HtmlLinks HtmlLinks;
+
+/**
+ * \brief Create a streaming HTML link extractor
+ * \param[in] cb the callback for each link
+ * \param[in] userdata the pointer passed to the callback
+ */
+HtmlLinks *HtmlLinks_new(HtmlHref_cb cb, void *userdata);
+
+/**
+ * \brief Feed a chunk of the document into the link extractor
+ */
+void HtmlLinks_feed(HtmlLinks *parser, const char *data, size_t len);
+
+/**
+ * \brief Free a streaming HTML link extractor
+ */
+void HtmlLinks_free(HtmlLinks *parser);
+
+/**
+ * \brief Decode the character references in an attribute value in place
+ */
+void html_unescape(char *str);
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+/**
+ * \file json.c
+ * \brief Streaming JSON directory listing parser implementation
+ * \details This is not a general purpose JSON parser. It only tracks enough
+ * of the structure to pick out the members of the objects inside the top
+ * level array. Everything else is skipped without being stored, so memory
+ * usage stays constant regardless of the size of the listing.
+ */
+
+#include "json.h"
+
+#include "util.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * \brief The tokeniser states
+ */
+typedef enum {
+    /** \brief Expecting the first byte of the document */
+    JSON_START,
+    /** \brief In between tokens */
+    JSON_VALUE,
+    /** \brief Inside a string */
+    JSON_STRING,
+    /** \brief After a backslash inside a string */
+    JSON_STRING_ESC,
+    /** \brief Inside a \\uXXXX escape sequence */
+    JSON_STRING_UNICODE,
+    /** \brief Inside a number or a literal, e.g. true, false, null */
+    JSON_BARE,
+} JsonState;
+
+struct JsonListing {
+    JsonEntry_cb cb;
+    void *userdata;
+    JsonState state;
+    /** \brief The number of currently open arrays and objects */
+    int depth;
+    /** \brief Bit n is set if the container at depth n + 1 is an array */
+    uint64_t array_mask;
+    /** \brief Whether the next string at the entry level is a member name */
+    int expect_key;
+    /** \brief The name of the member currently being parsed */
+    char key[16];
+    /** \brief The buffer for the token currently being parsed */
+    char tok[NAME_MAX + 1];
+    size_t tok_len;
+    int tok_overflow;
+    /** \brief The code point of the \\uXXXX sequence being parsed */
+    unsigned int uni;
+    int uni_len;
+    /** \brief The high surrogate of a UTF-16 surrogate pair */
+    unsigned int hi_surrogate;
+    /** \brief The entry currently being assembled */
+    JsonEntry entry;
+    int entry_invalid;
+};
+
+JsonListing *JsonListing_new(JsonEntry_cb cb, void *userdata)
+{
+    JsonListing *parser = CALLOC(1, sizeof(JsonListing));
+    parser->cb = cb;
+    parser->userdata = userdata;
+    parser->state = JSON_START;
+    return parser;
+}
+
+void JsonListing_free(JsonListing *parser)
+{
+    FREE(parser);
+}
+
+/**
+ * \brief Whether we are directly inside an object of the top level array
+ */
+static int JsonListing_at_entry(const JsonListing *parser)
+{
+    return parser->depth == 2 && (parser->array_mask & 1)
+           && !(parser->array_mask & 2);
+}
+
+static void JsonListing_tok_append(JsonListing *parser, char c)
+{
+    if (parser->tok_len < NAME_MAX) {
+        parser->tok[parser->tok_len++] = c;
+        parser->tok[parser->tok_len] = '\0';
+    } else {
+        parser->tok_overflow = 1;
+    }
+}
+
+static void JsonListing_tok_append_utf8(JsonListing *parser, unsigned int cp)
+{
+    if (cp < 0x80) {
+        JsonListing_tok_append(parser, (char)cp);
+    } else if (cp < 0x800) {
+        JsonListing_tok_append(parser, (char)(0xC0 | (cp >> 6)));
+        JsonListing_tok_append(parser, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        JsonListing_tok_append(parser, (char)(0xE0 | (cp >> 12)));
+        JsonListing_tok_append(parser, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        JsonListing_tok_append(parser, (char)(0x80 | (cp & 0x3F)));
+    } else {
+        JsonListing_tok_append(parser, (char)(0xF0 | (cp >> 18)));
+        JsonListing_tok_append(parser, (char)(0x80 | ((cp >> 12) & 0x3F)));
+        JsonListing_tok_append(parser, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        JsonListing_tok_append(parser, (char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+static void JsonListing_tok_reset(JsonListing *parser)
+{
+    parser->tok_len = 0;
+    parser->tok[0] = '\0';
+    parser->tok_overflow = 0;
+}
+
+/**
+ * \brief Copy the current token into a fixed size field, truncating it
+ */
+static void JsonListing_tok_copy(const JsonListing *parser, char *dst,
+                                 size_t dst_size)
+{
+    size_t len = parser->tok_len < dst_size - 1 ? parser->tok_len
+                                                : dst_size - 1;
+    memcpy(dst, parser->tok, len);
+    dst[len] = '\0';
+}
+
+/**
+ * \brief Handle a complete string token
+ */
+static void JsonListing_string_end(JsonListing *parser)
+{
+    if (!JsonListing_at_entry(parser)) {
+        return;
+    }
+    if (parser->expect_key) {
+        if (parser->tok_len < sizeof(parser->key)) {
+            JsonListing_tok_copy(parser, parser->key, sizeof(parser->key));
+        } else {
+            parser->key[0] = '\0';
+        }
+        return;
+    }
+    if (!strcmp(parser->key, "name")) {
+        if (parser->tok_overflow) {
+            parser->entry_invalid = 1;
+        }
+        JsonListing_tok_copy(parser, parser->entry.name,
+                             sizeof(parser->entry.name));
+    } else if (!strcmp(parser->key, "type")) {
+        JsonListing_tok_copy(parser, parser->entry.type,
+                             sizeof(parser->entry.type));
+    } else if (!strcmp(parser->key, "mtime")) {
+        JsonListing_tok_copy(parser, parser->entry.mtime,
+                             sizeof(parser->entry.mtime));
+    }
+}
+
+/**
+ * \brief Handle a complete number or literal token
+ */
+static void JsonListing_bare_end(JsonListing *parser)
+{
+    if (!JsonListing_at_entry(parser) || parser->expect_key) {
+        return;
+    }
+    if (!strcmp(parser->key, "size") && !parser->tok_overflow) {
+        char *end = NULL;
+        long long size = strtoll(parser->tok, &end, 10);
+        if (end != parser->tok && size >= 0) {
+            parser->entry.size = (off_t)size;
+        }
+    }
+}
+
+static void JsonListing_open(JsonListing *parser, int is_array)
+{
+    if (parser->depth < 64) {
+        if (is_array) {
+            parser->array_mask |= (uint64_t)1 << parser->depth;
+        } else {
+            parser->array_mask &= ~((uint64_t)1 << parser->depth);
+        }
+    }
+    parser->depth++;
+    if (JsonListing_at_entry(parser)) {
+        memset(&parser->entry, 0, sizeof(JsonEntry));
+        parser->entry.size = -1;
+        parser->entry_invalid = 0;
+        parser->expect_key = 1;
+        parser->key[0] = '\0';
+    }
+}
+
+static void JsonListing_close(JsonListing *parser)
+{
+    if (parser->depth <= 0) {
+        return;
+    }
+    if (JsonListing_at_entry(parser) && !parser->entry_invalid
+        && parser->entry.name[0] != '\0') {
+        parser->cb(parser->userdata, &parser->entry);
+    }
+    parser->depth--;
+}
+
+/**
+ * \brief Process one byte in between tokens
+ * \return -1 if the document turns out not to be a JSON listing
+ */
+static int JsonListing_value(JsonListing *parser, char c)
+{
+    switch (c) {
+    case '[':
+        JsonListing_open(parser, 1);
+        break;
+    case '{':
+        JsonListing_open(parser, 0);
+        break;
+    case ']':
+    case '}':
+        JsonListing_close(parser);
+        break;
+    case ':':
+        if (JsonListing_at_entry(parser)) {
+            parser->expect_key = 0;
+        }
+        break;
+    case ',':
+        if (JsonListing_at_entry(parser)) {
+            parser->expect_key = 1;
+            parser->key[0] = '\0';
+        }
+        break;
+    case '"':
+        JsonListing_tok_reset(parser);
+        parser->state = JSON_STRING;
+        break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        break;
+    default:
+        JsonListing_tok_reset(parser);
+        JsonListing_tok_append(parser, c);
+        parser->state = JSON_BARE;
+        break;
+    }
+    return 0;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+int JsonListing_feed(JsonListing *parser, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        switch (parser->state) {
+        case JSON_START:
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                break;
+            }
+            /* Skip the UTF-8 byte order mark, if there is one. */
+            if ((unsigned char)c == 0xEF || (unsigned char)c == 0xBB
+                || (unsigned char)c == 0xBF) {
+                break;
+            }
+            if (c != '[') {
+                return -1;
+            }
+            parser->state = JSON_VALUE;
+            JsonListing_open(parser, 1);
+            break;
+        case JSON_VALUE:
+            if (JsonListing_value(parser, c)) {
+                return -1;
+            }
+            break;
+        case JSON_STRING:
+            if (c == '\\') {
+                parser->state = JSON_STRING_ESC;
+            } else if (c == '"') {
+                JsonListing_string_end(parser);
+                parser->state = JSON_VALUE;
+            } else {
+                JsonListing_tok_append(parser, c);
+            }
+            break;
+        case JSON_STRING_ESC:
+            parser->state = JSON_STRING;
+            switch (c) {
+            case 'b':
+                JsonListing_tok_append(parser, '\b');
+                break;
+            case 'f':
+                JsonListing_tok_append(parser, '\f');
+                break;
+            case 'n':
+                JsonListing_tok_append(parser, '\n');
+                break;
+            case 'r':
+                JsonListing_tok_append(parser, '\r');
+                break;
+            case 't':
+                JsonListing_tok_append(parser, '\t');
+                break;
+            case 'u':
+                parser->uni = 0;
+                parser->uni_len = 0;
+                parser->state = JSON_STRING_UNICODE;
+                break;
+            default:
+                /* This covers '"', '\\' and '/' */
+                JsonListing_tok_append(parser, c);
+                break;
+            }
+            break;
+        case JSON_STRING_UNICODE: {
+            int h = hex_value(c);
+            if (h < 0) {
+                /* Malformed escape sequence, keep going regardless */
+                parser->state = JSON_STRING;
+                parser->hi_surrogate = 0;
+                i--;
+                break;
+            }
+            parser->uni = (parser->uni << 4) | (unsigned int)h;
+            if (++parser->uni_len < 4) {
+                break;
+            }
+            parser->state = JSON_STRING;
+            if (parser->uni >= 0xD800 && parser->uni <= 0xDBFF) {
+                parser->hi_surrogate = parser->uni;
+            } else if (parser->uni >= 0xDC00 && parser->uni <= 0xDFFF) {
+                if (parser->hi_surrogate) {
+                    unsigned int cp = 0x10000
+                                      + ((parser->hi_surrogate - 0xD800) << 10)
+                                      + (parser->uni - 0xDC00);
+                    JsonListing_tok_append_utf8(parser, cp);
+                }
+                parser->hi_surrogate = 0;
+            } else {
+                JsonListing_tok_append_utf8(parser, parser->uni);
+                parser->hi_surrogate = 0;
+            }
+        } break;
+        case JSON_BARE:
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+                || (c >= 'A' && c <= 'Z') || c == '-' || c == '+'
+                || c == '.') {
+                JsonListing_tok_append(parser, c);
+            } else {
+                JsonListing_bare_end(parser);
+                parser->state = JSON_VALUE;
+                if (JsonListing_value(parser, c)) {
+                    return -1;
+                }
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+long JsonEntry_mtime(const JsonEntry *entry)
+{
+    struct tm tm = {0};
+    const char *end
+        = strptime(entry->mtime, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) {
+        return 0;
+    }
+    return (long)timegm(&tm);
+}
@@ -0,0 +1,97 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+#ifndef JSON_H
+#define JSON_H
+
+/**
+ * \file json.h
+ * \brief Streaming JSON directory listing parser header
+ * \details This parses the directory listings generated by nginx with
+ * "autoindex_format json;", which look like:
+ *
+ *     [
+ *       { "name":"dir", "type":"directory", "mtime":"..." },
+ *       { "name":"file", "type":"file", "mtime":"...", "size":123 }
+ *     ]
+ *
+ * The parser is fed with arbitrarily sized chunks of the response body, and
+ * it invokes a callback for every complete entry.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * \brief The maximum length of the mtime string we keep
+ */
+#define JSON_MTIME_MAX 64
+
+/**
+ * \brief A single entry of a JSON directory listing
+ */
+typedef struct {
+    /** \brief The unescaped name of the entry */
+    char name[NAME_MAX + 1];
+    /** \brief The "type" field, e.g. "file" or "directory" */
+    char type[16];
+    /** \brief The "mtime" field, in the RFC 1123 format */
+    char mtime[JSON_MTIME_MAX];
+    /** \brief The "size" field, -1 if it was not supplied */
+    off_t size;
+} JsonEntry;
+
+/**
+ * \brief The callback which is invoked for every complete entry
+ */
+typedef void (*JsonEntry_cb)(void *userdata, const JsonEntry *entry);
+
+typedef struct JsonListing JsonListing;
+
+/**
+ * \brief Create a streaming JSON listing parser
+ * \param[in] cb the callback for each entry
+ * \param[in] userdata the pointer passed to the callback
+ */
+JsonListing *JsonListing_new(JsonEntry_cb cb, void *userdata);
+
+/**
+ * \brief Feed a chunk of the response body into the parser
+ * \return 0 on success, -1 if the input is not a JSON listing
+ */
+int JsonListing_feed(JsonListing *parser, const char *data, size_t len);
+
+/**
+ * \brief Free a streaming JSON listing parser
+ */
+void JsonListing_free(JsonListing *parser);
+
+/**
+ * \brief Convert a JSON listing mtime string to a time value
+ * \return the time since epoch, or 0 if the string cannot be parsed
+ */
+long JsonEntry_mtime(const JsonEntry *entry);
+
+#endif
@@ -30,7 +30,10 @@
 
 #include "cache.h"
 #include "config.h"
+#include "html.h"
+#include "json.h"
 #include "log.h"
+#include "manifest.h"
 #include "memcache.h"
 #include "network.h"
 #include "util.h"
@@ -38,14 +41,24 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
-#include <gumbo.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/param.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <zlib.h>
 
-#define STATUS_LEN 64
+/**
+ * \brief The sizes of the first and the largest blocks of a LinkArena
+ */
+#define LINK_ARENA_MIN_BLOCK 1024
+#define LINK_ARENA_MAX_BLOCK 65536
 
 /*
  * ---------------- External variables -----------------------
@@ -54,46 +67,179 @@ LinkTable *ROOT_LINK_TBL = NULL;
 int ROOT_LINK_OFFSET = 0;
 
 /**
- * \brief LinkTable generation priority lock
- * \details This allows LinkTable generation to be run exclusively. This
- * effectively gives LinkTable generation priority over file transfer.
+ * \brief The lock protecting the structure of the LinkTable tree
+ * \details Lookups only take this for reading, so they run in parallel.
+ * Attaching, replacing and freeing LinkTables take it for writing.
+ */
+static pthread_rwlock_t link_lock = PTHREAD_RWLOCK_INITIALIZER;
+/**
+ * \brief Serialises the building of the hash indexes of the LinkTables
+ */
+static pthread_mutex_t link_index_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * \brief Incremented whenever a LinkTable is freed or replaced, this
+ * invalidates every entry of the path cache.
+ */
+static atomic_ulong link_generation = 1;
+
+/**
+ * \brief The number of LinkTable_fill_worker() threads running, protected by
+ * link_fill_lock
+ */
+static int link_fills;
+static pthread_mutex_t link_fill_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * \brief Broadcast whenever a LinkTable_fill_worker() has stat'ed some
+ * entries, and when it finishes
+ */
+static pthread_cond_t link_fill_cond = PTHREAD_COND_INITIALIZER;
+
+/** \brief The function called after LinkTable_replace() */
+static struct {
+    pthread_mutex_t lock;
+    /** \brief Broadcast when the last running call of callback returns */
+    pthread_cond_t cond;
+    /** \brief See LinkSystem_on_replace() */
+    LinkReplaceCallback callback;
+    /** \brief The number of calls of callback which have not returned */
+    int running;
+} link_replace = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                   .cond = PTHREAD_COND_INITIALIZER };
+/**
+ * \brief The LinkTables which are part of the tree, in the order they were
+ * attached
+ * \details LinkTable_evict() sweeps them like the hand of a clock, so the
+ * ones which have not been used for the longest time are evicted first. The
+ * lock is taken after link_lock, never the other way round.
  */
-static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    pthread_mutex_t lock;
+    LinkTable *head;
+    LinkTable *tail;
+    /** \brief The next LinkTable LinkTable_evict() looks at */
+    LinkTable *hand;
+    size_t n_tables;
+    atomic_size_t bytes;
+    atomic_ulong evictions;
+    /** \brief Set while a thread is evicting LinkTables */
+    atomic_int evicting;
+} link_residency = {.lock = PTHREAD_MUTEX_INITIALIZER};
 static void make_link_relative(const char *page_url, char *link_url);
+static int LinkTable_download(LinkTable *linktbl, const char *url,
+                              const LinkTable *stale);
+static void LinkTableMap_unref(struct LinkTableMap *map);
+static LinkTable *LinkTree_disk_open(const char *url);
+static void LinkTable_fill_start(LinkTable *linktbl);
+static void LinkTable_resident_remove(LinkTable *linktbl);
+static void LinkTree_resident_add(LinkTable *linktbl);
+static void LinkTable_evict(void);
 
 /**
- * \brief create a new Link
+ * \brief A LinkTable or LinkTree file mapped into memory
+ * \details It is shared by the LinkTables whose strings point into it, and
+ * unmapped when the last of them is freed.
  */
-static Link *Link_new(const char *linkname, LinkType type)
-{
-    Link *link = CALLOC(1, sizeof(Link));
+struct LinkTableMap {
+    atomic_int refcount;
+    size_t size;
+    char *addr;
+};
 
-    strncpy(link->linkname, linkname, NAME_MAX);
-    strncpy(link->linkpath, linkname, NAME_MAX);
-    link->type = type;
+/**
+ * \brief A block of memory which Links and their strings are allocated from
+ * \details The blocks of a LinkTable are chained together, and only freed with
+ * the LinkTable, so nothing allocated from them ever moves.
+ */
+struct LinkArena {
+    struct LinkArena *next;
+    /** \brief The size of data */
+    size_t size;
+    /** \brief The number of bytes of data handed out */
+    size_t used;
+    max_align_t data[];
+};
 
-    /*
-     * remove the '/' from linkname if it exists
-     */
-    size_t len = strnlen(link->linkname, NAME_MAX);
-    if (len > 0) {
-        char *c = &(link->linkname[len - 1]);
-        if (*c == '/') {
-            *c = '\0';
+/**
+ * \brief Allocate zeroed memory from the arena of a LinkTable
+ */
+static void *LinkArena_alloc(LinkTable *linktbl, size_t size, size_t align)
+{
+    struct LinkArena *arena = linktbl->arena;
+    size_t offset = arena ? (arena->used + align - 1) & ~(align - 1) : 0;
+    if (!arena || offset + size > arena->size) {
+        /* Small tables stay small, big ones get fewer, larger blocks */
+        size_t block_size = arena ? arena->size * 2 : LINK_ARENA_MIN_BLOCK;
+        if (block_size > LINK_ARENA_MAX_BLOCK) {
+            block_size = LINK_ARENA_MAX_BLOCK;
+        }
+        if (block_size < size) {
+            block_size = size;
         }
+        arena = CALLOC(1, sizeof(struct LinkArena) + block_size);
+        arena->size = block_size;
+        arena->next = linktbl->arena;
+        linktbl->arena = arena;
+        offset = 0;
+    }
+    arena->used = offset + size;
+    return (char *)arena->data + offset;
+}
+
+/**
+ * \brief Copy at most n bytes of a string into the arena of a LinkTable
+ */
+static char *LinkArena_strndup(LinkTable *linktbl, const char *str, size_t n)
+{
+    size_t len = strnlen(str, n);
+    char *copy = LinkArena_alloc(linktbl, len + 1, 1);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/**
+ * \brief A links array which a refresh has swapped out of a LinkTable, see
+ * LinkTable_entries()
+ */
+struct LinkRetired {
+    struct LinkRetired *prev;
+    Link **links;
+    int capacity;
+};
+
+static void LinkArena_free(struct LinkArena *arena)
+{
+    while (arena) {
+        struct LinkArena *next = arena->next;
+        FREE(arena);
+        arena = next;
     }
+}
 
-    return link;
+/**
+ * \brief Check whether a URL has a different origin from the root URL
+ * \note ROOT_LINK_TBL is only dereferenced while holding link_lock, like the
+ * rest of the tree.
+ */
+static int is_cross_origin_from_root(const char *url)
+{
+    int cross_origin = 0;
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    if (ROOT_LINK_TBL) {
+        cross_origin = is_cross_origin(ROOT_LINK_TBL->links[0]->url, url);
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    return cross_origin;
 }
 
 static int is_same_origin(const char *link_url)
 {
-    return !CONFIG.external_links || !ROOT_LINK_TBL
-           || !is_cross_origin(ROOT_LINK_TBL->links[0]->f_url, link_url);
+    return !CONFIG.external_links || !is_cross_origin_from_root(link_url);
 }
 
 static CURL *Link_to_curl(Link *link)
 {
+    char *url = Link_get_url(link);
+    int same_origin = is_same_origin(url);
     CURL *curl = curl_easy_init();
     if (!curl) {
         lprintf(fatal, "curl_easy_init() failed!\n");
@@ -116,7 +262,7 @@ static CURL *Link_to_curl(Link *link)
     if (ret) {
         lprintf(error, "%s\n", curl_easy_strerror(ret));
     }
-    ret = curl_easy_setopt(curl, CURLOPT_URL, link->f_url);
+    ret = curl_easy_setopt(curl, CURLOPT_URL, url);
     if (ret) {
         lprintf(error, "%s\n", curl_easy_strerror(ret));
     }
@@ -179,7 +325,7 @@ static CURL *Link_to_curl(Link *link)
     }
 
     if (CONFIG.http_headers) {
-        if (is_same_origin(link->f_url)) {
+        if (same_origin) {
             ret = curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
                                    CONFIG.http_headers);
             if (ret) {
@@ -194,7 +340,7 @@ static CURL *Link_to_curl(Link *link)
          * --external-links is active, cross-origin links must NOT receive
          * the user's credentials for the primary server.
          */
-        if (is_same_origin(link->f_url)) {
+        if (same_origin) {
             ret = curl_easy_setopt(curl, CURLOPT_USERNAME,
                                    CONFIG.http_username);
             if (ret) {
@@ -204,7 +350,7 @@ static CURL *Link_to_curl(Link *link)
     }
 
     if (CONFIG.http_password) {
-        if (is_same_origin(link->f_url)) {
+        if (same_origin) {
             ret = curl_easy_setopt(curl, CURLOPT_PASSWORD,
                                    CONFIG.http_password);
             if (ret) {
@@ -249,9 +395,70 @@ static CURL *Link_to_curl(Link *link)
         }
     }
 
+    FREE(url);
     return curl;
 }
 
+static int Link_is_uninitialised(const Link *link)
+{
+    LinkType type = link->type;
+    return type == LINK_UNINITIALISED_FILE || type == LINK_UNINITIALISED_DIR;
+}
+
+/**
+ * \brief The highest power of two the delay of Link_probe_failed() is
+ * multiplied by
+ */
+#define LINK_PROBE_MAX_SHIFT 16
+
+/**
+ * \brief The table-wide probe_time when no entry is invalid
+ */
+#define LINKTABLE_PROBE_NEVER ((time_t)-1)
+
+void Link_probe_failed(Link *link)
+{
+    if (link->probe_failures < LINK_PROBE_MAX_SHIFT) {
+        link->probe_failures++;
+    }
+    long delay = (long)CONFIG.http_wait_sec << (link->probe_failures - 1);
+    if (CONFIG.refresh_timeout > 0 && delay > CONFIG.refresh_timeout) {
+        delay = CONFIG.refresh_timeout;
+    }
+    link->probe_time = time(NULL) + delay;
+    /* The probe time is set first, readers check the type */
+    link->type = LINK_INVALID;
+}
+
+/**
+ * \brief The type to stat an invalid link as again
+ * \details Directories are listed with a trailing '/', which their URL keeps.
+ */
+static LinkType Link_uninitialised_type(const Link *link)
+{
+    char *url = Link_get_url(link);
+    size_t len = strlen(url);
+    LinkType type = len && url[len - 1] == '/' ? LINK_UNINITIALISED_DIR
+                                               : LINK_UNINITIALISED_FILE;
+    FREE(url);
+    return type;
+}
+
+/**
+ * \brief Check whether the invalid entries of a LinkTable are due to be
+ * stat'ed again
+ * \details probe_time is 0 until LinkTable_uninitialised_fill() has gone
+ * through the table, so a table loaded from the disk is checked once.
+ */
+static int LinkTable_probe_due(LinkTable *linktbl)
+{
+    if (!CONFIG.invalid_refresh) {
+        return 0;
+    }
+    time_t probe_time = linktbl->probe_time;
+    return probe_time != LINKTABLE_PROBE_NEVER && probe_time <= time(NULL);
+}
+
 static void Link_req_file_stat(Link *this_link)
 {
     CURL *curl = Link_to_curl(this_link);
@@ -282,6 +489,73 @@ static void Link_req_file_stat(Link *this_link)
     transfer_nonblocking(curl);
 }
 
+void Link_restat(Link *link)
+{
+    if (!atomic_exchange(&link->restat, 0)) {
+        return;
+    }
+    CURL *curl = Link_to_curl(link);
+    CURLcode ret = curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    ret = curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    TransferStruct ts = {0};
+    ts.type = DATA;
+    ts.transferring = 1;
+    ret = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&ts);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    ret = curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)&ts);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    transfer_blocking(curl);
+
+    long http_resp = 0;
+    curl_off_t cl = -1;
+    long filetime = -1;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_resp);
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &cl);
+    curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime);
+    curl_easy_cleanup(curl);
+    FREE(ts.data);
+
+    /* The file is served as it was, if it cannot be stat'ed */
+    if (http_resp != HTTP_OK || cl < 0) {
+        lprintf(debug, "%s: HTTP %ld\n", link->linkname, http_resp);
+        return;
+    }
+    /* The Link is being served, so it is only written if it has changed */
+    if ((size_t)cl != link->content_length || filetime != link->time) {
+        lprintf(debug, "%s has changed\n", link->linkname);
+        link->content_length = cl;
+        link->time = filetime;
+    }
+}
+
+/**
+ * \brief Work out when the invalid entries of a LinkTable are due to be
+ * stat'ed again
+ */
+static void LinkTable_probe_update(LinkTable *linktbl, Link **links, int size)
+{
+    time_t probe_time = LINKTABLE_PROBE_NEVER;
+    for (int i = 1; i < size; i++) {
+        Link *this_link = links[i];
+        if (this_link->type == LINK_INVALID
+            && (probe_time == LINKTABLE_PROBE_NEVER
+                || this_link->probe_time < probe_time)) {
+            probe_time = this_link->probe_time;
+        }
+    }
+    linktbl->probe_time = probe_time;
+}
+
 /**
  * \brief Fill in the uninitialised entries in a link table
  * \details Try and get the stats for each link in the link table. This will get
@@ -293,60 +567,59 @@ static void LinkTable_uninitialised_fill(LinkTable *linktbl)
         return;
     }
     int u;
-    char s[STATUS_LEN];
+    Link **links;
+    int size = LinkTable_entries(linktbl, &links);
 
     /*
-     * Start all uninitialized requests once
+     * Start all uninitialized requests once, including the invalid links
+     * whose backoff has expired
      */
     int total_uninitialized = 0;
-    for (int i = 0; i < linktbl->size; i++) {
-        Link *this_link = linktbl->links[i];
-        if (this_link->type == LINK_UNINITIALISED_FILE
-            || this_link->type == LINK_UNINITIALISED_DIR) {
-            Link_req_file_stat(linktbl->links[i]);
+    time_t now = time(NULL);
+    for (int i = 0; i < size; i++) {
+        Link *this_link = links[i];
+        if (CONFIG.invalid_refresh && this_link->type == LINK_INVALID
+            && this_link->probe_time <= now) {
+            this_link->type = Link_uninitialised_type(this_link);
+        }
+        if (Link_is_uninitialised(this_link)) {
+            Link_req_file_stat(links[i]);
             total_uninitialized++;
         }
     }
 
     if (total_uninitialized == 0) {
+        LinkTable_probe_update(linktbl, links, size);
         return;
     }
 
-    int n = total_uninitialized;
-    int j = 0;
     do {
         u = 0;
-        for (int i = 0; i < linktbl->size; i++) {
-            Link *this_link = linktbl->links[i];
-            if (this_link->type == LINK_UNINITIALISED_FILE
-                || this_link->type == LINK_UNINITIALISED_DIR) {
+        for (int i = 0; i < size; i++) {
+            if (Link_is_uninitialised(links[i])) {
                 u++;
             }
         }
 
         if (u > 0) {
-            if (CONFIG.log_type & debug) {
-                if (j) {
-                    erase_string(stderr, STATUS_LEN, s);
-                }
-                snprintf(s, STATUS_LEN, "%d / %d", n - u, n);
-                fprintf(stderr, "%s", s);
-                j++;
-            }
-
             /*
              * Block until some handles are processed
              */
             int n_running = curl_multi_perform_once();
 
+            /* Wake up Link_wait_file_stat() */
+            PTHREAD_MUTEX_LOCK(&link_fill_lock);
+            PTHREAD_COND_BROADCAST(&link_fill_cond);
+            PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+
             if (n_running == 0) {
-                for (int i = 0; i < linktbl->size; i++) {
-                    Link *this_link = linktbl->links[i];
-                    if (this_link->type == LINK_UNINITIALISED_FILE
-                        || this_link->type == LINK_UNINITIALISED_DIR) {
-                        lprintf(error, "Failed to initialize: %s\n",
-                                this_link->f_url);
-                        this_link->type = LINK_INVALID;
+                for (int i = 0; i < size; i++) {
+                    Link *this_link = links[i];
+                    if (Link_is_uninitialised(this_link)) {
+                        char *url = Link_get_url(this_link);
+                        lprintf(error, "Failed to initialize: %s\n", url);
+                        FREE(url);
+                        Link_probe_failed(this_link);
                     }
                 }
                 break;
@@ -354,10 +627,9 @@ static void LinkTable_uninitialised_fill(LinkTable *linktbl)
         }
     } while (u > 0);
 
-    if (CONFIG.log_type & debug) {
-        erase_string(stderr, STATUS_LEN, s);
-        fprintf(stderr, "... Done!\n");
-    }
+    LinkTable_probe_update(linktbl, links, size);
+    lprintf(debug, "%s: %d entries initialised\n", links[0]->url,
+            total_uninitialized);
 }
 
 /**
@@ -368,12 +640,12 @@ static LinkTable *single_LinkTable_new(const char *url)
     const char *orig_ptr = strrchr(url, '/') + 1;
     char *ptr = curl_easy_unescape(NULL, orig_ptr, 0, NULL);
     LinkTable *linktbl = LinkTable_alloc(url);
-    Link *link = Link_new(ptr ? ptr : orig_ptr, LINK_UNINITIALISED_FILE);
-    strncpy(link->f_url, url, PATH_MAX);
+    Link *link
+        = LinkTable_add(linktbl, ptr ? ptr : orig_ptr, LINK_UNINITIALISED_FILE);
+    Link_set_url(link, url);
     if (ptr) {
         curl_free(ptr);
     }
-    LinkTable_add(linktbl, link);
     LinkTable_uninitialised_fill(linktbl);
     LinkTable_print(linktbl);
     return linktbl;
@@ -406,9 +678,16 @@ LinkTable *LinkSystem_init(const char *url)
      * ----------- Create the root link table --------------
      */
     if (CONFIG.mode == NORMAL) {
-        ROOT_LINK_TBL = LinkTable_new(url);
+        if (CACHE_SYSTEM_INIT) {
+            ROOT_LINK_TBL = LinkTree_disk_open(url);
+        }
+        if (!ROOT_LINK_TBL) {
+            ROOT_LINK_TBL = LinkTable_new(url);
+        }
     } else if (CONFIG.mode == SINGLE) {
         ROOT_LINK_TBL = single_LinkTable_new(url);
+    } else if (CONFIG.mode == MANIFEST) {
+        ROOT_LINK_TBL = manifest_LinkTable_new(url, CONFIG.manifest_url);
     } else if (CONFIG.mode == SONIC) {
         sonic_config_init(url, CONFIG.sonic_username, CONFIG.sonic_password);
         if (!CONFIG.sonic_id3) {
@@ -419,16 +698,179 @@ LinkTable *LinkSystem_init(const char *url)
     } else {
         lprintf(fatal, "Invalid CONFIG.mode\n");
     }
+    if (ROOT_LINK_TBL) {
+        /* The tree loaded from the cache may not fit */
+        LinkTree_resident_add(ROOT_LINK_TBL);
+        LinkTable_evict();
+    }
     return ROOT_LINK_TBL;
 }
 
-void LinkTable_add(LinkTable *linktbl, Link *link)
+void LinkSystem_fill_start(void)
+{
+    if (CONFIG.mode != NORMAL) {
+        return;
+    }
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    LinkTable *linktbl = ROOT_LINK_TBL;
+    linktbl->refcount++;
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    LinkTable_fill_start(linktbl);
+    LinkTable_unref(linktbl);
+}
+
+Link *LinkTable_add(LinkTable *linktbl, const char *linkname, LinkType type)
 {
-    linktbl->links = (Link **)REALLOC(
-        (void *)linktbl->links, ((size_t)linktbl->size + 1) * sizeof(Link *));
+    if (linktbl->size == linktbl->capacity) {
+        linktbl->capacity = linktbl->capacity ? linktbl->capacity * 2 : 16;
+        linktbl->links = (Link **)REALLOC(
+            (void *)linktbl->links, (size_t)linktbl->capacity * sizeof(Link *));
+    }
+
+    Link *link = LinkArena_alloc(linktbl, sizeof(Link), _Alignof(Link));
+    link->linkname = LinkArena_strndup(linktbl, linkname, NAME_MAX);
+    link->type = type;
+
+    /*
+     * remove the '/' from linkname if it exists
+     */
+    size_t len = strlen(link->linkname);
+    if (len > 0 && link->linkname[len - 1] == '/') {
+        link->linkname[len - 1] = '\0';
+    }
+
     linktbl->links[linktbl->size] = link;
     link->parent_table = linktbl;
     linktbl->size++;
+    return link;
+}
+
+char *Link_get_url(const Link *link)
+{
+    if (!link->url) {
+        return STRDUP("");
+    }
+    if (link->url_absolute) {
+        return STRDUP(link->url);
+    }
+    const char *base = link->parent_table->links[0]->url;
+    size_t base_len = strlen(base);
+    size_t len = strlen(link->url);
+    char *url = CALLOC(base_len + len + 1, sizeof(char));
+    memcpy(url, base, base_len);
+    memcpy(url + base_len, link->url, len);
+    return url;
+}
+
+void Link_set_url(Link *link, const char *url)
+{
+    LinkTable *linktbl = link->parent_table;
+    Link *head_link = linktbl->links[0];
+    size_t base_len = head_link->url ? strlen(head_link->url) : 0;
+
+    /*
+     * The URL of a directory listing entry is almost always the URL of the
+     * listing followed by the escaped name, so only the name is stored.
+     */
+    if (link == head_link || !base_len
+        || strncmp(url, head_link->url, base_len)) {
+        link->url = LinkArena_strndup(linktbl, url, PATH_MAX);
+        link->url_absolute = 1;
+        return;
+    }
+    const char *suffix = url + base_len;
+    if (!strcmp(suffix, link->linkname)) {
+        link->url = link->linkname;
+    } else {
+        link->url = LinkArena_strndup(linktbl, suffix, PATH_MAX);
+    }
+    link->url_absolute = 0;
+}
+
+/**
+ * \brief Open addressing hash index of the Links of a LinkTable, by linkname
+ */
+struct LinkIndex {
+    /** \brief The number of buckets, a power of two */
+    int capacity;
+    /** \brief The size of the LinkTable when the index was built */
+    int size;
+    /** \brief The links array of the LinkTable when the index was built */
+    Link **links;
+    /**
+     * \brief The index this one superseded
+     * \details Concurrent lookups may still be probing it, so it is only
+     * freed with the LinkTable.
+     */
+    struct LinkIndex *prev;
+    Link *slots[];
+};
+
+/**
+ * \brief Get the hash index of a LinkTable, building it if it is out of date
+ * \details The index is built once and then published atomically, so lookups
+ * holding link_lock for reading do not need to lock anything else.
+ */
+static struct LinkIndex *LinkTable_index(LinkTable *linktbl)
+{
+    struct LinkIndex *index
+        = atomic_load_explicit(&linktbl->index, memory_order_acquire);
+    if (index && index->size == linktbl->size
+        && index->links == linktbl->links) {
+        return index;
+    }
+
+    PTHREAD_MUTEX_LOCK(&link_index_lock);
+    index = atomic_load_explicit(&linktbl->index, memory_order_acquire);
+    if (index && index->size == linktbl->size
+        && index->links == linktbl->links) {
+        PTHREAD_MUTEX_UNLOCK(&link_index_lock);
+        return index;
+    }
+
+    int capacity = 16;
+    while (capacity < linktbl->size * 2 && capacity < (1 << 30)) {
+        capacity <<= 1;
+    }
+    struct LinkIndex *new_index = CALLOC(
+        1, sizeof(struct LinkIndex) + (size_t)capacity * sizeof(Link *));
+    new_index->capacity = capacity;
+    new_index->size = linktbl->size;
+    new_index->links = linktbl->links;
+    new_index->prev = index;
+
+    for (int i = 1; i < linktbl->size; i++) {
+        Link *link = linktbl->links[i];
+        unsigned int bucket = link_hash_str(link->linkname) & (capacity - 1);
+        while (new_index->slots[bucket]) {
+            /* The first Link with a name wins, like a linear scan */
+            if (!strncmp(new_index->slots[bucket]->linkname, link->linkname,
+                         NAME_MAX)) {
+                break;
+            }
+            bucket = (bucket + 1) & (capacity - 1);
+        }
+        if (!new_index->slots[bucket]) {
+            new_index->slots[bucket] = link;
+        }
+    }
+    atomic_store_explicit(&linktbl->index, new_index, memory_order_release);
+    PTHREAD_MUTEX_UNLOCK(&link_index_lock);
+    return new_index;
+}
+
+Link *LinkTable_lookup(LinkTable *linktbl, const char *linkname)
+{
+    struct LinkIndex *index = LinkTable_index(linktbl);
+    unsigned int mask = index->capacity - 1;
+    unsigned int bucket = link_hash_str(linkname) & mask;
+    while (index->slots[bucket]) {
+        if (!strncmp(linkname, index->slots[bucket]->linkname, NAME_MAX)) {
+            return index->slots[bucket];
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return NULL;
 }
 
 static LinkType linkname_to_LinkType(const char *linkname)
@@ -500,6 +942,8 @@ end:
 
 struct LinkHashSet {
     const char **buckets;
+    /** \brief The Link stored along with the name in the same bucket */
+    Link **links;
     int capacity;
     int size;
 };
@@ -536,6 +980,7 @@ LinkHashSet *LinkHashSet_new(int capacity)
     LinkHashSet *set = (LinkHashSet *)CALLOC(1, sizeof(LinkHashSet));
     set->capacity = capacity;
     set->buckets = (const char **)CALLOC(capacity, sizeof(const char *));
+    set->links = (Link **)CALLOC(capacity, sizeof(Link *));
     return set;
 }
 
@@ -546,11 +991,13 @@ static void LinkHashSet_resize(LinkHashSet *set)
     }
     int old_capacity = set->capacity;
     const char **old_buckets = set->buckets;
+    Link **old_links = set->links;
     if (set->capacity > INT_MAX / 2) {
         lprintf(fatal, "LinkHashSet capacity overflow\n");
     }
     set->capacity *= 2;
     set->buckets = (const char **)CALLOC(set->capacity, sizeof(const char *));
+    set->links = (Link **)CALLOC(set->capacity, sizeof(Link *));
 
     for (int i = 0; i < old_capacity; i++) {
         if (old_buckets[i]) {
@@ -560,12 +1007,19 @@ static void LinkHashSet_resize(LinkHashSet *set)
                 bucket = (bucket + 1) & (set->capacity - 1);
             }
             set->buckets[bucket] = old_buckets[i];
+            set->links[bucket] = old_links[i];
         }
     }
     FREE(old_buckets);
+    FREE(old_links);
 }
 
 int LinkHashSet_add(LinkHashSet *set, const char *linkname)
+{
+    return LinkHashSet_add_link(set, linkname, NULL);
+}
+
+int LinkHashSet_add_link(LinkHashSet *set, const char *linkname, Link *link)
 {
     if (!set || !linkname || set->capacity <= 0) {
         return 0;
@@ -582,10 +1036,41 @@ int LinkHashSet_add(LinkHashSet *set, const char *linkname)
         bucket = (bucket + 1) & (set->capacity - 1);
     }
     set->buckets[bucket] = STRDUP(linkname);
+    set->links[bucket] = link;
     set->size++;
     return 1;
 }
 
+Link *LinkHashSet_get(LinkHashSet *set, const char *linkname)
+{
+    if (!set || !linkname || set->capacity <= 0) {
+        return NULL;
+    }
+    unsigned int hash = link_hash_str(linkname);
+    int bucket = hash & (set->capacity - 1);
+    while (set->buckets[bucket] != NULL) {
+        if (link_linknames_equal(set->buckets[bucket], linkname)) {
+            return set->links[bucket];
+        }
+        bucket = (bucket + 1) & (set->capacity - 1);
+    }
+    return NULL;
+}
+
+/**
+ * \brief Index the Links of a LinkTable by their names
+ * \note The caller must free the set with LinkHashSet_free().
+ */
+static LinkHashSet *LinkTable_to_LinkHashSet(LinkTable *linktbl)
+{
+    LinkHashSet *set = LinkHashSet_new(linktbl->size * 2);
+    for (int i = 1; i < linktbl->size; i++) {
+        LinkHashSet_add_link(set, linktbl->links[i]->linkname,
+                             linktbl->links[i]);
+    }
+    return set;
+}
+
 void LinkHashSet_free(LinkHashSet *set)
 {
     if (!set) {
@@ -597,6 +1082,7 @@ void LinkHashSet_free(LinkHashSet *set)
         }
     }
     FREE(set->buckets);
+    FREE(set->links);
     FREE(set);
 }
 
@@ -893,105 +1379,263 @@ char *external_url_to_filename(const char *url)
 }
 
 /**
- * Shamelessly copied and pasted from:
- * https://github.com/google/gumbo-parser/blob/master/examples/find_links.cc
+ * \brief The formats of the directory listings
+ */
+typedef enum {
+    LISTING_UNKNOWN,
+    LISTING_HTML,
+    LISTING_JSON,
+    /** \brief The listing is in a format we were told not to accept */
+    LISTING_IGNORED,
+} ListingFormat;
+
+/**
+ * \brief The state of a directory listing being parsed
+ * \details The listing is parsed as it is being downloaded, so it never has
+ * to be held in memory in its entirety.
+ */
+typedef struct {
+    LinkTable *linktbl;
+    /** \brief The URL of the directory listing */
+    const char *url;
+    /** \brief The names of the links which have been added */
+    LinkHashSet *set;
+    /** \brief The curl handle which is downloading the listing */
+    CURL *curl;
+    ListingFormat format;
+    HtmlLinks *html;
+    JsonListing *json;
+    /** \brief The number of bytes of the listing received */
+    size_t received;
+} ListingParser;
+
+/**
+ * \brief Convert the href of an \<a\> tag into a Link
  */
-static void HTML_to_LinkTable(const char *url, GumboNode *node,
-                              LinkTable *linktbl, LinkHashSet *set)
+static void html_href_to_Link(void *userdata, const char *raw_href)
 {
-    if (node->type != GUMBO_NODE_ELEMENT) {
-        return;
-    }
-    GumboAttribute *href;
-    href = gumbo_get_attribute(&node->v.element.attributes, "href");
-    if (node->v.element.tag == GUMBO_TAG_A && href) {
-        const char *raw_href = href->value;
+    ListingParser *lp = userdata;
+    const char *url = lp->url;
 
-        if (CONFIG.external_links && is_external_url(raw_href)
-            && is_cross_origin(url, raw_href)) {
-            /*
-             * -------- External (cross-origin) link handling --------
-             * Extract the filename from the external URL and create a
-             * Link with f_url already pointing to the external server.
-             * LinkTable_fill() will skip URL-construction for these.
-             */
-            char *filename = external_url_to_filename(raw_href);
-            if (filename && filename[0] != '\0' && strcmp(filename, ".") != 0
-                && strcmp(filename, "..") != 0) {
-                /* Determine type: directory if URL (ignoring query/fragment)
-                 * ends with '/' */
-                const char *qf = strpbrk(raw_href, "?#");
-                size_t href_len
-                    = qf ? (size_t)(qf - raw_href) : strlen(raw_href);
-                LinkType type = (href_len > 0 && raw_href[href_len - 1] == '/')
-                                    ? LINK_UNINITIALISED_DIR
-                                    : LINK_UNINITIALISED_FILE;
-
-                /* First-wins: skip if a link with this name already exists */
-                if (LinkHashSet_add(set, filename)) {
-                    Link *link = Link_new(filename, type);
-                    snprintf(link->f_url, sizeof(link->f_url), "%s", raw_href);
-                    LinkTable_add(linktbl, link);
-                }
+    if (CONFIG.external_links && is_external_url(raw_href)
+        && is_cross_origin(url, raw_href)) {
+        /*
+         * -------- External (cross-origin) link handling --------
+         * Extract the filename from the external URL and create a
+         * Link with its URL already pointing to the external server.
+         * LinkTable_fill() will skip URL-construction for these.
+         */
+        char *filename = external_url_to_filename(raw_href);
+        if (filename && filename[0] != '\0' && strcmp(filename, ".") != 0
+            && strcmp(filename, "..") != 0) {
+            /* Determine type: directory if URL (ignoring query/fragment)
+             * ends with '/' */
+            const char *qf = strpbrk(raw_href, "?#");
+            size_t href_len = qf ? (size_t)(qf - raw_href) : strlen(raw_href);
+            LinkType type = (href_len > 0 && raw_href[href_len - 1] == '/')
+                                ? LINK_UNINITIALISED_DIR
+                                : LINK_UNINITIALISED_FILE;
+
+            /* First-wins: skip if a link with this name already exists */
+            if (LinkHashSet_add(lp->set, filename)) {
+                Link *link = LinkTable_add(lp->linktbl, filename, type);
+                Link_set_url(link, raw_href);
             }
-            FREE(filename);
-        } else {
-            /*
-             * -------- Same-origin / relative link handling (unchanged)
-             * --------
-             */
-            char *relative_url = STRNDUP(raw_href, PATH_MAX);
-            make_link_relative(url, relative_url);
-
-            /* Truncate at the first slash to support links to subdirectories */
-            char *slash = strchr(relative_url, '/');
-            if (slash && slash != relative_url) {
-                /* Don't truncate full URIs like http://... */
-                if (*(slash - 1) != ':' && slash[1] != '/') {
-                    slash[1] = '\0';
-                }
+        }
+        FREE(filename);
+    } else {
+        /*
+         * -------- Same-origin / relative link handling --------
+         */
+        char *relative_url = STRNDUP(raw_href, PATH_MAX);
+        make_link_relative(url, relative_url);
+
+        /* Truncate at the first slash to support links to subdirectories */
+        char *slash = strchr(relative_url, '/');
+        if (slash && slash != relative_url) {
+            /* Don't truncate full URIs like http://... */
+            if (*(slash - 1) != ':' && slash[1] != '/') {
+                slash[1] = '\0';
             }
+        }
 
-            /* if it is valid, copy the link onto the heap */
-            LinkType type = linkname_to_LinkType(relative_url);
+        /* if it is valid, add it to the LinkTable */
+        LinkType type = linkname_to_LinkType(relative_url);
 
-            /* Check if the new link is a duplicate */
-            if ((type == LINK_UNINITIALISED_DIR)
-                || (type == LINK_UNINITIALISED_FILE)) {
-                if (LinkHashSet_add(set, relative_url)) {
-                    LinkTable_add(linktbl, Link_new(relative_url, type));
-                }
+        /* Check if the new link is a duplicate */
+        if ((type == LINK_UNINITIALISED_DIR)
+            || (type == LINK_UNINITIALISED_FILE)) {
+            if (LinkHashSet_add(lp->set, relative_url)) {
+                LinkTable_add(lp->linktbl, relative_url, type);
             }
-            FREE(relative_url);
         }
-    }
-
-    /* Note the recursive call */
-    GumboVector *children = &node->v.element.children;
-    for (size_t i = 0; i < children->length; ++i) {
-        HTML_to_LinkTable(url, (GumboNode *)children->data[i], linktbl, set);
+        FREE(relative_url);
     }
 }
 
-void LinkTable_parse_html(LinkTable *linktbl, const char *url, const char *html)
+/**
+ * \brief Convert a JSON listing entry into a fully initialised Link
+ */
+static void json_entry_to_Link(void *userdata, const JsonEntry *entry)
 {
-    if (!linktbl || !url || !html) {
+    ListingParser *lp = userdata;
+    const char *name = entry->name;
+
+    if (name[0] == '\0' || !strcmp(name, ".") || !strcmp(name, "..")
+        || strchr(name, '/')) {
+        lprintf(debug, "Skipping invalid JSON entry: %s\n", name);
         return;
     }
-    GumboOutput *output = gumbo_parse(html);
-    if (!output) {
+
+    LinkType type;
+    if (!strcmp(entry->type, "directory")) {
+        type = LINK_DIR;
+    } else if (!strcmp(entry->type, "file") && entry->size >= 0) {
+        type = LINK_FILE;
+    } else {
+        /*
+         * Symbolic links show up as "other", we have to ask the server what
+         * they point to.
+         */
+        type = LINK_UNINITIALISED_FILE;
+    }
+
+    if (!LinkHashSet_add(lp->set, name)) {
         return;
     }
-    LinkHashSet *set = LinkHashSet_new(4096);
-    if (output->root) {
-        HTML_to_LinkTable(url, output->root, linktbl, set);
+
+    Link *link = LinkTable_add(lp->linktbl, name, type);
+    if (type == LINK_FILE) {
+        link->content_length = (size_t)entry->size;
+    }
+    link->time = JsonEntry_mtime(entry);
+
+    /*
+     * The name is already unescaped, so we can escape it directly. Setting
+     * the URL here means LinkTable_fill() leaves this Link alone.
+     */
+    char *escaped_name = curl_easy_escape(NULL, name, 0);
+    char *url = path_append(lp->url, escaped_name ? escaped_name : name);
+    char full_url[PATH_MAX + 1];
+    snprintf(full_url, sizeof(full_url), "%s%s", url,
+             type == LINK_DIR ? "/" : "");
+    Link_set_url(link, full_url);
+    FREE(url);
+    if (escaped_name) {
+        curl_free(escaped_name);
     }
-    LinkHashSet_free(set);
-    gumbo_destroy_output(&kGumboDefaultOptions, output);
 }
-void Link_set_file_stat(Link *this_link, CURL *curl)
+
+static void ListingParser_init(ListingParser *lp, LinkTable *linktbl,
+                               const char *url)
 {
-    long http_resp;
+    memset(lp, 0, sizeof(ListingParser));
+    lp->linktbl = linktbl;
+    lp->url = url;
+    lp->set = LinkHashSet_new(4096);
+    lp->format = LISTING_UNKNOWN;
+    lp->html = HtmlLinks_new(html_href_to_Link, lp);
+    lp->json = JsonListing_new(json_entry_to_Link, lp);
+}
+
+static void ListingParser_cleanup(ListingParser *lp)
+{
+    HtmlLinks_free(lp->html);
+    JsonListing_free(lp->json);
+    LinkHashSet_free(lp->set);
+}
+
+/**
+ * \brief Feed a chunk of a directory listing into the matching parser
+ * \details JSON listings are recognised by their leading '['.
+ */
+static void ListingParser_feed(ListingParser *lp, const char *data, size_t len)
+{
+    if (lp->format == LISTING_UNKNOWN) {
+        size_t i = 0;
+        /* Skip the whitespaces and the UTF-8 byte order mark */
+        while (i < len
+               && (isspace((unsigned char)data[i])
+                   || (unsigned char)data[i] == 0xEF
+                   || (unsigned char)data[i] == 0xBB
+                   || (unsigned char)data[i] == 0xBF)) {
+            i++;
+        }
+        if (i == len) {
+            return;
+        }
+        if (data[i] == '[') {
+            lp->format = LISTING_JSON;
+        } else if (CONFIG.json_listing) {
+            lprintf(warning, "%s is not a JSON directory listing\n", lp->url);
+            lp->format = LISTING_IGNORED;
+        } else {
+            lp->format = LISTING_HTML;
+        }
+    }
+
+    if (lp->format == LISTING_JSON) {
+        JsonListing_feed(lp->json, data, len);
+    } else if (lp->format == LISTING_HTML) {
+        HtmlLinks_feed(lp->html, data, len);
+    }
+}
+
+/**
+ * \brief The curl write callback for directory listings
+ */
+static size_t listing_write_callback(void *recv_data, size_t size,
+                                     size_t nmemb, void *userp)
+{
+    ListingParser *lp = (ListingParser *)userp;
+    size_t recv_size = size * nmemb;
+
+    /*
+     * Error pages are not directory listings, they are discarded before
+     * Link_download_perform() retries.
+     */
+    long http_resp = 0;
+    CURLcode ret
+        = curl_easy_getinfo(lp->curl, CURLINFO_RESPONSE_CODE, &http_resp);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    if (http_resp != HTTP_OK) {
+        return recv_size;
+    }
+
+    lp->received += recv_size;
+    ListingParser_feed(lp, recv_data, recv_size);
+    return recv_size;
+}
+
+void LinkTable_parse_html(LinkTable *linktbl, const char *url, const char *html)
+{
+    if (!linktbl || !url || !html) {
+        return;
+    }
+    ListingParser lp;
+    ListingParser_init(&lp, linktbl, url);
+    HtmlLinks_feed(lp.html, html, strlen(html));
+    ListingParser_cleanup(&lp);
+}
+
+int LinkTable_parse_json(LinkTable *linktbl, const char *url, const char *json,
+                         size_t len)
+{
+    if (!linktbl || !url || !json) {
+        return -1;
+    }
+    ListingParser lp;
+    ListingParser_init(&lp, linktbl, url);
+    int res = JsonListing_feed(lp.json, json, len);
+    ListingParser_cleanup(&lp);
+    return res;
+}
+
+void Link_set_file_stat(Link *this_link, CURL *curl)
+{
+    long http_resp;
     CURLcode ret = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_resp);
     if (ret) {
         lprintf(error, "%s\n", curl_easy_strerror(ret));
@@ -1007,57 +1651,133 @@ void Link_set_file_stat(Link *this_link, CURL *curl)
             lprintf(error, "%s\n", curl_easy_strerror(ret));
         }
 
+        /* Only a successful probe resets the backoff */
         if (this_link->type == LINK_UNINITIALISED_FILE) {
             if (cl < 0) {
-                this_link->type = LINK_INVALID;
+                Link_probe_failed(this_link);
             } else if (cl == 0 && CONFIG.zero_len_is_dir) {
+                this_link->probe_failures = 0;
                 this_link->type = LINK_DIR;
             } else {
-                this_link->type = LINK_FILE;
+                /* The size is set first, readers check the type */
+                this_link->probe_failures = 0;
                 this_link->content_length = cl;
+                this_link->type = LINK_FILE;
             }
         } else if (this_link->type == LINK_UNINITIALISED_DIR) {
+            this_link->probe_failures = 0;
             this_link->type = LINK_DIR;
         }
 
     } else {
-        lprintf(warning, "%s: HTTP %ld\n", this_link->f_url, http_resp);
+        char *url = Link_get_url(this_link);
+        lprintf(warning, "%s: HTTP %ld\n", url, http_resp);
         /*
          * Emit a targeted warning if an external link needs authentication
          * that we are not providing.
          */
         if (CONFIG.external_links && (http_resp == 401 || http_resp == 403)
-            && ROOT_LINK_TBL
-            && is_cross_origin(ROOT_LINK_TBL->links[0]->f_url,
-                               this_link->f_url)) {
+            && is_cross_origin_from_root(url)) {
             lprintf(warning,
                     "External link %s requires authentication (HTTP %ld). "
                     "Credentials are only applied to the mounted "
                     "server.\n",
-                    this_link->f_url, http_resp);
+                    url, http_resp);
         }
-        if (HTTP_temp_failure(http_resp) || CONFIG.invalid_refresh) {
+        FREE(url);
+        if (HTTP_temp_failure(http_resp)) {
             lprintf(warning, ", retrying later.\n");
         } else {
+            Link_probe_failed(this_link);
+        }
+    }
+}
+
+/**
+ * \brief Carry the stat results of unchanged entries over from a stale
+ * LinkTable
+ * \details The Links are matched by name. A Link that is still uninitialised
+ * takes the type, size and time of the stale Link with the same name and URL,
+ * so only the new entries have to be probed. The listing cannot tell whether
+ * such a file has changed, so it is stat'ed again when it is next opened.
+ */
+static void LinkTable_inherit(LinkTable *linktbl, LinkTable *stale)
+{
+    LinkHashSet *set = LinkTable_to_LinkHashSet(stale);
+    int inherited = 0;
+    for (int i = 1; i < linktbl->size; i++) {
+        Link *this_link = linktbl->links[i];
+        Link *stale_link = LinkHashSet_get(set, this_link->linkname);
+        if (!stale_link) {
+            continue;
+        }
+        char *url = Link_get_url(this_link);
+        char *stale_url = Link_get_url(stale_link);
+        int same_url = !strcmp(url, stale_url);
+        FREE(stale_url);
+        FREE(url);
+        if (!same_url) {
+            continue;
+        }
+        if ((this_link->type == LINK_UNINITIALISED_FILE
+             && stale_link->type == LINK_FILE)
+            || (this_link->type == LINK_UNINITIALISED_DIR
+                && stale_link->type == LINK_DIR)) {
+            this_link->content_length = stale_link->content_length;
+            this_link->time = stale_link->time;
+            /* The file may have changed, see Link_restat() */
+            this_link->restat = this_link->type == LINK_UNINITIALISED_FILE;
+            this_link->type = stale_link->type;
+            inherited++;
+        } else if (Link_is_uninitialised(this_link)
+                   && stale_link->type == LINK_INVALID
+                   && stale_link->probe_time > time(NULL)) {
+            /* A broken link is not probed again before its backoff expires */
+            this_link->probe_failures = stale_link->probe_failures;
+            this_link->probe_time = stale_link->probe_time;
             this_link->type = LINK_INVALID;
+            inherited++;
         }
     }
+    LinkHashSet_free(set);
+    lprintf(debug, "%d of %d entries unchanged\n", inherited,
+            linktbl->size - 1);
 }
 
-static void LinkTable_fill(LinkTable *linktbl)
+void LinkTable_fill(LinkTable *linktbl, LinkTable *stale)
 {
     Link *head_link = linktbl->links[0];
     for (int i = 1; i < linktbl->size; i++) {
         Link *this_link = linktbl->links[i];
 
         /*
-         * External links have f_url pre-populated by HTML_to_LinkTable().
+         * External links have their URL pre-populated by html_href_to_Link().
          * Skip URL construction for them.
          */
-        if (this_link->f_url[0] != '\0') {
+        if (this_link->url) {
             continue;
         }
 
+        /* The href of the link, the trailing '/' was removed from linkname */
+        size_t linkname_len = strlen(this_link->linkname);
+        char *linkpath = CALLOC(linkname_len + 2, sizeof(char));
+        memcpy(linkpath, this_link->linkname, linkname_len);
+        if (this_link->type == LINK_UNINITIALISED_DIR) {
+            linkpath[linkname_len] = '/';
+        }
+
+        /*
+         * Unescaping never makes the name longer, so it is done in place. It
+         * is done before the URL is set, Link_set_url() only shares the name
+         * with the URL if the name does not need escaping.
+         */
+        char *unescaped_linkname
+            = curl_easy_unescape(NULL, this_link->linkname, 0, NULL);
+        if (unescaped_linkname) {
+            strcpy(this_link->linkname, unescaped_linkname);
+            curl_free(unescaped_linkname);
+        }
+
         /* Some web sites use characters in their href attributes that really
            shouldn't be in their href attributes, most commonly spaces. And
            some web sites _do_ properly encode their href attributes. So we
@@ -1065,10 +1785,9 @@ static void LinkTable_fill(LinkTable *linktbl)
            will definitely be happy with it (e.g., curl won't accept URLs with
            spaces in them!). If we only escaped it, and there were already
            encoded characters in it, then that would break the link. */
-        char *unescaped_path
-            = curl_easy_unescape(NULL, this_link->linkpath, 0, NULL);
+        char *unescaped_path = curl_easy_unescape(NULL, linkpath, 0, NULL);
         char *escaped_path = curl_easy_escape(
-            NULL, unescaped_path ? unescaped_path : this_link->linkpath, 0);
+            NULL, unescaped_path ? unescaped_path : linkpath, 0);
         if (unescaped_path) {
             curl_free(unescaped_path);
         }
@@ -1083,26 +1802,231 @@ static void LinkTable_fill(LinkTable *linktbl)
                 escaped_path[escaped_len - 3] = '/';
                 escaped_path[escaped_len - 2] = '\0';
             }
-            char *url = path_append(head_link->f_url, escaped_path);
+            char *url = path_append(head_link->url, escaped_path);
             curl_free(escaped_path);
-            strncpy(this_link->f_url, url, PATH_MAX);
+            Link_set_url(this_link, url);
             FREE(url);
         } else {
             /* Fallback in case escape fails */
-            char *url = path_append(head_link->f_url, this_link->linkpath);
-            strncpy(this_link->f_url, url, PATH_MAX);
+            char *url = path_append(head_link->url, linkpath);
+            Link_set_url(this_link, url);
             FREE(url);
         }
+        FREE(linkpath);
+    }
+    if (stale) {
+        LinkTable_inherit(linktbl, stale);
+    }
+}
 
-        char *unescaped_linkname
-            = curl_easy_unescape(NULL, this_link->linkname, 0, NULL);
-        if (unescaped_linkname) {
-            snprintf(this_link->linkname, sizeof(this_link->linkname), "%s",
-                     unescaped_linkname);
-            curl_free(unescaped_linkname);
+/**
+ * \brief Mark a LinkTable as used, so LinkTable_evict() passes it over once
+ * \details Lookups call this for every LinkTable they go through, so the flag
+ * is only written when it is not set yet.
+ */
+static void LinkTable_touch(LinkTable *linktbl)
+{
+    if (!atomic_load_explicit(&linktbl->accessed, memory_order_relaxed)) {
+        atomic_store_explicit(&linktbl->accessed, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * \brief The heap memory used by a LinkTable
+ * \details The strings in a mapped file are not counted, the kernel can drop
+ * their pages whenever it needs to.
+ */
+static size_t LinkTable_heap_size(const LinkTable *linktbl)
+{
+    size_t size = sizeof(LinkTable)
+                  + (size_t)linktbl->capacity * sizeof(Link *);
+    for (const struct LinkArena *arena = linktbl->arena; arena;
+         arena = arena->next) {
+        size += sizeof(struct LinkArena) + arena->size;
+    }
+    for (const struct LinkIndex *index = atomic_load(&linktbl->index); index;
+         index = index->prev) {
+        size += sizeof(struct LinkIndex)
+                + (size_t)index->capacity * sizeof(Link *);
+    }
+    for (const struct LinkRetired *retired = linktbl->retired; retired;
+         retired = retired->prev) {
+        size += sizeof(struct LinkRetired)
+                + (size_t)retired->capacity * sizeof(Link *);
+    }
+    return size;
+}
+
+/**
+ * \brief Count a LinkTable which has been attached to the tree as resident
+ * \details A LinkTable which is already resident is counted again, with the
+ * memory it has gained since.
+ */
+static void LinkTable_resident_add(LinkTable *linktbl)
+{
+    PTHREAD_MUTEX_LOCK(&link_residency.lock);
+    if (linktbl->resident_size) {
+        link_residency.bytes -= linktbl->resident_size;
+    } else {
+        linktbl->resident_prev = link_residency.tail;
+        linktbl->resident_next = NULL;
+        if (link_residency.tail) {
+            link_residency.tail->resident_next = linktbl;
+        } else {
+            link_residency.head = linktbl;
         }
+        link_residency.tail = linktbl;
+        link_residency.n_tables++;
+        linktbl->accessed = 1;
     }
-    LinkTable_uninitialised_fill(linktbl);
+    linktbl->resident_size = LinkTable_heap_size(linktbl);
+    link_residency.bytes += linktbl->resident_size;
+    PTHREAD_MUTEX_UNLOCK(&link_residency.lock);
+}
+
+/**
+ * \brief Count a LinkTable and the LinkTables below it as resident
+ */
+static void LinkTree_resident_add(LinkTable *linktbl)
+{
+    LinkTable_resident_add(linktbl);
+    for (int i = 1; i < linktbl->size; i++) {
+        if (linktbl->links[i]->next_table) {
+            LinkTree_resident_add(linktbl->links[i]->next_table);
+        }
+    }
+}
+
+/**
+ * \brief Remove a LinkTable from the resident list
+ * \note The caller must hold link_residency.lock.
+ */
+static void LinkTable_resident_unlink(LinkTable *linktbl)
+{
+    if (!linktbl->resident_size) {
+        return;
+    }
+    if (linktbl->resident_prev) {
+        linktbl->resident_prev->resident_next = linktbl->resident_next;
+    } else {
+        link_residency.head = linktbl->resident_next;
+    }
+    if (linktbl->resident_next) {
+        linktbl->resident_next->resident_prev = linktbl->resident_prev;
+    } else {
+        link_residency.tail = linktbl->resident_prev;
+    }
+    if (link_residency.hand == linktbl) {
+        link_residency.hand = linktbl->resident_next;
+    }
+    link_residency.n_tables--;
+    link_residency.bytes -= linktbl->resident_size;
+    linktbl->resident_size = 0;
+    linktbl->resident_prev = NULL;
+    linktbl->resident_next = NULL;
+}
+
+static void LinkTable_resident_remove(LinkTable *linktbl)
+{
+    PTHREAD_MUTEX_LOCK(&link_residency.lock);
+    LinkTable_resident_unlink(linktbl);
+    PTHREAD_MUTEX_UNLOCK(&link_residency.lock);
+}
+
+/**
+ * \brief Pick the LinkTable to evict and detach it from the tree
+ * \details This is the clock algorithm: the hand clears the accessed flag of
+ * the LinkTables it passes, and stops at the first one whose flag was already
+ * clear. Only LinkTables which nobody holds a reference to can be evicted, so
+ * the ones with open files or with subdirectories in memory stay. The
+ * subdirectories are evicted first, which releases their parent.
+ * \note The caller must hold link_lock for writing.
+ * \return the detached LinkTable, or NULL if none can be evicted
+ */
+static LinkTable *LinkTable_evict_pick(void)
+{
+    PTHREAD_MUTEX_LOCK(&link_residency.lock);
+    LinkTable *victim = NULL;
+    /* Going round twice clears every flag on the way */
+    for (size_t i = 0; i < 2 * link_residency.n_tables && !victim; i++) {
+        LinkTable *linktbl = link_residency.hand ? link_residency.hand
+                                                 : link_residency.head;
+        link_residency.hand = linktbl->resident_next;
+        if (linktbl == ROOT_LINK_TBL || !linktbl->parent_link
+            || linktbl->refcount) {
+            continue;
+        }
+        if (!atomic_exchange(&linktbl->accessed, 0)) {
+            victim = linktbl;
+        }
+    }
+    if (victim) {
+        LinkTable_resident_unlink(victim);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_residency.lock);
+
+    if (victim) {
+        victim->parent_link->next_table = NULL;
+        victim->parent_link = NULL;
+        /* The path cache must not hand out its Links any more */
+        atomic_fetch_add(&link_generation, 1);
+    }
+    return victim;
+}
+
+/**
+ * \brief Evict the least recently used LinkTables until the resident ones fit
+ * in CONFIG.dir_mem_limit
+ * \details An evicted LinkTable is saved to the cache first, so it is loaded
+ * from there when its directory is visited again. Without the cache, its
+ * listing is downloaded again.
+ * \note The caller must not hold link_lock.
+ */
+static void LinkTable_evict(void)
+{
+    /* In manifest mode the LinkTables cannot be regenerated individually */
+    if (!CONFIG.dir_mem_limit || CONFIG.mode == MANIFEST
+        || link_residency.bytes <= CONFIG.dir_mem_limit) {
+        return;
+    }
+    /* One thread evicting is enough */
+    if (atomic_exchange(&link_residency.evicting, 1)) {
+        return;
+    }
+    while (link_residency.bytes > CONFIG.dir_mem_limit) {
+        PTHREAD_RWLOCK_WRLOCK(&link_lock);
+        LinkTable *victim = LinkTable_evict_pick();
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        if (!victim) {
+            break;
+        }
+
+        if (CACHE_SYSTEM_INIT && victim->index_time) {
+            char *unescaped_path = url_to_cache_path(victim->links[0]->url);
+            if (LinkTable_disk_save(victim, unescaped_path)) {
+                lprintf(error, "Failed to save the LinkTable!\n");
+            }
+            FREE(unescaped_path);
+        }
+        lprintf(debug, "evicted %s, %zu bytes resident\n",
+                victim->links[0]->url, (size_t)link_residency.bytes);
+
+        LinkTable *parent = victim->parent_tbl;
+        LinkTable_free(victim);
+        LinkTable_unref(parent);
+        link_residency.evictions++;
+    }
+    link_residency.evicting = 0;
+}
+
+size_t LinkSystem_resident_bytes(void)
+{
+    return link_residency.bytes;
+}
+
+unsigned long LinkSystem_evictions(void)
+{
+    return link_residency.evictions;
 }
 
 void LinkTable_ref(LinkTable *tbl)
@@ -1110,20 +2034,22 @@ void LinkTable_ref(LinkTable *tbl)
     if (!tbl) {
         return;
     }
-    PTHREAD_MUTEX_LOCK(&link_lock);
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
     tbl->refcount++;
     tbl->orphaned = 0;
-    PTHREAD_MUTEX_UNLOCK(&link_lock);
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
 }
 
 void LinkTable_mark_orphaned(LinkTable *tbl)
 {
-    if (!tbl) {
+    /*
+     * In manifest mode the LinkTables cannot be regenerated individually, so
+     * they are never evicted.
+     */
+    if (!tbl || CONFIG.mode == MANIFEST) {
         return;
     }
-    PTHREAD_MUTEX_LOCK(&link_lock);
     tbl->orphaned = 1;
-    PTHREAD_MUTEX_UNLOCK(&link_lock);
 }
 
 void LinkTable_unref(LinkTable *tbl)
@@ -1131,7 +2057,20 @@ void LinkTable_unref(LinkTable *tbl)
     if (!tbl) {
         return;
     }
-    PTHREAD_MUTEX_LOCK(&link_lock);
+
+    /*
+     * Dropping a reference which is not the last one cannot free the table,
+     * so it does not need link_lock.
+     */
+    int refcount = atomic_load(&tbl->refcount);
+    while (refcount > 1) {
+        if (atomic_compare_exchange_weak(&tbl->refcount, &refcount,
+                                         refcount - 1)) {
+            return;
+        }
+    }
+
+    PTHREAD_RWLOCK_WRLOCK(&link_lock);
     tbl->refcount--;
     if (tbl->refcount == 0 && tbl->orphaned) {
         LinkTable *parent = tbl->parent_tbl;
@@ -1139,7 +2078,9 @@ void LinkTable_unref(LinkTable *tbl)
         if (parent_link) {
             parent_link->next_table = NULL;
         }
-        PTHREAD_MUTEX_UNLOCK(&link_lock);
+        /* The path cache must not hand out its Links any more */
+        atomic_fetch_add(&link_generation, 1);
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
 
         LinkTable_free(tbl);
 
@@ -1148,20 +2089,36 @@ void LinkTable_unref(LinkTable *tbl)
         }
         return;
     }
-    PTHREAD_MUTEX_UNLOCK(&link_lock);
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
 }
 
 void LinkTable_free(LinkTable *linktbl)
 {
     if (linktbl) {
+        LinkTable_resident_remove(linktbl);
+        atomic_fetch_add(&link_generation, 1);
         for (int i = 0; i < linktbl->size; i++) {
             Link *entry = linktbl->links ? linktbl->links[i] : NULL;
             if (!entry) {
                 continue;
             }
             LinkTable_free(entry->next_table);
-            FREE(entry);
         }
+        struct LinkIndex *index = atomic_load(&linktbl->index);
+        while (index) {
+            struct LinkIndex *prev = index->prev;
+            FREE(index);
+            index = prev;
+        }
+        struct LinkRetired *retired = linktbl->retired;
+        while (retired) {
+            struct LinkRetired *prev = retired->prev;
+            FREE(retired->links);
+            FREE(retired);
+            retired = prev;
+        }
+        LinkArena_free(linktbl->arena);
+        LinkTableMap_unref(linktbl->map);
         FREE(linktbl->links);
         FREE(linktbl);
     }
@@ -1173,13 +2130,14 @@ void LinkTable_print(LinkTable *linktbl)
         int j = 0;
         lprintf(info, "--------------------------------------------\n");
         lprintf(info, " LinkTable %p for %s\n", (void *)linktbl,
-                linktbl->links[0]->f_url);
+                linktbl->links[0]->url);
         lprintf(info, "--------------------------------------------\n");
         for (int i = 0; i < linktbl->size; i++) {
             Link *this_link = linktbl->links[i];
+            char *url = Link_get_url(this_link);
             lprintf(info, "%d %c %lu %s %s\n", i, this_link->type,
-                    this_link->content_length, this_link->linkname,
-                    this_link->f_url);
+                    this_link->content_length, this_link->linkname, url);
+            FREE(url);
             if ((this_link->type != LINK_FILE) && (this_link->type != LINK_DIR)
                 && (this_link->type != LINK_HEAD)) {
                 j++;
@@ -1202,9 +2160,8 @@ LinkTable *LinkTable_alloc(const char *url)
     /*
      * populate the base URL
      */
-    Link *head_link = Link_new("/", LINK_HEAD);
-    LinkTable_add(linktbl, head_link);
-    strncpy(head_link->f_url, url, PATH_MAX);
+    Link *head_link = LinkTable_add(linktbl, "/", LINK_HEAD);
+    Link_set_url(head_link, url);
     assert(linktbl->size == 1);
     return linktbl;
 }
@@ -1221,7 +2178,7 @@ char *url_to_cache_path(const char *url)
      * origin, so applying ROOT_LINK_OFFSET would produce garbage. Detect
      * this case by checking whether url is cross-origin from root.
      */
-    if (ROOT_LINK_TBL && is_cross_origin(ROOT_LINK_TBL->links[0]->f_url, url)) {
+    if (is_cross_origin_from_root(url)) {
         /* External URL: use the full URL as the cache key path. */
         char *temp = curl_easy_unescape(NULL, url, 0, NULL);
         unescaped_path = temp ? STRDUP(temp) : STRDUP(url);
@@ -1256,148 +2213,743 @@ char *url_to_cache_path(const char *url)
     return unescaped_path;
 }
 
-LinkTable *LinkTable_new(const char *url)
+/**
+ * \brief Check whether a LinkTable is older than CONFIG.refresh_timeout
+ */
+static int LinkTable_is_stale(LinkTable *linktbl)
 {
-    char *unescaped_path = url_to_cache_path(url);
-    LinkTable *linktbl = NULL;
-
-    /*
-     * Attempt to load the LinkTable from the disk.
-     */
-    if (CACHE_SYSTEM_INIT) {
-        CacheDir_create(unescaped_path);
-        LinkTable *disk_linktbl;
+    return time(NULL) - linktbl->index_time > CONFIG.refresh_timeout;
+}
 
-        disk_linktbl = LinkTable_disk_open(unescaped_path);
-        if (disk_linktbl) {
-            /*
-             * Check if the LinkTable needs to be refreshed based on timeout.
-             */
-            time_t time_now = time(NULL);
-            if (time_now - disk_linktbl->index_time > CONFIG.refresh_timeout) {
-                lprintf(info, "time_now: %ld, index_time: %ld\n",
-                        (long)time_now, (long)disk_linktbl->index_time);
-                lprintf(info, "diff: %ld, limit: %d\n",
-                        (long)(time_now - disk_linktbl->index_time),
-                        CONFIG.refresh_timeout);
-                LinkTable_free(disk_linktbl);
-            } else {
-                linktbl = disk_linktbl;
-            }
+static int LinkTable_has_uninitialised(LinkTable *linktbl)
+{
+    Link **links;
+    int size = LinkTable_entries(linktbl, &links);
+    for (int i = 1; i < size; i++) {
+        if (Link_is_uninitialised(links[i])) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    /*
-     * Download a new LinkTable because we didn't manage to load it from the
-     * disk
-     */
-    if (!linktbl) {
-        linktbl = LinkTable_alloc(url);
-        linktbl->index_time = time(NULL);
-
-        /*
-         * start downloading the base URL
-         */
-        TransferStruct ts = Link_download_full(linktbl->links[0]);
-        if (ts.curr_size == 0) {
-            LinkTable_free(linktbl);
-            return NULL;
-        }
-
-        /*
-         * Otherwise parsed the received data
-         */
-        LinkTable_parse_html(linktbl, url, ts.data);
-        FREE(ts.data);
-
-
-        LinkTable_fill(linktbl);
+/**
+ * \brief Stat the uninitialised entries of a LinkTable, runs in its own thread
+ * \param[in] arg the LinkTable, the thread holds a reference to it
+ */
+static void *LinkTable_fill_worker(void *arg)
+{
+    LinkTable *linktbl = arg;
+    LinkTable_uninitialised_fill(linktbl);
 
-        /*
-         * Save the link table
-         */
-        if (CACHE_SYSTEM_INIT && LinkTable_disk_save(linktbl, unescaped_path)) {
+    if (CACHE_SYSTEM_INIT && linktbl->index_time) {
+        char *unescaped_path = url_to_cache_path(linktbl->links[0]->url);
+        if (LinkTable_disk_save(linktbl, unescaped_path)) {
             lprintf(error, "Failed to save the LinkTable!\n");
         }
+        FREE(unescaped_path);
     }
 
-    FREE(unescaped_path);
-    LinkTable_print(linktbl);
-    return linktbl;
-}
+    linktbl->filling = 0;
+    LinkTable_unref(linktbl);
 
-static void LinkTable_disk_delete(const char *dirn)
-{
-    char *metadirn = path_append(META_DIR, dirn);
-    char *path = path_append(metadirn, ".LinkTable");
-    if (unlink(path)) {
-        lprintf(error, "unlink(%s): %s\n", path, strerror(errno));
-    }
-    FREE(path);
-    FREE(metadirn);
+    PTHREAD_MUTEX_LOCK(&link_fill_lock);
+    link_fills--;
+    PTHREAD_COND_BROADCAST(&link_fill_cond);
+    PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+    return NULL;
 }
 
-/* This is necessary to get the compiler on some platforms to stop
-   complaining about the fact that we're not using the return value of
-   fread, when we know we aren't and that's fine. */
-static inline void ignore_value(int i)
+/**
+ * \brief Start stating the uninitialised entries of a LinkTable in the
+ * background
+ * \details The LinkTable is served in the meantime. readdir lists the entries
+ * which are still being stat'ed, Link_wait_file_stat() waits for a single
+ * entry.
+ * \note The caller must hold a reference to the LinkTable, and must not hold
+ * link_lock.
+ */
+static void LinkTable_fill_start(LinkTable *linktbl)
 {
-    (void)i;
-}
+    if (!linktbl || linktbl->filling
+        || (!LinkTable_has_uninitialised(linktbl)
+            && !LinkTable_probe_due(linktbl))) {
+        return;
+    }
+    if (atomic_exchange(&linktbl->filling, 1)) {
+        return;
+    }
 
-int LinkTable_disk_save(LinkTable *linktbl, const char *dirn)
-{
-    char *metadirn = path_append(META_DIR, dirn);
-    char *path = path_append(metadirn, ".LinkTable");
-    FILE *fp = fopen(path, "w");
-    FREE(metadirn);
+    pthread_t thread;
+    pthread_attr_t attr;
 
-    if (!fp) {
-        lprintf(error, "fopen(%s): %s\n", path, strerror(errno));
-        FREE(path);
-        return -1;
+    if (pthread_attr_init(&attr)) {
+        lprintf(fatal, "pthread_attr_init():%d, %s\n", errno, strerror(errno));
     }
 
-    if (fwrite(&linktbl->size, sizeof(int), 1, fp) != 1
-        || fwrite(&linktbl->index_time, sizeof(time_t), 1, fp) != 1) {
-        lprintf(error, "Failed to save the header of %s!\n", path);
-    }
-    FREE(path);
-    for (int i = 0; i < linktbl->size; i++) {
-        ignore_value(
-            fwrite(linktbl->links[i]->linkname, sizeof(char), NAME_MAX, fp));
-        ignore_value(
-            fwrite(linktbl->links[i]->f_url, sizeof(char), PATH_MAX, fp));
-        ignore_value(fwrite(&linktbl->links[i]->type, sizeof(LinkType), 1, fp));
-        ignore_value(
-            fwrite(&linktbl->links[i]->content_length, sizeof(size_t), 1, fp));
-        ignore_value(fwrite(&linktbl->links[i]->time, sizeof(long), 1, fp));
+    if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+        lprintf(fatal, "pthread_attr_setdetachstate():%d, %s\n", errno,
+                strerror(errno));
     }
 
-    int res = 0;
+    linktbl->refcount++;
+    PTHREAD_MUTEX_LOCK(&link_fill_lock);
+    link_fills++;
+    PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+    if (pthread_create(&thread, &attr, LinkTable_fill_worker, linktbl)) {
+        lprintf(error, "pthread_create(): %d, %s\n", errno, strerror(errno));
+        PTHREAD_MUTEX_LOCK(&link_fill_lock);
+        link_fills--;
+        PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+        linktbl->refcount--;
+        linktbl->filling = 0;
+    }
 
-    if (ferror(fp)) {
-        lprintf(error, "encountered ferror!\n");
-        res = -1;
+    if (pthread_attr_destroy(&attr)) {
+        lprintf(fatal, "pthread_attr_destroy(): %d, %s\n", errno,
+                strerror(errno));
     }
+}
 
-    if (fclose(fp)) {
-        lprintf(error, "cannot close the file pointer, %s\n", strerror(errno));
-        res = -1;
+void Link_wait_file_stat(Link *link)
+{
+    LinkTable *linktbl = link->parent_table;
+    if (!Link_is_uninitialised(link)) {
+        return;
     }
+    LinkTable_fill_start(linktbl);
 
-    return res;
+    /* A fill which has finished leaves entries it has to retry */
+    PTHREAD_MUTEX_LOCK(&link_fill_lock);
+    while (Link_is_uninitialised(link) && linktbl->filling) {
+        PTHREAD_COND_WAIT(&link_fill_cond, &link_fill_lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
 }
 
-LinkTable *LinkTable_disk_open(const char *dirn)
+void LinkTable_wait_filled(LinkTable *linktbl)
 {
-    char *metadirn = path_append(META_DIR, dirn);
+    PTHREAD_MUTEX_LOCK(&link_fill_lock);
+    while (linktbl->filling) {
+        PTHREAD_COND_WAIT(&link_fill_cond, &link_fill_lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+}
+
+/**
+ * \brief Download and fill in a LinkTable, then save it to the disk
+ * \param[in] stale the LinkTable being refreshed, or NULL
+ * \return the new LinkTable, stale if the listing has not been modified, or
+ * NULL if the listing cannot be downloaded
+ */
+static LinkTable *LinkTable_fetch(const char *url, const char *unescaped_path,
+                                  LinkTable *stale)
+{
+    LinkTable *linktbl = LinkTable_alloc(url);
+    linktbl->index_time = time(NULL);
+
+    /*
+     * Download the base URL, the listing is parsed as it arrives
+     */
+    int res = LinkTable_download(linktbl, url, stale);
+    if (res) {
+        LinkTable_free(linktbl);
+        return res == 1 ? stale : NULL;
+    }
+
+    LinkTable_fill(linktbl, stale);
+
+    /*
+     * A refreshed LinkTable replaces one which is being served, so it is
+     * completed first. A new one is served straight away, its entries are
+     * stat'ed in the background once it is part of the tree, see
+     * LinkTable_fill_start().
+     */
+    if (stale) {
+        LinkTable_uninitialised_fill(linktbl);
+    }
+
+    /*
+     * Save the link table, LinkTable_fill_worker() saves it once its entries
+     * have been stat'ed otherwise.
+     */
+    if (CACHE_SYSTEM_INIT && !LinkTable_has_uninitialised(linktbl)
+        && LinkTable_disk_save(linktbl, unescaped_path)) {
+        lprintf(error, "Failed to save the LinkTable!\n");
+    }
+    return linktbl;
+}
+
+LinkTable *LinkTable_new(const char *url)
+{
+    char *unescaped_path = url_to_cache_path(url);
+    LinkTable *linktbl = NULL;
+
+    /*
+     * Attempt to load the LinkTable from the disk.
+     */
+    if (CACHE_SYSTEM_INIT) {
+        CacheDir_create(unescaped_path);
+        linktbl = LinkTable_disk_open(unescaped_path);
+        /*
+         * A stale LinkTable is still served, LinkTable_revalidate() refreshes
+         * it in the background once it has been added to the tree.
+         */
+        if (linktbl && LinkTable_is_stale(linktbl)) {
+            lprintf(info, "serving stale LinkTable for %s\n", url);
+            lprintf(info, "age: %ld, limit: %d\n",
+                    (long)(time(NULL) - linktbl->index_time),
+                    CONFIG.refresh_timeout);
+        }
+    }
+
+    /*
+     * Download a new LinkTable because we didn't manage to load it from the
+     * disk
+     */
+    if (!linktbl) {
+        linktbl = LinkTable_fetch(url, unescaped_path, NULL);
+        if (!linktbl) {
+            FREE(unescaped_path);
+            return NULL;
+        }
+    }
+
+    FREE(unescaped_path);
+    LinkTable_print(linktbl);
+    return linktbl;
+}
+
+static int Link_is_dir(const Link *link)
+{
+    LinkType type = link->type;
+    return type == LINK_DIR || type == LINK_UNINITIALISED_DIR;
+}
+
+/**
+ * \brief Find the Link of a stale LinkTable which is the same entry as a Link
+ * of its refreshed listing
+ * \details The first Links with the name in each table are paired up if they
+ * have the same URL, and are either both directories or both not.
+ * \note The caller must hold link_lock for writing.
+ */
+static Link *LinkTable_match(LinkTable *stale, LinkTable *linktbl, Link *link)
+{
+    Link *stale_link = LinkTable_lookup(stale, link->linkname);
+    if (!stale_link || LinkTable_lookup(linktbl, link->linkname) != link
+        || Link_is_dir(stale_link) != Link_is_dir(link)) {
+        return NULL;
+    }
+    char *url = Link_get_url(link);
+    char *stale_url = Link_get_url(stale_link);
+    int same_url = !strcmp(url, stale_url);
+    FREE(stale_url);
+    FREE(url);
+    return same_url ? stale_link : NULL;
+}
+
+/**
+ * \brief Update a Link with the stat results of its refreshed entry
+ * \return whether its type, size or time have changed
+ */
+static int Link_update(Link *link, const Link *fresh)
+{
+    /* An entry which could not be stat'ed keeps what is known about it */
+    if (Link_is_uninitialised(fresh)) {
+        return 0;
+    }
+    LinkType type = fresh->type;
+    link->probe_failures = fresh->probe_failures;
+    link->probe_time = fresh->probe_time;
+    if (fresh->restat && !link->restat) {
+        link->restat = 1;
+    }
+    /* The Link is being served, so it is only written if it has changed */
+    if (link->type == type && link->content_length == fresh->content_length
+        && link->time == fresh->time) {
+        return 0;
+    }
+    link->content_length = fresh->content_length;
+    link->time = fresh->time;
+    link->type = type;
+    return 1;
+}
+
+/**
+ * \brief Copy a Link of a refreshed listing into the LinkTable it is merged
+ * into
+ */
+static Link *LinkTable_adopt(LinkTable *linktbl, const Link *link)
+{
+    Link *copy = LinkArena_alloc(linktbl, sizeof(Link), _Alignof(Link));
+    *copy = *link;
+    copy->parent_table = linktbl;
+    copy->linkname = LinkArena_strndup(linktbl, link->linkname, NAME_MAX);
+    if (link->url == link->linkname) {
+        copy->url = copy->linkname;
+    } else if (link->url) {
+        copy->url = LinkArena_strndup(linktbl, link->url, PATH_MAX);
+    }
+    copy->next_table = NULL;
+    copy->cache_ptr = NULL;
+    return copy;
+}
+
+void LinkTable_replace(LinkTable *old_tbl, LinkTable *new_tbl)
+{
+    /* new_tbl is not shared yet, so it can be indexed without link_lock */
+    LinkTable_index(new_tbl);
+
+    PTHREAD_RWLOCK_WRLOCK(&link_lock);
+    old_tbl->refreshing = 0;
+    if (old_tbl != ROOT_LINK_TBL && !old_tbl->parent_link) {
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        LinkTable_free(new_tbl);
+        return;
+    }
+
+    LinkTableDiff diff = {
+        .added = CALLOC(new_tbl->size, sizeof(Link *)),
+        .removed = CALLOC(old_tbl->size, sizeof(Link *)),
+        .changed = CALLOC(new_tbl->size, sizeof(Link *)),
+    };
+    /*
+     * The subdirectories that have disappeared from the listing cannot be
+     * freed while holding link_lock, they are collected here.
+     */
+    LinkTable **gone = CALLOC(old_tbl->size, sizeof(LinkTable *));
+    int n_gone = 0;
+
+    /* This reference is dropped when we are done with the table */
+    old_tbl->refcount++;
+    Link *dir_link = old_tbl == ROOT_LINK_TBL ? NULL : old_tbl->parent_link;
+
+    /*
+     * The entries which are still listed keep their Links, so their inodes,
+     * subdirectories and cache files stay as they are.
+     */
+    Link **links = CALLOC(new_tbl->size, sizeof(Link *));
+    links[0] = old_tbl->links[0];
+    for (int i = 1; i < new_tbl->size; i++) {
+        Link *new_link = new_tbl->links[i];
+        Link *old_link = LinkTable_match(old_tbl, new_tbl, new_link);
+        if (old_link) {
+            if (Link_update(old_link, new_link)) {
+                diff.changed[diff.n_changed++] = old_link;
+            }
+            links[i] = old_link;
+        } else {
+            links[i] = LinkTable_adopt(old_tbl, new_link);
+            diff.added[diff.n_added++] = links[i];
+        }
+    }
+
+    for (int i = 1; i < old_tbl->size; i++) {
+        Link *old_link = old_tbl->links[i];
+        Link *new_link = LinkTable_lookup(new_tbl, old_link->linkname);
+        if (new_link
+            && LinkTable_match(old_tbl, new_tbl, new_link) == old_link) {
+            continue;
+        }
+        diff.removed[diff.n_removed++] = old_link;
+        LinkTable *child = old_link->next_table;
+        if (child) {
+            /*
+             * The child keeps its reference to this table until it is
+             * freed.
+             */
+            old_link->next_table = NULL;
+            child->parent_link = NULL;
+            child->orphaned = 1;
+            child->refcount++;
+            gone[n_gone++] = child;
+        }
+    }
+
+    if (diff.n_added || diff.n_removed || new_tbl->size != old_tbl->size
+        || memcmp((void *)links, (void *)old_tbl->links,
+                  (size_t)new_tbl->size * sizeof(Link *))) {
+        /* Readers may still be walking the old array */
+        struct LinkRetired *retired = CALLOC(1, sizeof(struct LinkRetired));
+        retired->links = old_tbl->links;
+        retired->capacity = old_tbl->capacity;
+        retired->prev = old_tbl->retired;
+        old_tbl->retired = retired;
+        old_tbl->links = links;
+        old_tbl->size = new_tbl->size;
+        old_tbl->capacity = new_tbl->size;
+    } else {
+        FREE(links);
+    }
+    old_tbl->index_time = new_tbl->index_time;
+    old_tbl->probe_time = new_tbl->probe_time;
+    memcpy(old_tbl->etag, new_tbl->etag, sizeof(old_tbl->etag));
+    memcpy(old_tbl->last_modified, new_tbl->last_modified,
+           sizeof(old_tbl->last_modified));
+    LinkTable_resident_add(old_tbl);
+    atomic_fetch_add(&link_generation, 1);
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+
+    lprintf(debug, "%s: %d entries added, %d removed, %d changed\n",
+            old_tbl->links[0]->url, diff.n_added, diff.n_removed,
+            diff.n_changed);
+
+    /* LinkSystem_on_replace() waits for the call to return */
+    PTHREAD_MUTEX_LOCK(&link_replace.lock);
+    LinkReplaceCallback callback = link_replace.callback;
+    if (callback) {
+        link_replace.running++;
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_replace.lock);
+    if (callback) {
+        callback(dir_link, old_tbl, &diff);
+        PTHREAD_MUTEX_LOCK(&link_replace.lock);
+        if (!--link_replace.running) {
+            PTHREAD_COND_BROADCAST(&link_replace.cond);
+        }
+        PTHREAD_MUTEX_UNLOCK(&link_replace.lock);
+    }
+
+    for (int i = 0; i < n_gone; i++) {
+        LinkTable_unref(gone[i]);
+    }
+    FREE(gone);
+    FREE(diff.added);
+    FREE(diff.removed);
+    FREE(diff.changed);
+    LinkTable_free(new_tbl);
+    LinkTable_unref(old_tbl);
+    LinkTable_evict();
+}
+
+int LinkTable_entries(LinkTable *linktbl, Link ***links)
+{
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    int size = linktbl->size;
+    *links = linktbl->links;
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    return size;
+}
+
+void LinkSystem_on_replace(LinkReplaceCallback callback)
+{
+    PTHREAD_MUTEX_LOCK(&link_replace.lock);
+    link_replace.callback = callback;
+    while (link_replace.running) {
+        PTHREAD_COND_WAIT(&link_replace.cond, &link_replace.lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_replace.lock);
+}
+
+/**
+ * \brief Refresh a stale LinkTable, runs in its own thread
+ * \param[in] arg the stale LinkTable, the caller must hold a reference to it
+ */
+static void *LinkTable_refresh(void *arg)
+{
+    LinkTable *old_tbl = arg;
+    char *url = Link_get_url(old_tbl->links[0]);
+    char *unescaped_path = url_to_cache_path(url);
+
+    lprintf(info, "refreshing %s\n", url);
+    LinkTable *new_tbl = LinkTable_fetch(url, unescaped_path, old_tbl);
+    if (new_tbl == old_tbl) {
+        lprintf(info, "%s has not been modified\n", url);
+        PTHREAD_RWLOCK_WRLOCK(&link_lock);
+        old_tbl->index_time = time(NULL);
+        old_tbl->refreshing = 0;
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        if (CACHE_SYSTEM_INIT && LinkTable_disk_save(old_tbl, unescaped_path)) {
+            lprintf(error, "Failed to save the LinkTable!\n");
+        }
+    } else if (new_tbl) {
+        LinkTable_print(new_tbl);
+        LinkTable_replace(old_tbl, new_tbl);
+    } else {
+        lprintf(warning, "failed to refresh %s, serving the stale listing\n",
+                url);
+        PTHREAD_RWLOCK_WRLOCK(&link_lock);
+        /* Don't retry until another refresh_timeout has elapsed */
+        old_tbl->index_time = time(NULL);
+        old_tbl->refreshing = 0;
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    }
+
+    FREE(unescaped_path);
+    FREE(url);
+    LinkTable_unref(old_tbl);
+    return NULL;
+}
+
+/**
+ * \brief Start refreshing a LinkTable in the background if it is stale
+ * \details The stale LinkTable is still served until LinkTable_replace()
+ * swaps the refreshed one in.
+ * \note The caller must hold link_lock, for reading is enough.
+ */
+static void LinkTable_revalidate(LinkTable *linktbl)
+{
+    if (CONFIG.mode != NORMAL || !linktbl || linktbl->refreshing
+        || !LinkTable_is_stale(linktbl)) {
+        return;
+    }
+    /*
+     * Tables which have been replaced are no longer part of the tree, and
+     * tables without an index_time were not built from a downloaded listing.
+     */
+    if ((linktbl != ROOT_LINK_TBL && !linktbl->parent_link)
+        || !linktbl->index_time) {
+        return;
+    }
+    /* Several readers may get here at once, only one of them refreshes */
+    if (atomic_exchange(&linktbl->refreshing, 1)) {
+        return;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    if (pthread_attr_init(&attr)) {
+        lprintf(fatal, "pthread_attr_init():%d, %s\n", errno, strerror(errno));
+    }
+
+    if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+        lprintf(fatal, "pthread_attr_setdetachstate():%d, %s\n", errno,
+                strerror(errno));
+    }
+
+    linktbl->refcount++;
+    if (pthread_create(&thread, &attr, LinkTable_refresh, linktbl)) {
+        lprintf(error, "pthread_create(): %d, %s\n", errno, strerror(errno));
+        linktbl->refreshing = 0;
+        linktbl->refcount--;
+    }
+
+    if (pthread_attr_destroy(&attr)) {
+        lprintf(fatal, "pthread_attr_destroy(): %d, %s\n", errno,
+                strerror(errno));
+    }
+}
+
+static void LinkTable_disk_delete(const char *dirn)
+{
+    char *metadirn = path_append(META_DIR, dirn);
+    char *path = path_append(metadirn, ".LinkTable");
+    if (unlink(path)) {
+        lprintf(error, "unlink(%s): %s\n", path, strerror(errno));
+    }
+    FREE(path);
+    FREE(metadirn);
+}
+
+/**
+ * \brief The magic number at the start of a LinkTable file
+ * \details Files saved by older versions start with the number of Links
+ * instead, so they can be told apart.
+ */
+#define LINKTABLE_DISK_MAGIC "HDFS\x89LT\n"
+#define LINKTABLE_DISK_VERSION 2
+/** \brief The string offset of a Link without a URL */
+#define LINKTABLE_DISK_NO_URL UINT32_MAX
+
+/**
+ * \brief The header of a LinkTable file
+ * \details The file is laid out as the header, n_links entries, then a table
+ * of NUL terminated strings the entries point into by offset. The strings are
+ * used in place when the file is loaded with mmap(), see LinkTable_disk_open().
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_links;
+    uint32_t strtab_size;
+    /** \brief The CRC-32 of everything after the header */
+    uint32_t crc;
+    int64_t index_time;
+    uint32_t etag_off;
+    uint32_t last_modified_off;
+} LinkTableDiskHeader;
+
+/**
+ * \brief An entry of a LinkTable file
+ */
+typedef struct {
+    uint32_t name_off;
+    /** \brief LINKTABLE_DISK_NO_URL, or the offset of Link::url */
+    uint32_t url_off;
+    uint32_t type;
+    uint32_t url_absolute;
+    uint64_t content_length;
+    int64_t time;
+} LinkTableDiskEntry;
+
+_Static_assert(sizeof(LinkTableDiskHeader) == 40,
+               "LinkTableDiskHeader must not have padding");
+_Static_assert(sizeof(LinkTableDiskEntry) == 32,
+               "LinkTableDiskEntry must not have padding");
+
+static uint32_t LinkTable_disk_crc(const char *data, size_t len)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (len > 0) {
+        uInt chunk = len > 0x40000000 ? 0x40000000 : (uInt)len;
+        crc = crc32(crc, (const Bytef *)data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+    return (uint32_t)crc;
+}
+
+/**
+ * \brief Append a string to the string table of a LinkTable file
+ * \return the offset of the string
+ */
+static uint32_t LinkTable_disk_add_string(char *strtab, size_t *strtab_used,
+                                          const char *str)
+{
+    uint32_t off = (uint32_t)*strtab_used;
+    size_t len = strlen(str) + 1;
+    memcpy(strtab + *strtab_used, str, len);
+    *strtab_used += len;
+    return off;
+}
+
+/**
+ * \brief Serialise a LinkTable into the format of a LinkTable file
+ * \return the buffer, which the caller must free, or NULL if the LinkTable is
+ * too large
+ */
+static char *LinkTable_disk_serialise(LinkTable *linktbl, size_t *size)
+{
+    /* Links whose URL is their name share the string */
+    size_t strtab_size = strlen(linktbl->etag) + strlen(linktbl->last_modified)
+                         + 2;
+    for (int i = 0; i < linktbl->size; i++) {
+        Link *link = linktbl->links[i];
+        strtab_size += strlen(link->linkname) + 1;
+        if (link->url && strcmp(link->url, link->linkname)) {
+            strtab_size += strlen(link->url) + 1;
+        }
+    }
+    if (strtab_size >= LINKTABLE_DISK_NO_URL) {
+        return NULL;
+    }
+
+    size_t entries_size = (size_t)linktbl->size * sizeof(LinkTableDiskEntry);
+    size_t file_size = sizeof(LinkTableDiskHeader) + entries_size + strtab_size;
+    char *buf = CALLOC(file_size, sizeof(char));
+    LinkTableDiskHeader *header = (LinkTableDiskHeader *)buf;
+    LinkTableDiskEntry *entries
+        = (LinkTableDiskEntry *)(buf + sizeof(LinkTableDiskHeader));
+    char *strtab = buf + sizeof(LinkTableDiskHeader) + entries_size;
+    size_t strtab_used = 0;
+
+    for (int i = 0; i < linktbl->size; i++) {
+        Link *link = linktbl->links[i];
+        entries[i].name_off
+            = LinkTable_disk_add_string(strtab, &strtab_used, link->linkname);
+        if (!link->url) {
+            entries[i].url_off = LINKTABLE_DISK_NO_URL;
+        } else if (!strcmp(link->url, link->linkname)) {
+            entries[i].url_off = entries[i].name_off;
+        } else {
+            entries[i].url_off
+                = LinkTable_disk_add_string(strtab, &strtab_used, link->url);
+        }
+        entries[i].type = (uint32_t)link->type;
+        entries[i].url_absolute = (uint32_t)link->url_absolute;
+        entries[i].content_length = (uint64_t)link->content_length;
+        entries[i].time = (int64_t)link->time;
+    }
+    memcpy(header->magic, LINKTABLE_DISK_MAGIC, sizeof(header->magic));
+    header->version = LINKTABLE_DISK_VERSION;
+    header->n_links = (uint32_t)linktbl->size;
+    header->index_time = (int64_t)linktbl->index_time;
+    header->etag_off
+        = LinkTable_disk_add_string(strtab, &strtab_used, linktbl->etag);
+    header->last_modified_off = LinkTable_disk_add_string(
+        strtab, &strtab_used, linktbl->last_modified);
+    header->strtab_size = (uint32_t)strtab_size;
+    header->crc = LinkTable_disk_crc(buf + sizeof(LinkTableDiskHeader),
+                                     file_size - sizeof(LinkTableDiskHeader));
+    *size = file_size;
+    return buf;
+}
+
+/**
+ * \brief Replace a file with the content of a buffer
+ * \details The file is written under a temporary name and renamed over the old
+ * one, so a LinkTable which still maps the old file keeps its contents.
+ */
+static int disk_write_atomic(const char *path, const char *buf, size_t size)
+{
+    size_t tmp_len = strlen(path) + 8;
+    char *tmp_path = CALLOC(tmp_len, sizeof(char));
+    snprintf(tmp_path, tmp_len, "%s.XXXXXX", path);
+
+    int res = 0;
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        lprintf(error, "mkstemp(%s): %s\n", tmp_path, strerror(errno));
+        FREE(tmp_path);
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, buf + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            lprintf(error, "write(%s): %s\n", tmp_path, strerror(errno));
+            res = -1;
+            break;
+        }
+        written += (size_t)n;
+    }
+    if (close(fd)) {
+        lprintf(error, "close(%s): %s\n", tmp_path, strerror(errno));
+        res = -1;
+    }
+    if (!res && rename(tmp_path, path)) {
+        lprintf(error, "rename(%s): %s\n", path, strerror(errno));
+        res = -1;
+    }
+    if (res) {
+        unlink(tmp_path);
+    }
+    FREE(tmp_path);
+    return res;
+}
+
+int LinkTable_disk_save(LinkTable *linktbl, const char *dirn)
+{
+    size_t size;
+    /* A refresh may swap the entries of a LinkTable in the tree */
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    char *buf = LinkTable_disk_serialise(linktbl, &size);
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    if (!buf) {
+        lprintf(error, "LinkTable of %s is too large to save!\n", dirn);
+        return -1;
+    }
+
+    char *metadirn = path_append(META_DIR, dirn);
     char *path = path_append(metadirn, ".LinkTable");
-    FILE *fp = fopen(path, "r");
     FREE(metadirn);
+    int res = disk_write_atomic(path, buf, size);
+    FREE(path);
+    FREE(buf);
+    return res;
+}
 
+/**
+ * \brief Load a LinkTable saved by older versions, with fixed size fields
+ */
+static LinkTable *LinkTable_disk_open_v1(const char *dirn, const char *path)
+{
+    FILE *fp = fopen(path, "r");
     if (!fp) {
-        FREE(path);
         return NULL;
     }
 
@@ -1409,7 +2961,6 @@ LinkTable *LinkTable_disk_open(const char *dirn)
         fclose(fp);
         LinkTable_free(linktbl);
         LinkTable_disk_delete(dirn);
-        FREE(path);
         return NULL;
     }
 
@@ -1420,7 +2971,6 @@ LinkTable *LinkTable_disk_open(const char *dirn)
         fclose(fp);
         LinkTable_free(linktbl);
         LinkTable_disk_delete(dirn);
-        FREE(path);
         return NULL;
     }
     long file_size = ftell(fp);
@@ -1430,7 +2980,6 @@ LinkTable *LinkTable_disk_open(const char *dirn)
         fclose(fp);
         LinkTable_free(linktbl);
         LinkTable_disk_delete(dirn);
-        FREE(path);
         return NULL;
     }
 
@@ -1442,126 +2991,805 @@ LinkTable *LinkTable_disk_open(const char *dirn)
         fclose(fp);
         LinkTable_free(linktbl);
         LinkTable_disk_delete(dirn);
-        FREE(path);
         return NULL;
     }
 
-    linktbl->size = sz;
-    linktbl->links
-        = (Link **)CALLOC( // NOLINT(clang-analyzer-optin.taint.TaintedAlloc)
-            sz, sizeof(Link *));
-
+    char linkname[NAME_MAX + 1] = { 0 };
+    char url[PATH_MAX + 1] = { 0 };
     for (int i = 0; i < sz; i++) {
-        linktbl->links[i] = CALLOC(1, sizeof(Link));
-        linktbl->links[i]->parent_table = linktbl;
-        if (fread(linktbl->links[i]->linkname, sizeof(char), NAME_MAX, fp)
-                != NAME_MAX
-            || fread(linktbl->links[i]->f_url, sizeof(char), PATH_MAX, fp)
-                   != PATH_MAX
-            || fread(&linktbl->links[i]->type, sizeof(LinkType), 1, fp) != 1
-            || fread(&linktbl->links[i]->content_length, sizeof(size_t), 1, fp)
-                   != 1
-            || fread(&linktbl->links[i]->time, sizeof(long), 1, fp) != 1) {
+        LinkType type;
+        size_t content_length;
+        long mtime;
+        if (fread(linkname, sizeof(char), NAME_MAX, fp) != NAME_MAX
+            || fread(url, sizeof(char), PATH_MAX, fp) != PATH_MAX
+            || fread(&type, sizeof(LinkType), 1, fp) != 1
+            || fread(&content_length, sizeof(size_t), 1, fp) != 1
+            || fread(&mtime, sizeof(long), 1, fp) != 1) {
             lprintf(error, "Corrupted LinkTable at index %d!\n", i);
             fclose(fp);
             LinkTable_free(linktbl);
             LinkTable_disk_delete(dirn);
-            FREE(path);
             return NULL;
         }
-    }
+        Link *link = LinkTable_add(linktbl, linkname, type);
+        Link_set_url(link, url);
+        link->content_length = content_length;
+        link->time = mtime;
+    }
+    if (fread(linktbl->etag, sizeof(char), LINKTABLE_VALIDATOR_LEN, fp)
+            != LINKTABLE_VALIDATOR_LEN
+        || fread(linktbl->last_modified, sizeof(char), LINKTABLE_VALIDATOR_LEN,
+                 fp)
+               != LINKTABLE_VALIDATOR_LEN) {
+        /* Saved by an older version, a full download is needed next time */
+        linktbl->etag[0] = '\0';
+        linktbl->last_modified[0] = '\0';
+    }
+    linktbl->etag[LINKTABLE_VALIDATOR_LEN - 1] = '\0';
+    linktbl->last_modified[LINKTABLE_VALIDATOR_LEN - 1] = '\0';
     if (fclose(fp)) {
         lprintf(error, "cannot close the file pointer, %s\n", strerror(errno));
     }
 
-    FREE(path);
     return linktbl;
 }
 
-LinkTable *path_to_LinkTable(const char *path)
+
+/**
+ * \brief Check that a string offset of a LinkTable file is in bounds
+ */
+static int LinkTable_disk_string_valid(uint32_t off, uint32_t strtab_size)
+{
+    return off < strtab_size;
+}
+
+/**
+ * \brief Check the mapping of a LinkTable file before it is used
+ * \return 0 if it is valid
+ */
+static int LinkTable_disk_validate(const char *map, size_t map_size)
 {
-    Link *link = NULL;
-    Link *tmp_link = NULL;
-    LinkTable *next_table = NULL;
+    const LinkTableDiskHeader *header = (const LinkTableDiskHeader *)map;
+    if (header->version != LINKTABLE_DISK_VERSION) {
+        lprintf(error, "Unsupported LinkTable version: %u\n", header->version);
+        return -1;
+    }
+    size_t entries_size
+        = (size_t)header->n_links * sizeof(LinkTableDiskEntry);
+    if (header->n_links < 1 || header->strtab_size < 1
+        || map_size
+               != sizeof(LinkTableDiskHeader) + entries_size
+                      + header->strtab_size) {
+        lprintf(error, "Invalid LinkTable size!\n");
+        return -1;
+    }
+    if (LinkTable_disk_crc(map + sizeof(LinkTableDiskHeader),
+                           map_size - sizeof(LinkTableDiskHeader))
+        != header->crc) {
+        lprintf(error, "LinkTable checksum mismatch!\n");
+        return -1;
+    }
 
-    if (!strcmp(path, "/")) {
-        next_table = ROOT_LINK_TBL;
-        LinkTable_ref(next_table);
-        return next_table;
-    } else {
-        link = path_to_Link(path);
-        if (!link) {
-            return NULL;
+    const LinkTableDiskEntry *entries
+        = (const LinkTableDiskEntry *)(map + sizeof(LinkTableDiskHeader));
+    const char *strtab = map + sizeof(LinkTableDiskHeader) + entries_size;
+    uint32_t strtab_size = header->strtab_size;
+    /* Every string ends before the end of the table */
+    if (strtab[strtab_size - 1] != '\0'
+        || !LinkTable_disk_string_valid(header->etag_off, strtab_size)
+        || !LinkTable_disk_string_valid(header->last_modified_off,
+                                        strtab_size)) {
+        lprintf(error, "Invalid LinkTable string table!\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < header->n_links; i++) {
+        if (!LinkTable_disk_string_valid(entries[i].name_off, strtab_size)
+            || (entries[i].url_off != LINKTABLE_DISK_NO_URL
+                && !LinkTable_disk_string_valid(entries[i].url_off,
+                                                strtab_size))) {
+            lprintf(error, "Corrupted LinkTable at index %u!\n", i);
+            return -1;
         }
-        tmp_link = link;
+    }
+    /* Relative URLs are resolved against the URL of the head link */
+    if (entries[0].url_off == LINKTABLE_DISK_NO_URL
+        || !entries[0].url_absolute) {
+        lprintf(error, "Invalid LinkTable head link!\n");
+        return -1;
+    }
+    return 0;
+}
 
-        PTHREAD_MUTEX_LOCK(&link_lock);
-        next_table = link->next_table;
-        if (next_table) {
-            next_table->refcount++;
-            next_table->orphaned = 0;
+/**
+ * \brief Map a LinkTable or LinkTree file into memory
+ * \details The mapping is private, so the strings can be modified in place
+ * without touching the file.
+ * \return the mapping with a single reference, or NULL on failure
+ */
+static struct LinkTableMap *LinkTableMap_new(int fd, size_t size)
+{
+    char *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        lprintf(error, "mmap(): %s\n", strerror(errno));
+        return NULL;
+    }
+    struct LinkTableMap *map = CALLOC(1, sizeof(struct LinkTableMap));
+    map->refcount = 1;
+    map->addr = addr;
+    map->size = size;
+    return map;
+}
+
+static void LinkTableMap_unref(struct LinkTableMap *map)
+{
+    if (map && atomic_fetch_sub(&map->refcount, 1) == 1) {
+        munmap(map->addr, map->size);
+        FREE(map);
+    }
+}
+
+/**
+ * \brief Create a LinkTable from a validated LinkTable file in a mapping
+ * \details The LinkTable takes a reference to the mapping.
+ */
+static LinkTable *LinkTable_disk_load(struct LinkTableMap *map, char *data)
+{
+    const LinkTableDiskHeader *header = (const LinkTableDiskHeader *)data;
+    LinkTableDiskEntry *entries
+        = (LinkTableDiskEntry *)(data + sizeof(LinkTableDiskHeader));
+    char *strtab = data + sizeof(LinkTableDiskHeader)
+                   + (size_t)header->n_links * sizeof(LinkTableDiskEntry);
+
+    LinkTable *linktbl = CALLOC(1, sizeof(LinkTable));
+    atomic_fetch_add(&map->refcount, 1);
+    linktbl->map = map;
+    linktbl->index_time = (time_t)header->index_time;
+    strncpy(linktbl->etag, strtab + header->etag_off,
+            LINKTABLE_VALIDATOR_LEN - 1);
+    strncpy(linktbl->last_modified, strtab + header->last_modified_off,
+            LINKTABLE_VALIDATOR_LEN - 1);
+
+    /* The Links are allocated in one go, their strings stay in the mapping */
+    int n_links = (int)header->n_links;
+    Link *links = LinkArena_alloc(linktbl, (size_t)n_links * sizeof(Link),
+                                  _Alignof(Link));
+    linktbl->links = CALLOC((size_t)n_links, sizeof(Link *));
+    linktbl->capacity = n_links;
+    for (int i = 0; i < n_links; i++) {
+        Link *link = &links[i];
+        link->parent_table = linktbl;
+        link->linkname = strtab + entries[i].name_off;
+        if (entries[i].url_off != LINKTABLE_DISK_NO_URL) {
+            link->url = strtab + entries[i].url_off;
         }
-        PTHREAD_MUTEX_UNLOCK(&link_lock);
+        link->url_absolute = entries[i].url_absolute != 0;
+        link->type = (LinkType)entries[i].type;
+        link->content_length = (size_t)entries[i].content_length;
+        link->time = (long)entries[i].time;
+        linktbl->links[i] = link;
     }
+    linktbl->size = n_links;
+    return linktbl;
+}
 
-    if (!next_table) {
-        LinkTable *new_table = NULL;
-        if (CONFIG.mode == NORMAL) {
-            new_table = LinkTable_new(tmp_link->f_url);
-        } else if (CONFIG.mode == SINGLE) {
-            new_table = single_LinkTable_new(tmp_link->f_url);
-        } else if (CONFIG.mode == SONIC) {
-            if (!CONFIG.sonic_id3) {
-                new_table = sonic_LinkTable_new_index(tmp_link->sonic.id);
-            } else {
-                new_table = sonic_LinkTable_new_id3(tmp_link->sonic.depth,
-                                                    tmp_link->sonic.id);
+LinkTable *LinkTable_disk_open(const char *dirn)
+{
+    char *metadirn = path_append(META_DIR, dirn);
+    char *path = path_append(metadirn, ".LinkTable");
+    FREE(metadirn);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        FREE(path);
+        return NULL;
+    }
+
+    struct stat st;
+    char magic[sizeof(((LinkTableDiskHeader *)0)->magic)];
+    if (fstat(fd, &st)
+        || pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)
+        || memcmp(magic, LINKTABLE_DISK_MAGIC, sizeof(magic))
+        || (size_t)st.st_size < sizeof(LinkTableDiskHeader)) {
+        close(fd);
+        LinkTable *linktbl = LinkTable_disk_open_v1(dirn, path);
+        if (linktbl) {
+            lprintf(debug, "Converting %s to the current format\n", path);
+            LinkTable_disk_save(linktbl, dirn);
+        }
+        FREE(path);
+        return linktbl;
+    }
+
+    struct LinkTableMap *map = LinkTableMap_new(fd, (size_t)st.st_size);
+    close(fd);
+    if (!map) {
+        FREE(path);
+        return NULL;
+    }
+    LinkTable *linktbl = NULL;
+    if (LinkTable_disk_validate(map->addr, map->size)) {
+        lprintf(error, "Deleting %s\n", path);
+        LinkTable_disk_delete(dirn);
+    } else {
+        linktbl = LinkTable_disk_load(map, map->addr);
+    }
+    LinkTableMap_unref(map);
+    FREE(path);
+    return linktbl;
+}
+
+/**
+ * \brief The magic number at the start of a LinkTree file
+ */
+#define LINKTREE_DISK_MAGIC "HDFS\x89TR\n"
+#define LINKTREE_DISK_VERSION 1
+/** \brief The parent of the root LinkTable in a LinkTree file */
+#define LINKTREE_DISK_NO_PARENT UINT32_MAX
+
+/**
+ * \brief The header of a LinkTree file
+ * \details A LinkTree file is a snapshot of the whole LinkTable tree. The
+ * header is followed by n_tables records, each followed by a LinkTable file
+ * padded to 8 bytes. A parent always comes before its children.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_tables;
+} LinkTreeDiskHeader;
+
+/**
+ * \brief A LinkTable in a LinkTree file
+ */
+typedef struct {
+    /** \brief The index of the parent LinkTable in the file */
+    uint32_t parent;
+    /** \brief The index of the parent Link in the parent LinkTable */
+    uint32_t parent_link;
+    /** \brief The size of the LinkTable file which follows */
+    uint64_t size;
+} LinkTreeDiskRecord;
+
+_Static_assert(sizeof(LinkTreeDiskHeader) == 16,
+               "LinkTreeDiskHeader must not have padding");
+_Static_assert(sizeof(LinkTreeDiskRecord) == 16,
+               "LinkTreeDiskRecord must not have padding");
+
+/** \brief Round a size up to the alignment of a LinkTree file */
+static size_t LinkTree_disk_align(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+static char *LinkTree_disk_path(void)
+{
+    return path_append(META_DIR, ".LinkTree");
+}
+
+int LinkTree_disk_save(void)
+{
+    if (!CACHE_SYSTEM_INIT || CONFIG.mode != NORMAL) {
+        return -1;
+    }
+
+    size_t buf_size = sizeof(LinkTreeDiskHeader);
+    size_t buf_capacity = 4096;
+    char *buf = CALLOC(buf_capacity, sizeof(char));
+    uint32_t n_tables = 0;
+
+    /*
+     * The tree is walked breadth first, so the parents are saved before their
+     * children. Nothing is attached or replaced while it is being walked.
+     */
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    if (!ROOT_LINK_TBL) {
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        FREE(buf);
+        return -1;
+    }
+    size_t queue_capacity = 64;
+    LinkTable **queue = CALLOC(queue_capacity, sizeof(LinkTable *));
+    LinkTreeDiskRecord *records
+        = CALLOC(queue_capacity, sizeof(LinkTreeDiskRecord));
+    queue[0] = ROOT_LINK_TBL;
+    records[0].parent = LINKTREE_DISK_NO_PARENT;
+    size_t n_queued = 1;
+    for (size_t i = 0; i < n_queued; i++) {
+        LinkTable *linktbl = queue[i];
+        size_t size;
+        char *table_buf = LinkTable_disk_serialise(linktbl, &size);
+        if (!table_buf) {
+            /* Its subdirectories are left out as well */
+            continue;
+        }
+        size_t record_size
+            = sizeof(LinkTreeDiskRecord) + LinkTree_disk_align(size);
+        if (buf_size + record_size > buf_capacity) {
+            while (buf_size + record_size > buf_capacity) {
+                buf_capacity *= 2;
             }
-        } else {
-            lprintf(fatal, "Invalid CONFIG.mode: %d\n", CONFIG.mode);
+            buf = REALLOC(buf, buf_capacity);
         }
+        records[i].size = size;
+        /* The parent is referred to by its index in the file */
+        memcpy(buf + buf_size, &records[i], sizeof(LinkTreeDiskRecord));
+        memset(buf + buf_size + sizeof(LinkTreeDiskRecord), 0,
+               record_size - sizeof(LinkTreeDiskRecord));
+        memcpy(buf + buf_size + sizeof(LinkTreeDiskRecord), table_buf, size);
+        FREE(table_buf);
+        buf_size += record_size;
+        uint32_t index = n_tables++;
+
+        for (int j = 1; j < linktbl->size; j++) {
+            if (!linktbl->links[j]->next_table) {
+                continue;
+            }
+            if (n_queued == queue_capacity) {
+                queue_capacity *= 2;
+                queue = (LinkTable **)REALLOC(
+                    (void *)queue, queue_capacity * sizeof(LinkTable *));
+                records = REALLOC(records,
+                                  queue_capacity * sizeof(LinkTreeDiskRecord));
+            }
+            queue[n_queued] = linktbl->links[j]->next_table;
+            records[n_queued].parent = index;
+            records[n_queued].parent_link = (uint32_t)j;
+            n_queued++;
+        }
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    FREE(queue);
+    FREE(records);
+
+    LinkTreeDiskHeader *header = (LinkTreeDiskHeader *)buf;
+    memcpy(header->magic, LINKTREE_DISK_MAGIC, sizeof(header->magic));
+    header->version = LINKTREE_DISK_VERSION;
+    header->n_tables = n_tables;
+
+    char *path = LinkTree_disk_path();
+    int res = disk_write_atomic(path, buf, buf_size);
+    lprintf(debug, "saved %u LinkTables to %s\n", n_tables, path);
+    FREE(path);
+    FREE(buf);
+    return res;
+}
+
+/**
+ * \brief Load the LinkTable tree from a LinkTree file
+ * \param[in] url the URL the root LinkTable must have
+ * \return the root LinkTable, or NULL if there is no usable LinkTree file
+ */
+static LinkTable *LinkTree_disk_open(const char *url)
+{
+    char *path = LinkTree_disk_path();
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        FREE(path);
+        return NULL;
+    }
+
+    struct stat st;
+    LinkTreeDiskHeader header;
+    if (fstat(fd, &st)
+        || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, LINKTREE_DISK_MAGIC, sizeof(header.magic))
+        || header.version != LINKTREE_DISK_VERSION || header.n_tables < 1) {
+        lprintf(error, "Invalid LinkTree file %s\n", path);
+        close(fd);
+        FREE(path);
+        return NULL;
+    }
+    struct LinkTableMap *map = LinkTableMap_new(fd, (size_t)st.st_size);
+    close(fd);
+    if (!map) {
+        FREE(path);
+        return NULL;
+    }
 
-        if (!new_table) {
-            if (link) {
-                LinkTable_unref(link->parent_table);
+    LinkTable **tables = CALLOC(header.n_tables, sizeof(LinkTable *));
+    size_t offset = sizeof(LinkTreeDiskHeader);
+    uint32_t i;
+    for (i = 0; i < header.n_tables; i++) {
+        if (map->size - offset < sizeof(LinkTreeDiskRecord)) {
+            break;
+        }
+        const LinkTreeDiskRecord *record
+            = (const LinkTreeDiskRecord *)(map->addr + offset);
+        offset += sizeof(LinkTreeDiskRecord);
+        if (record->size > map->size - offset
+            || LinkTable_disk_validate(map->addr + offset, record->size)) {
+            break;
+        }
+        LinkTable *linktbl = LinkTable_disk_load(map, map->addr + offset);
+        offset += LinkTree_disk_align(record->size);
+
+        if (i == 0) {
+            /* The cache directory may be shared with other URLs */
+            if (record->parent != LINKTREE_DISK_NO_PARENT
+                || strcmp(linktbl->links[0]->url, url)) {
+                LinkTable_free(linktbl);
+                break;
             }
-            return NULL;
+            tables[i] = linktbl;
+            continue;
         }
 
-        PTHREAD_MUTEX_LOCK(&link_lock);
-        if (!link->next_table) {
+        LinkTable *parent
+            = record->parent < i ? tables[record->parent] : NULL;
+        Link *link = NULL;
+        if (parent && record->parent_link >= 1
+            && record->parent_link < (uint32_t)parent->size) {
+            link = parent->links[record->parent_link];
+        }
+        if (!link || link->next_table
+            || (link->type != LINK_DIR
+                && link->type != LINK_UNINITIALISED_DIR)) {
+            LinkTable_free(linktbl);
+            break;
+        }
+        link->next_table = linktbl;
+        linktbl->parent_tbl = parent;
+        linktbl->parent_link = link;
+        parent->refcount++;
+        tables[i] = linktbl;
+    }
+    LinkTableMap_unref(map);
+
+    LinkTable *root = tables[0];
+    if (i < header.n_tables) {
+        lprintf(error, "Corrupted LinkTree file %s at LinkTable %u\n", path,
+                i);
+        /* This frees the LinkTables attached to the root as well */
+        LinkTable_free(root);
+        root = NULL;
+    } else {
+        lprintf(debug, "loaded %u LinkTables from %s\n", i, path);
+    }
+    FREE(tables);
+    FREE(path);
+    return root;
+}
+
+/**
+ * \brief State of the thread which saves the LinkTree file periodically
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int stop;
+} link_autosave = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                    .cond = PTHREAD_COND_INITIALIZER };
+
+static void *LinkTree_autosave_worker(void *arg)
+{
+    (void)arg;
+    PTHREAD_MUTEX_LOCK(&link_autosave.lock);
+    while (!link_autosave.stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CONFIG.snapshot_interval;
+        int res = 0;
+        while (!link_autosave.stop && res != ETIMEDOUT) {
+            res = pthread_cond_timedwait(&link_autosave.cond,
+                                         &link_autosave.lock, &deadline);
+        }
+        if (link_autosave.stop) {
+            break;
+        }
+        PTHREAD_MUTEX_UNLOCK(&link_autosave.lock);
+        LinkTree_disk_save();
+        PTHREAD_MUTEX_LOCK(&link_autosave.lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_autosave.lock);
+    return NULL;
+}
+
+void LinkTree_autosave_start(void)
+{
+    if (!CACHE_SYSTEM_INIT || CONFIG.mode != NORMAL
+        || CONFIG.snapshot_interval <= 0) {
+        return;
+    }
+    PTHREAD_MUTEX_LOCK(&link_autosave.lock);
+    if (!link_autosave.running) {
+        link_autosave.stop = 0;
+        int res = pthread_create(&link_autosave.thread, NULL,
+                                 LinkTree_autosave_worker, NULL);
+        if (res) {
+            lprintf(error, "pthread_create(): %s\n", strerror(res));
+        } else {
+            link_autosave.running = 1;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_autosave.lock);
+}
+
+void LinkTree_autosave_stop(void)
+{
+    PTHREAD_MUTEX_LOCK(&link_autosave.lock);
+    int running = link_autosave.running;
+    link_autosave.stop = 1;
+    link_autosave.running = 0;
+    PTHREAD_COND_BROADCAST(&link_autosave.cond);
+    PTHREAD_MUTEX_UNLOCK(&link_autosave.lock);
+    if (running) {
+        pthread_join(link_autosave.thread, NULL);
+    }
+    LinkTree_disk_save();
+}
+
+/**
+ * \brief A LinkTable which is being built, see LinkTable_build()
+ */
+typedef struct LinkTableBuild {
+    /** \brief The Link the LinkTable is built for */
+    Link *link;
+    /**
+     * \brief The result of the build, for the threads waiting for it
+     * \details A reference to it is taken for each of them.
+     */
+    LinkTable *table;
+    int done;
+    /** \brief The number of threads using this structure */
+    int refcount;
+    pthread_cond_t cond;
+    struct LinkTableBuild *next;
+} LinkTableBuild;
+
+/**
+ * \brief The LinkTables which are being built, protected by link_build_lock
+ */
+static LinkTableBuild *link_builds;
+static pthread_mutex_t link_build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Create the LinkTable of a directory Link, in the current mode
+ */
+static LinkTable *LinkTable_build_new(Link *link)
+{
+    LinkTable *new_table = NULL;
+    if (CONFIG.mode == NORMAL) {
+        char *url = Link_get_url(link);
+        new_table = LinkTable_new(url);
+        FREE(url);
+    } else if (CONFIG.mode == SINGLE) {
+        char *url = Link_get_url(link);
+        new_table = single_LinkTable_new(url);
+        FREE(url);
+    } else if (CONFIG.mode == SONIC) {
+        if (!CONFIG.sonic_id3) {
+            new_table = sonic_LinkTable_new_index(link->sonic.id);
+        } else {
+            new_table
+                = sonic_LinkTable_new_id3(link->sonic.depth, link->sonic.id);
+        }
+    } else if (CONFIG.mode == MANIFEST) {
+        /*
+         * All the directories were populated at mount time, so this is
+         * not a directory.
+         */
+    } else {
+        lprintf(fatal, "Invalid CONFIG.mode: %d\n", CONFIG.mode);
+    }
+    return new_table;
+}
+
+/**
+ * \brief Build the LinkTable of a directory Link and attach it to the tree
+ * \details If another thread is already building it, this waits for that
+ * thread rather than downloading the listing again.
+ * \note The caller must hold a reference to the parent table of the Link, and
+ * must not hold link_lock. link_build_lock is taken before link_lock, never
+ * the other way round.
+ * \return link->next_table with a reference for the caller, so it cannot be
+ * evicted before the caller uses it, or NULL if it cannot be built
+ */
+static LinkTable *LinkTable_build(Link *link)
+{
+    PTHREAD_MUTEX_LOCK(&link_build_lock);
+    LinkTableBuild *build = link_builds;
+    while (build && build->link != link) {
+        build = build->next;
+    }
+    if (build) {
+        build->refcount++;
+        while (!build->done) {
+            PTHREAD_COND_WAIT(&build->cond, &link_build_lock);
+        }
+        LinkTable *table = build->table;
+        if (--build->refcount == 0) {
+            PTHREAD_COND_DESTROY(&build->cond);
+            FREE(build);
+        }
+        PTHREAD_MUTEX_UNLOCK(&link_build_lock);
+        return table;
+    }
+    /*
+     * A build is attached before it is removed from link_builds, so a build
+     * which has just finished is seen here.
+     */
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    LinkTable *attached = link->next_table;
+    if (attached) {
+        attached->refcount++;
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    if (attached) {
+        PTHREAD_MUTEX_UNLOCK(&link_build_lock);
+        return attached;
+    }
+    build = CALLOC(1, sizeof(LinkTableBuild));
+    build->link = link;
+    build->refcount = 1;
+    PTHREAD_COND_INIT(&build->cond, NULL);
+    build->next = link_builds;
+    link_builds = build;
+    PTHREAD_MUTEX_UNLOCK(&link_build_lock);
+
+    LinkTable *new_table = LinkTable_build_new(link);
+    LinkTable *table = NULL;
+    if (new_table) {
+        PTHREAD_RWLOCK_WRLOCK(&link_lock);
+        table = link->next_table;
+        if (!table) {
+            table = new_table;
             link->next_table = new_table;
             new_table->parent_tbl = link->parent_table;
             new_table->parent_link = link;
             if (new_table->parent_tbl) {
                 new_table->parent_tbl->refcount++;
             }
-            new_table->refcount++;
             new_table->orphaned = 0;
-            next_table = new_table;
+            LinkTable_resident_add(new_table);
+        }
+        table->refcount++;
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        if (table == new_table) {
+            LinkTable_fill_start(new_table);
         } else {
+            /* Another LinkTable has been attached in the meantime */
             LinkTable_free(new_table);
-            next_table = link->next_table;
-            next_table->refcount++;
-            next_table->orphaned = 0;
         }
-        PTHREAD_MUTEX_UNLOCK(&link_lock);
+    }
+
+    PTHREAD_MUTEX_LOCK(&link_build_lock);
+    LinkTableBuild **prev = &link_builds;
+    while (*prev != build) {
+        prev = &(*prev)->next;
+    }
+    *prev = build->next;
+    build->table = table;
+    if (table) {
+        /* Our own reference keeps it alive in the meantime */
+        table->refcount += build->refcount - 1;
+    }
+    build->done = 1;
+    PTHREAD_COND_BROADCAST(&build->cond);
+    if (--build->refcount == 0) {
+        PTHREAD_COND_DESTROY(&build->cond);
+        FREE(build);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_build_lock);
+
+    if (table == new_table) {
+        LinkTable_evict();
+    }
+    return table;
+}
 
-        if (CONFIG.invalid_refresh) {
-            LinkTable_uninitialised_fill(next_table);
+LinkTable *path_to_LinkTable(const char *path)
+{
+    if (!strcmp(path, "/")) {
+        PTHREAD_RWLOCK_RDLOCK(&link_lock);
+        LinkTable *next_table = ROOT_LINK_TBL;
+        next_table->refcount++;
+        next_table->orphaned = 0;
+        LinkTable_touch(next_table);
+        LinkTable_revalidate(next_table);
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        if (LinkTable_probe_due(next_table)) {
+            LinkTable_fill_start(next_table);
         }
+        return next_table;
     }
 
-    if (link) {
-        LinkTable_unref(link->parent_table);
+    Link *link = path_to_Link(path);
+    if (!link) {
+        return NULL;
+    }
+    LinkTable *next_table = Link_to_LinkTable(link);
+    LinkTable_unref(link->parent_table);
+    return next_table;
+}
+
+LinkTable *Link_to_LinkTable(Link *link)
+{
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    LinkTable *next_table = link->next_table;
+    if (next_table) {
+        next_table->refcount++;
+        next_table->orphaned = 0;
+        LinkTable_touch(next_table);
+        LinkTable_revalidate(next_table);
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+
+    if (!next_table) {
+        next_table = LinkTable_build(link);
+        if (next_table) {
+            PTHREAD_RWLOCK_RDLOCK(&link_lock);
+            next_table->orphaned = 0;
+            LinkTable_revalidate(next_table);
+            PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        }
+    }
+
+    /* The invalid links are stat'ed again in the background */
+    if (next_table && LinkTable_probe_due(next_table)) {
+        LinkTable_fill_start(next_table);
     }
 
     return next_table;
 }
 
+Link *LinkTable_find(LinkTable *linktbl, const char *linkname)
+{
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    LinkTable_touch(linktbl);
+    LinkTable_revalidate(linktbl);
+    Link *link = LinkTable_lookup(linktbl, linkname);
+    if (link) {
+        link->parent_table->refcount++;
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    return link;
+}
+
+char *Link_get_path(const Link *link)
+{
+    char *path = CALLOC(PATH_MAX, sizeof(char));
+    size_t start = PATH_MAX - 1;
+
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    while (link) {
+        size_t len = strnlen(link->linkname, NAME_MAX);
+        if (len + 1 > start) {
+            break;
+        }
+        start -= len;
+        memcpy(path + start, link->linkname, len);
+        path[--start] = '/';
+        LinkTable *linktbl = link->parent_table;
+        if (linktbl == ROOT_LINK_TBL) {
+            PTHREAD_RWLOCK_UNLOCK(&link_lock);
+            memmove(path, path + start, PATH_MAX - start);
+            return path;
+        }
+        link = linktbl ? linktbl->parent_link : NULL;
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    FREE(path);
+    return NULL;
+}
+
+/**
+ * \brief Look up a path relative to a LinkTable
+ * \details A reference to the LinkTable of each level is held while the next
+ * level is looked up, so link_lock is only held within a level, and it is not
+ * held while a missing LinkTable is built.
+ * \param[in] linktbl the LinkTable, the reference to it held by the caller is
+ * handed over
+ * \return the Link with a reference to its parent table, or NULL
+ */
 static Link *path_to_Link_recursive(char *path, LinkTable *linktbl)
 {
-    if (!linktbl || !path || path[0] == '\0') {
+    if (!linktbl) {
+        return NULL;
+    }
+    if (!path || path[0] == '\0') {
+        LinkTable_unref(linktbl);
         return NULL;
     }
 
@@ -1583,135 +3811,250 @@ static Link *path_to_Link_recursive(char *path, LinkTable *linktbl)
         }
     }
 
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    LinkTable_touch(linktbl);
+    LinkTable_revalidate(linktbl);
+
     char *slash = strchr(path, '/');
     if (slash == NULL) {
         /*
          * We cannot find another '/', we have reached the last level
          */
-        for (int i = 1; i < linktbl->size; i++) {
-            if (!strncmp(path, linktbl->links[i]->linkname, NAME_MAX)) {
-                /*
-                 * We found our link
-                 */
-                return linktbl->links[i];
-            }
+        Link *link = LinkTable_lookup(linktbl, path);
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        if (!link) {
+            LinkTable_unref(linktbl);
         }
-    } else {
-        /*
-         * We can still find '/', time to consume the path and traverse
-         * the tree structure
-         */
+        return link;
+    }
 
-        /*
-         * add termination mark to the current string,
-         * effective create two substrings
-         */
-        *slash = '\0';
-        /*
-         * move the pointer past the '/'
-         */
-        char *next_path = slash + 1;
-        for (int i = 1; i < linktbl->size; i++) {
-            if (!strncmp(path, linktbl->links[i]->linkname, NAME_MAX)) {
-                /*
-                 * The next sub-directory exists
-                 */
-                LinkTable *next_table = linktbl->links[i]->next_table;
-                if (!next_table) {
-                    linktbl->refcount++;
-                    PTHREAD_MUTEX_UNLOCK(&link_lock);
-                    LinkTable *new_table = NULL;
-                    if (CONFIG.mode == NORMAL) {
-                        new_table = LinkTable_new(linktbl->links[i]->f_url);
-                    } else if (CONFIG.mode == SONIC) {
-                        if (!CONFIG.sonic_id3) {
-                            new_table = sonic_LinkTable_new_index(
-                                linktbl->links[i]->sonic.id);
-                        } else {
-                            new_table = sonic_LinkTable_new_id3(
-                                linktbl->links[i]->sonic.depth,
-                                linktbl->links[i]->sonic.id);
-                        }
-                    } else {
-                        lprintf(fatal, "Invalid CONFIG.mode\n");
-                    }
+    /*
+     * We can still find '/', time to consume the path and traverse the tree
+     * structure
+     */
 
-                    if (!new_table) {
-                        PTHREAD_MUTEX_LOCK(&link_lock);
-                        linktbl->refcount--;
-                        if (linktbl->refcount == 0 && linktbl->orphaned) {
-                            LinkTable *parent = linktbl->parent_tbl;
-                            Link *parent_link = linktbl->parent_link;
-                            if (parent_link) {
-                                parent_link->next_table = NULL;
-                            }
-                            PTHREAD_MUTEX_UNLOCK(&link_lock);
-                            LinkTable_free(linktbl);
-                            if (parent) {
-                                LinkTable_unref(parent);
-                            }
-                            PTHREAD_MUTEX_LOCK(&link_lock);
-                        }
-                        return NULL;
-                    }
+    /*
+     * add termination mark to the current string,
+     * effective create two substrings
+     */
+    *slash = '\0';
+    /*
+     * move the pointer past the '/'
+     */
+    char *next_path = slash + 1;
+    Link *dir_link = LinkTable_lookup(linktbl, path);
+    LinkTable *next_table = dir_link ? dir_link->next_table : NULL;
+    if (next_table) {
+        next_table->refcount++;
+    }
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
 
-                    PTHREAD_MUTEX_LOCK(&link_lock);
-                    if (!linktbl->links[i]->next_table) {
-                        linktbl->links[i]->next_table = new_table;
-                        new_table->parent_tbl = linktbl;
-                        new_table->parent_link = linktbl->links[i];
-                        linktbl->refcount++;
-                        next_table = new_table;
-                    } else {
-                        LinkTable_free(new_table);
-                        next_table = linktbl->links[i]->next_table;
-                    }
-                    linktbl->refcount--;
-                }
-                return path_to_Link_recursive(next_path, next_table);
-            }
+    /* The next sub-directory exists, but it has not been listed yet */
+    if (dir_link && !next_table) {
+        next_table = LinkTable_build(dir_link);
+    }
+    LinkTable_unref(linktbl);
+    return path_to_Link_recursive(next_path, next_table);
+}
+
+/**
+ * \brief The number of entries in the path cache, must be a power of two
+ */
+#define PATH_CACHE_SIZE 4096
+
+/**
+ * \brief An entry of the path cache, which maps a full path to its Link
+ * \details The entries are updated by threads holding link_lock for reading,
+ * so each of them is protected by a sequence lock. A writer makes seq odd
+ * while it updates the entry. A reader which sees seq change treats the
+ * lookup as a miss.
+ */
+typedef struct {
+    /** \brief The sequence counter, odd while the entry is being updated */
+    atomic_uint seq;
+    /** \brief The hash of the path */
+    _Atomic uint64_t hash;
+    /** \brief The value of link_generation when the entry was added */
+    atomic_ulong generation;
+    /** \brief The Link of the path */
+    _Atomic(Link *) link;
+} PathCacheEntry;
+
+/**
+ * \brief Direct-mapped cache of path_to_Link() results
+ */
+static PathCacheEntry path_cache[PATH_CACHE_SIZE];
+
+static uint64_t path_hash(const char *path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = path; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * \brief Check that a path leads to a Link
+ * \details This walks from the Link up to the root LinkTable, matching the
+ * link names against the components of the path from the end.
+ * \note The caller must hold link_lock.
+ */
+static int Link_has_path(const Link *link, const char *path)
+{
+    size_t end = strnlen(path, PATH_MAX);
+    if (end > 1 && path[end - 1] == '/') {
+        end--;
+    }
+    while (link) {
+        size_t len = strnlen(link->linkname, NAME_MAX);
+        if (len + 1 > end || strncmp(path + end - len, link->linkname, len)
+            || path[end - len - 1] != '/') {
+            return 0;
+        }
+        end -= len + 1;
+        LinkTable *linktbl = link->parent_table;
+        if (linktbl == ROOT_LINK_TBL) {
+            return end == 0;
         }
+        link = linktbl ? linktbl->parent_link : NULL;
+    }
+    return 0;
+}
+
+/**
+ * \brief Look up a path in the path cache
+ * \note The caller must hold link_lock, for reading is enough.
+ */
+static Link *PathCache_lookup(const char *path, uint64_t hash)
+{
+    PathCacheEntry *entry = &path_cache[hash & (PATH_CACHE_SIZE - 1)];
+    unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+    if (seq & 1) {
+        return NULL;
+    }
+    uint64_t entry_hash
+        = atomic_load_explicit(&entry->hash, memory_order_relaxed);
+    unsigned long generation
+        = atomic_load_explicit(&entry->generation, memory_order_relaxed);
+    Link *link = atomic_load_explicit(&entry->link, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) {
+        return NULL;
+    }
+
+    /*
+     * If the generation has not moved on, no LinkTable has been freed since
+     * the entry was added, so the Link can be dereferenced.
+     */
+    if (link && entry_hash == hash
+        && generation == atomic_load(&link_generation)
+        && Link_has_path(link, path)) {
+        return link;
     }
     return NULL;
 }
 
+/**
+ * \brief Add the Link of a path to the path cache
+ * \param[in] generation the value of link_generation before the Link was
+ * looked up
+ * \note The caller must hold link_lock, for reading is enough. If another
+ * thread is updating the same entry, the Link is not added.
+ */
+static void PathCache_insert(uint64_t hash, unsigned long generation,
+                             Link *link)
+{
+    PathCacheEntry *entry = &path_cache[hash & (PATH_CACHE_SIZE - 1)];
+    unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    if ((seq & 1)
+        || !atomic_compare_exchange_strong(&entry->seq, &seq, seq + 1)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&entry->hash, hash, memory_order_relaxed);
+    atomic_store_explicit(&entry->generation, generation,
+                          memory_order_relaxed);
+    atomic_store_explicit(&entry->link, link, memory_order_relaxed);
+    atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+}
+
+void LinkSystem_cleanup(void)
+{
+    /* The fill threads hold Links which are about to be freed */
+    PTHREAD_MUTEX_LOCK(&link_fill_lock);
+    while (link_fills) {
+        PTHREAD_COND_WAIT(&link_fill_cond, &link_fill_lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&link_fill_lock);
+
+    PTHREAD_RWLOCK_WRLOCK(&link_lock);
+    LinkTable *root = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = NULL;
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+    if (link_residency.evictions) {
+        lprintf(info, "%zu bytes of LinkTables resident, %lu evicted\n",
+                (size_t)link_residency.bytes,
+                (unsigned long)link_residency.evictions);
+    }
+    /* This also invalidates the whole path cache */
+    LinkTable_free(root);
+}
+
 Link *path_to_Link(const char *path)
 {
     lprintf(link_lock_debug, "thread %lx: locking link_lock;\n",
             (unsigned long)pthread_self());
 
-    PTHREAD_MUTEX_LOCK(&link_lock);
+    uint64_t hash = path_hash(path);
+    PTHREAD_RWLOCK_RDLOCK(&link_lock);
+    Link *link = PathCache_lookup(path, hash);
+    if (link) {
+        LinkTable_touch(link->parent_table);
+        LinkTable_revalidate(link->parent_table);
+        if (link->parent_table) {
+            link->parent_table->refcount++;
+        }
+        lprintf(link_lock_debug, "thread %lx: unlocking link_lock;\n",
+                (unsigned long)pthread_self());
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
+        return link;
+    }
+    unsigned long generation = atomic_load(&link_generation);
+    LinkTable *root = ROOT_LINK_TBL;
+    if (root) {
+        root->refcount++;
+    }
+    lprintf(link_lock_debug, "thread %lx: unlocking link_lock;\n",
+            (unsigned long)pthread_self());
+    PTHREAD_RWLOCK_UNLOCK(&link_lock);
+
     char *new_path = STRNDUP(path, PATH_MAX);
     if (!new_path) {
         lprintf(fatal, "cannot allocate memory\n");
     }
-    Link *link = path_to_Link_recursive(new_path, ROOT_LINK_TBL);
+    link = path_to_Link_recursive(new_path, root);
     FREE(new_path);
-
-    if (link && link->parent_table) {
-        link->parent_table->refcount++;
+    if (link) {
+        /* The reference to its parent table keeps the Link alive */
+        PTHREAD_RWLOCK_RDLOCK(&link_lock);
+        PathCache_insert(hash, generation, link);
+        PTHREAD_RWLOCK_UNLOCK(&link_lock);
     }
-
-    lprintf(link_lock_debug, "thread %lx: unlocking link_lock;\n",
-            (unsigned long)pthread_self());
-    PTHREAD_MUTEX_UNLOCK(&link_lock);
     return link;
 }
 
-TransferStruct Link_download_full(Link *link)
+/**
+ * \brief Perform a download, retrying on temporary HTTP failures
+ * \details The write callback has to be set up by the caller. The curl handle
+ * is cleaned up before this function returns.
+ * \return the HTTP response code of the final attempt
+ */
+static long Link_download_perform(Link *link, CURL *curl, TransferStruct *ts)
 {
-    char *url = link->f_url;
-    CURL *curl = Link_to_curl(link);
-
-    TransferStruct ts = {0};
-    ts.type = DATA;
-    ts.transferring = 1;
-
-    CURLcode ret = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&ts);
-    if (ret) {
-        lprintf(error, "%s\n", curl_easy_strerror(ret));
-    }
-    ret = curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)&ts);
+    char *url = Link_get_url(link);
+    CURLcode ret = curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)ts);
     if (ret) {
         lprintf(error, "%s\n", curl_easy_strerror(ret));
     }
@@ -1725,9 +4068,9 @@ TransferStruct Link_download_full(Link *link)
          * Reset the transfer struct for each attempt to avoid accumulating
          * data from failed/partial attempts.
          */
-        FREE(ts.data);
-        ts.curr_size = 0;
-        ts.transferring = 1;
+        FREE(ts->data);
+        ts->curr_size = 0;
+        ts->transferring = 1;
 
         transfer_blocking(curl);
         ret = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_resp);
@@ -1738,13 +4081,14 @@ TransferStruct Link_download_full(Link *link)
             lprintf(warning, "URL: %s, HTTP %ld, retrying later.\n", url,
                     http_resp);
             sleep(CONFIG.http_wait_sec);
+        } else if (http_resp == HTTP_NOT_MODIFIED) {
+            lprintf(debug, "URL: %s, HTTP %ld\n", url, http_resp);
         } else if (http_resp != HTTP_OK) {
             lprintf(warning, "cannot retrieve URL: %s, HTTP %ld\n", url,
                     http_resp);
-            ts.curr_size = 0;
-            free(ts.data); /* not FREE(); can be NULL on error path! */
             curl_easy_cleanup(curl);
-            return ts;
+            FREE(url);
+            return http_resp;
         }
     } while (HTTP_temp_failure(http_resp));
 
@@ -1753,9 +4097,167 @@ TransferStruct Link_download_full(Link *link)
         lprintf(error, "%s\n", curl_easy_strerror(ret));
     }
     curl_easy_cleanup(curl);
+    FREE(url);
+    return http_resp;
+}
+
+TransferStruct Link_download_full(Link *link)
+{
+    CURL *curl = Link_to_curl(link);
+
+    TransferStruct ts = {0};
+    ts.type = DATA;
+
+    CURLcode ret = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&ts);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+
+    if (Link_download_perform(link, curl, &ts) != HTTP_OK) {
+        ts.curr_size = 0;
+        FREE(ts.data);
+    }
     return ts;
 }
 
+/**
+ * \brief Copy the value of a header into a validator if the header name
+ * matches
+ */
+static void listing_header_value(const char *buffer, size_t len,
+                                 const char *name, char *value)
+{
+    size_t name_len = strlen(name);
+    if (len <= name_len || buffer[name_len] != ':'
+        || strncasecmp(buffer, name, name_len)) {
+        return;
+    }
+    const char *start = buffer + name_len + 1;
+    const char *end = buffer + len;
+    while (start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    /* A validator which does not fit cannot be sent back correctly */
+    size_t value_len = (size_t)(end - start);
+    if (value_len < LINKTABLE_VALIDATOR_LEN) {
+        memcpy(value, start, value_len);
+        value[value_len] = '\0';
+    }
+}
+
+/**
+ * \brief Record the ETag and Last-Modified headers of a directory listing
+ */
+static size_t listing_header_callback(char *buffer, size_t size, size_t nitems,
+                                      void *userdata)
+{
+    LinkTable *linktbl = userdata;
+    size_t len = size * nitems;
+    if (len >= 5 && !strncasecmp(buffer, "HTTP/", 5)) {
+        /*
+         * This is the status line of a new response, e.g. after a redirect
+         * or a retry.
+         */
+        linktbl->etag[0] = '\0';
+        linktbl->last_modified[0] = '\0';
+    } else {
+        listing_header_value(buffer, len, "ETag", linktbl->etag);
+        listing_header_value(buffer, len, "Last-Modified",
+                             linktbl->last_modified);
+    }
+    return len;
+}
+
+/**
+ * \brief Build the request headers for a conditional listing download
+ * \return the header list, or NULL if stale has no validators
+ */
+static struct curl_slist *LinkTable_conditional_headers(const LinkTable *stale)
+{
+    if (!stale || (!stale->etag[0] && !stale->last_modified[0])) {
+        return NULL;
+    }
+
+    /* This replaces the --http-header list set by Link_to_curl() */
+    struct curl_slist *headers = NULL;
+    if (is_same_origin(stale->links[0]->url)) {
+        for (struct curl_slist *h = CONFIG.http_headers; h; h = h->next) {
+            headers = curl_slist_append(headers, h->data);
+        }
+    }
+
+    char buf[LINKTABLE_VALIDATOR_LEN + 32];
+    if (stale->etag[0]) {
+        snprintf(buf, sizeof(buf), "If-None-Match: %s", stale->etag);
+        headers = curl_slist_append(headers, buf);
+    }
+    if (stale->last_modified[0]) {
+        snprintf(buf, sizeof(buf), "If-Modified-Since: %s",
+                 stale->last_modified);
+        headers = curl_slist_append(headers, buf);
+    }
+    return headers;
+}
+
+/**
+ * \brief Download a directory listing, and parse it as it arrives
+ * \param[in] stale the previous version of the listing, if there is one. Its
+ * ETag and Last-Modified headers are used to make a conditional request.
+ * \return 0 on success, 1 if stale has not been modified, -1 on failure
+ */
+static int LinkTable_download(LinkTable *linktbl, const char *url,
+                              const LinkTable *stale)
+{
+    ListingParser lp;
+    ListingParser_init(&lp, linktbl, url);
+
+    CURL *curl = Link_to_curl(linktbl->links[0]);
+    CURLcode ret
+        = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, listing_write_callback);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    ret = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&lp);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    ret = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,
+                           listing_header_callback);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    ret = curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)linktbl);
+    if (ret) {
+        lprintf(error, "%s\n", curl_easy_strerror(ret));
+    }
+    struct curl_slist *headers = LinkTable_conditional_headers(stale);
+    int conditional = headers != NULL;
+    if (headers) {
+        ret = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        if (ret) {
+            lprintf(error, "%s\n", curl_easy_strerror(ret));
+        }
+    }
+    lp.curl = curl;
+
+    TransferStruct ts = {0};
+    ts.type = DATA;
+    long http_resp = Link_download_perform(linktbl->links[0], curl, &ts);
+    curl_slist_free_all(headers);
+
+    int res = -1;
+    if (http_resp == HTTP_NOT_MODIFIED && conditional) {
+        res = 1;
+    } else if (http_resp == HTTP_OK && lp.received > 0) {
+        res = 0;
+    }
+    ListingParser_cleanup(&lp);
+    return res;
+}
+
 static CURL *Link_download_curl_setup(Link *link, size_t req_size, off_t offset,
                                       TransferStruct *header,
                                       TransferStruct *ts)
@@ -1941,22 +4443,98 @@ long Link_download(Link *link, char *output_buf, size_t req_size, off_t offset,
     return recv_sz;
 }
 
-long path_download(const char *path, char *output_buf, size_t req_size,
-                   off_t offset)
+/** \brief A download started by Link_download_async() */
+typedef struct {
+    /**
+     * \brief The transfer
+     * \details It is the first member, so the done callback can cast it back
+     * to its AsyncDownload.
+     */
+    TransferStruct ts;
+    /** \brief The response header */
+    TransferStruct header;
+    /** \brief The curl handle of the current attempt */
+    CURL *curl;
+    /** \brief The Link being downloaded */
+    Link *link;
+    /** \brief The requested size */
+    size_t req_size;
+    /** \brief The requested offset */
+    off_t offset;
+    /** \brief Called once the download has ended */
+    LinkDownloadCallback callback;
+    /** \brief The pointer passed to the callback */
+    void *userdata;
+} AsyncDownload;
+
+static void AsyncDownload_done(TransferStruct *ts);
+
+static void AsyncDownload_start(AsyncDownload *dl)
+{
+    memset(&dl->ts, 0, sizeof(dl->ts));
+    dl->ts.type = DATA;
+    dl->ts.transferring = 1;
+    dl->ts.done = AsyncDownload_done;
+    memset(&dl->header, 0, sizeof(dl->header));
+    dl->curl = Link_download_curl_setup(dl->link, dl->req_size, dl->offset,
+                                        &dl->header, &dl->ts);
+    transfer_async(dl->curl);
+}
+
+/** \brief Retry a download deferred by AsyncDownload_done() */
+static void AsyncDownload_retry(TransferStruct *ts)
+{
+    AsyncDownload_start((AsyncDownload *)ts);
+}
+
+/**
+ * \brief Finish a download started by Link_download_async()
+ * \details This runs on the network thread, so a retry is deferred rather
+ * than waited for, which would hold back the other asynchronous downloads.
+ */
+static void AsyncDownload_done(TransferStruct *ts)
+{
+    AsyncDownload *dl = (AsyncDownload *)ts;
+    curl_off_t recv_sz = Link_download_cleanup(dl->curl, &dl->header);
+
+    if (recv_sz == -EAGAIN) {
+        lprintf(warning, "HTTP temporary failure, retrying...\n");
+    } else if (recv_sz >= 0 && recv_sz != (curl_off_t)dl->req_size) {
+        lprintf(error,
+                "req_size != recv, req_size: %lu, recv: %ld, retrying...\n",
+                dl->req_size, recv_sz);
+    } else {
+        dl->callback(ts->data, recv_sz, dl->userdata);
+        FREE(ts->data);
+        FREE(dl);
+        return;
+    }
+    FREE(ts->data);
+    ts->done = AsyncDownload_retry;
+    transfer_async_defer(ts, CONFIG.http_wait_sec);
+}
+
+void Link_download_async(Link *link, size_t req_size, off_t offset,
+                         LinkDownloadCallback callback, void *userdata)
 {
-    if (!path) {
-        lprintf(fatal, "NULL path supplied\n");
+    if (req_size == 0 || link->content_length == 0 || offset < 0
+        || (size_t)offset >= link->content_length) {
+        callback(NULL, 0, userdata);
+        return;
     }
 
-    Link *link;
-    link = path_to_Link(path);
-    if (!link) {
-        return -ENOENT;
+    size_t remaining = link->content_length - (size_t)offset;
+    if (req_size > remaining) {
+        req_size = remaining;
     }
 
-    long res = Link_download(link, output_buf, req_size, offset, NULL);
-    LinkTable_unref(link->parent_table);
-    return res;
+    AsyncDownload *dl = CALLOC(1, sizeof(AsyncDownload));
+    dl->link = link;
+    dl->req_size = req_size;
+    dl->offset = offset;
+    dl->callback = callback;
+    dl->userdata = userdata;
+    AsyncDownload_start(dl);
 }
 
 static void make_link_relative(const char *page_url, char *link_url)
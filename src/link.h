@@ -31,6 +31,7 @@
 
 #include <curl/curl.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 
 #include "memcache.h"
@@ -53,18 +54,73 @@ typedef enum {
     LINK_UNINITIALISED_DIR = 'V',
 } LinkType;
 
+/**
+ * \brief the maximum length of the ETag and Last-Modified of a listing
+ */
+#define LINKTABLE_VALIDATOR_LEN 256
+
 /**
  * \brief link table type
  * \details index 0 contains the Link for the base URL
+ * \note The structure of the tree (next_table, parent_tbl, parent_link) is
+ * protected by link_lock in link.c. Lookups only take it for reading, so the
+ * fields they update are atomic.
  */
 struct LinkTable {
     int size;
     time_t index_time;
+    /**
+     * \brief The entries, see LinkTable_entries()
+     * \details A refresh swaps in a new array, see LinkTable_replace().
+     */
     Link **links;
-    int refcount;
-    int orphaned;
+    atomic_int refcount;
+    atomic_int orphaned;
     struct LinkTable *parent_tbl;
     Link *parent_link;
+    /** \brief Set while a background refresh of this table is running */
+    atomic_int refreshing;
+    /** \brief Set while the entries are stat'ed in the background */
+    atomic_int filling;
+    /**
+     * \brief The earliest time an invalid entry is stat'ed again, see
+     * LinkTable_probe_due() in link.c
+     */
+    _Atomic(time_t) probe_time;
+    /** \brief The ETag header of the directory listing */
+    char etag[LINKTABLE_VALIDATOR_LEN];
+    /** \brief The Last-Modified header of the directory listing */
+    char last_modified[LINKTABLE_VALIDATOR_LEN];
+    /** \brief Hash index of the Links by linkname, see LinkTable_lookup() */
+    _Atomic(struct LinkIndex *) index;
+    /** \brief The number of Links the links array has room for */
+    int capacity;
+    /**
+     * \brief The links arrays a refresh has swapped out
+     * \details Readers may still be walking them, so they are only freed
+     * with the LinkTable.
+     */
+    struct LinkRetired *retired;
+    /**
+     * \brief The memory the Links and their strings are allocated from
+     * \details It is only freed with the LinkTable.
+     */
+    struct LinkArena *arena;
+    /**
+     * \brief The mapping of the file this table was loaded from
+     * \details The strings of the Links point into it.
+     */
+    struct LinkTableMap *map;
+    /**
+     * \brief The heap memory of this table counted as resident, 0 if it is
+     * not part of the tree
+     */
+    size_t resident_size;
+    /** \brief Set when the table is used, see LinkTable_evict() in link.c */
+    atomic_int accessed;
+    /** \brief The list of resident LinkTables, see link_residency in link.c */
+    struct LinkTable *resident_prev;
+    struct LinkTable *resident_next;
 };
 
 /**
@@ -74,21 +130,42 @@ struct Link {
     /** \brief The parent LinkTable of this link */
     struct LinkTable *parent_table;
     /** \brief The link name in the last level of the URL */
-    char linkname[NAME_MAX + 1];
-    /** \brief This is for storing the unescaped path */
-    char linkpath[NAME_MAX + 1];
-    /** \brief The full URL of the file */
-    char f_url[PATH_MAX + 1];
-    /** \brief The type of the link */
-    LinkType type;
+    char *linkname;
+    /**
+     * \brief The URL of the link, see Link_get_url()
+     * \details Unless url_absolute is set, this is relative to the URL of the
+     * parent LinkTable. It is NULL until the URL is set.
+     */
+    char *url;
+    /** \brief Whether url is a full URL */
+    int url_absolute;
+    /**
+     * \brief The type of the link
+     * \details The entries of a LinkTable are stat'ed while it is served, so
+     * this is updated by other threads until it is initialised.
+     */
+    _Atomic(LinkType) type;
     /** \brief CURLINFO_CONTENT_LENGTH_DOWNLOAD of the file */
     size_t content_length;
     /** \brief The next LinkTable level, if it is a LINK_DIR */
     LinkTable *next_table;
     /** \brief CURLINFO_FILETIME obtained from the server */
     long time;
+    /** \brief The number of times in a row this link failed to be stat'ed */
+    int probe_failures;
+    /** \brief The earliest time an invalid link is stat'ed again */
+    time_t probe_time;
     /** \brief The pointer associated with the cache file */
     Cache *cache_ptr;
+    /** \brief content_length when the file was last opened */
+    size_t open_content_length;
+    /** \brief time when the file was last opened */
+    long open_time;
+    /**
+     * \brief Set when a refresh has kept the size and time of the file
+     * without stat'ing it again, see Link_restat()
+     */
+    atomic_int restat;
     /** \brief Stores *sonic related data */
     Sonic sonic;
 };
@@ -108,22 +185,119 @@ extern int ROOT_LINK_OFFSET;
  */
 LinkTable *LinkSystem_init(const char *raw_url);
 
+/**
+ * \brief Start stat'ing the entries of the root LinkTable in the background
+ * \details This starts a thread, so it has to be called after the process
+ * has daemonised.
+ */
+void LinkSystem_fill_start(void);
+
+/**
+ * \brief free the link sub-system, including the whole LinkTable tree
+ */
+void LinkSystem_cleanup(void);
+
+/**
+ * \brief The heap memory used by the LinkTables in the tree, in bytes
+ */
+size_t LinkSystem_resident_bytes(void);
+
+/**
+ * \brief The number of LinkTables evicted to stay within
+ * CONFIG.dir_mem_limit
+ */
+unsigned long LinkSystem_evictions(void);
+
+/**
+ * \brief The entries of a LinkTable which a refresh has changed
+ */
+typedef struct {
+    /** \brief The entries which have appeared in the listing */
+    Link **added;
+    int n_added;
+    /**
+     * \brief The entries which have disappeared from the listing
+     * \details Their Links stay valid as long as the LinkTable does.
+     */
+    Link **removed;
+    int n_removed;
+    /** \brief The entries whose type, size or time have changed */
+    Link **changed;
+    int n_changed;
+} LinkTableDiff;
+
+/**
+ * \brief Called once a refreshed listing has been merged into a LinkTable
+ * \param[in] dir_link the Link of the directory, or NULL for the root
+ * \param[in] linktbl the LinkTable, which has been refreshed
+ * \param[in] diff the entries the refresh has changed
+ * \details It is called without link_lock held.
+ */
+typedef void (*LinkReplaceCallback)(Link *dir_link, LinkTable *linktbl,
+                                    const LinkTableDiff *diff);
+
+/**
+ * \brief Set the function called whenever a LinkTable is refreshed
+ * \details It waits for the calls of the previous function which are still
+ * running, so once it returns, the previous function is no longer used. It
+ * must not be called from the function itself.
+ */
+void LinkSystem_on_replace(LinkReplaceCallback callback);
+
+/**
+ * \brief Stat a file again if a refresh has kept its size and time
+ * \details A HTML listing does not have the sizes and times of its files, so
+ * a refresh keeps the ones its entries were stat'ed with. Rather than every
+ * file being stat'ed on every refresh, a file is stat'ed again when it is
+ * next opened, before its cache file is checked against it.
+ */
+void Link_restat(Link *link);
+
+/**
+ * \brief Get the full URL of a Link
+ * \note The caller must free the returned string with FREE().
+ */
+char *Link_get_url(const Link *link);
+
+/**
+ * \brief Set the full URL of a Link
+ * \details If the URL is under the URL of the parent LinkTable, only the part
+ * after it is stored.
+ */
+void Link_set_url(Link *link, const char *url);
+
 /**
  * \brief Set the stats of a link, after curl multi handle finished querying
  */
 void Link_set_file_stat(Link *this_link, CURL *curl);
 
 /**
- * \brief create a new LinkTable
+ * \brief Mark a link as invalid after it failed to be stat'ed
+ * \details With --invalid-refresh, it is stat'ed again after a delay which
+ * doubles with each failure in a row, starting from CONFIG.http_wait_sec and
+ * capped at CONFIG.refresh_timeout.
  */
-LinkTable *LinkTable_new(const char *url);
+void Link_probe_failed(Link *link);
 
 /**
- * \brief download a path
- * \return the number of bytes downloaded
+ * \brief Wait for an uninitialised Link to be stat'ed
+ * \details If its LinkTable is not being filled in the background, this starts
+ * it. The Link may still be uninitialised afterwards, if its server asked to
+ * retry later.
+ */
+void Link_wait_file_stat(Link *link);
+
+/**
+ * \brief Wait for the background fill of a LinkTable to finish
+ * \details Entries the servers asked to retry later may still be
+ * uninitialised afterwards.
  */
-long path_download(const char *path, char *output_buf, size_t size,
-                   off_t offset);
+void LinkTable_wait_filled(LinkTable *linktbl);
+
+/**
+ * \brief create a new LinkTable
+ */
+LinkTable *LinkTable_new(const char *url);
 
 /**
  * \brief Download a Link
@@ -132,11 +306,54 @@ long path_download(const char *path, char *output_buf, size_t size,
 long Link_download(Link *link, char *output_buf, size_t req_size, off_t offset,
                    Cache *cf);
 
+/**
+ * \brief Called once a download started by Link_download_async() has ended
+ * \param[in] buf the data downloaded, only valid during the call
+ * \param[in] recv the number of bytes downloaded, or a negative errno
+ * \param[in] userdata the pointer given to Link_download_async()
+ */
+typedef void (*LinkDownloadCallback)(const char *buf, long recv,
+                                     void *userdata);
+
+/**
+ * \brief Download a Link without blocking
+ * \details The calling thread does not wait for the transfer. The callback
+ * is called by the network thread once the data has arrived, or straight
+ * away if there is nothing to download. Temporary failures are retried as
+ * in Link_download(). The Link must stay valid until the callback is called.
+ */
+void Link_download_async(Link *link, size_t req_size, off_t offset,
+                         LinkDownloadCallback callback, void *userdata);
+
 /**
  * \brief find the link associated with a path
  */
 Link *path_to_Link(const char *path);
 
+/**
+ * \brief Get the path of a Link, starting with '/'
+ * \note The caller must free the returned string with FREE().
+ * \return the path, or NULL if the Link is no longer part of the tree
+ */
+char *Link_get_path(const Link *link);
+
+/**
+ * \brief Get the LinkTable of a directory Link, building it if needed
+ * \note The caller must hold a reference to the parent table of the Link.
+ * \return the LinkTable with a reference for the caller, or NULL
+ */
+LinkTable *Link_to_LinkTable(Link *link);
+
+/**
+ * \brief Find the Link with a given name in a LinkTable
+ * \details Unlike LinkTable_lookup(), this takes link_lock itself, and counts
+ * as an access to the LinkTable.
+ * \note The caller must hold a reference to the LinkTable.
+ * \return the Link with a reference on its parent table for the caller, like
+ * path_to_Link(), or NULL if there is no Link with this name
+ */
+Link *LinkTable_find(LinkTable *linktbl, const char *linkname);
+
 /**
  * \brief return the link table for the associated path
  */
@@ -144,15 +361,42 @@ LinkTable *path_to_LinkTable(const char *path);
 
 /**
  * \brief dump a link table to the disk.
+ * \details The file is replaced atomically, see LinkTableDiskHeader in link.c
+ * for its layout.
  */
 int LinkTable_disk_save(LinkTable *linktbl, const char *dirn);
 
 /**
  * \brief load a link table from the disk.
+ * \details The file is mapped into memory rather than read. Files saved by
+ * older versions are converted to the current format, corrupted files are
+ * deleted.
  * \param[in] dirn We expected the unescaped_path here!
  */
 LinkTable *LinkTable_disk_open(const char *dirn);
 
+/**
+ * \brief Save the whole LinkTable tree to a single file in the cache
+ * \details LinkSystem_init() loads the tree from it on the next mount, rather
+ * than loading the LinkTable of each directory as it is visited. Every
+ * LinkTable is still refreshed after CONFIG.refresh_timeout.
+ * \return 0 on success, -1 if the cache is not enabled or on error
+ */
+int LinkTree_disk_save(void);
+
+/**
+ * \brief Start saving the LinkTable tree every CONFIG.snapshot_interval
+ * seconds
+ * \note This starts a thread, so it must be called after FUSE has forked.
+ */
+void LinkTree_autosave_start(void);
+
+/**
+ * \brief Stop saving the LinkTable tree periodically, and save it one last
+ * time
+ */
+void LinkTree_autosave_stop(void);
+
 /**
  * \brief Download a link's content to the memory
  * \warning You MUST free the memory field in TransferStruct after use!
@@ -185,15 +429,51 @@ void LinkTable_unref(LinkTable *tbl);
  */
 void LinkTable_mark_orphaned(LinkTable *tbl);
 
+/**
+ * \brief Merge a refreshed listing into a stale LinkTable
+ * \details The stale table stays in the tree. The entries which are still
+ * listed with the same URL keep their Links, with their subdirectory
+ * LinkTables, and have their type, size and time updated in place. Only the
+ * new entries get new Links. The subdirectory LinkTables of the entries which
+ * have gone are dropped from the tree.
+ * \note new_tbl is freed.
+ */
+void LinkTable_replace(LinkTable *old_tbl, LinkTable *new_tbl);
+
+/**
+ * \brief Get the entries of a LinkTable
+ * \details A refresh swaps in a new array of entries, the arrays it swaps out
+ * are kept until the LinkTable is freed. The entries can therefore be walked
+ * without link_lock.
+ * \note The caller must hold a reference to the LinkTable, and must not hold
+ * link_lock.
+ * \return the number of entries, including the head Link at index 0
+ */
+int LinkTable_entries(LinkTable *linktbl, Link ***links);
+
+/**
+ * \brief Find the Link with a given name in a LinkTable
+ * \details The hash index of the LinkTable is built on the first lookup, and
+ * rebuilt if Links have been added since. If several Links share a name, the
+ * first one is returned.
+ * \note The caller must hold link_lock, for reading is enough, if the
+ * LinkTable is part of the tree.
+ * \return the Link, or NULL if there is no Link with this name
+ */
+Link *LinkTable_lookup(LinkTable *linktbl, const char *linkname);
+
 /**
  * \brief print a LinkTable
  */
 void LinkTable_print(LinkTable *linktbl);
 
 /**
- * \brief add a Link to a LinkTable
+ * \brief add a new Link to a LinkTable
+ * \details The Link and its name are allocated from the arena of the
+ * LinkTable. A trailing '/' is removed from the name.
+ * \return the new Link, which does not have a URL yet
  */
-void LinkTable_add(LinkTable *linktbl, Link *link);
+Link *LinkTable_add(LinkTable *linktbl, const char *linkname, LinkType type);
 
 /**
  * \brief Parse HTML content and populate LinkTable with unique links.
@@ -201,6 +481,27 @@ void LinkTable_add(LinkTable *linktbl, Link *link);
 void LinkTable_parse_html(LinkTable *linktbl, const char *url,
                           const char *html);
 
+/**
+ * \brief Fill in the URLs of a freshly parsed LinkTable
+ * \details The names of the Links are unescaped, and their URLs are built
+ * from the escaped names.
+ * \param[in] stale the previous version of the LinkTable, or NULL. Entries
+ * that are already known from it are not probed again.
+ * \note This does not stat the entries, see LinkTable_uninitialised_fill()
+ * and LinkTable_fill_start().
+ */
+void LinkTable_fill(LinkTable *linktbl, LinkTable *stale);
+
+/**
+ * \brief Parse a JSON directory listing and populate LinkTable with its
+ * entries.
+ * \details The entries are fully initialised, so they do not need HEAD
+ * requests.
+ * \return 0 on success, -1 if the data is not a JSON directory listing
+ */
+int LinkTable_parse_json(LinkTable *linktbl, const char *url, const char *json,
+                         size_t len);
+
 /*
  * Functions exposed for unit testing duplicated URL logic
  */
@@ -237,6 +538,24 @@ LinkHashSet *LinkHashSet_new(int capacity);
  */
 int LinkHashSet_add(LinkHashSet *set, const char *linkname);
 
+/**
+ * \brief Add a link name to the LinkHashSet along with its Link, if the link
+ * name is not already present.
+ * \param set The LinkHashSet to insert the link name into.
+ * \param linkname The link name string to add.
+ * \param link The Link to store with the link name.
+ * \return 1 if successfully added (not a duplicate), 0 if it is a duplicate.
+ */
+int LinkHashSet_add_link(LinkHashSet *set, const char *linkname, Link *link);
+
+/**
+ * \brief Look up the Link stored with a link name.
+ * \param set The LinkHashSet to search.
+ * \param linkname The link name string to look up.
+ * \return The Link, or NULL if the link name is absent or has no Link.
+ */
+Link *LinkHashSet_get(LinkHashSet *set, const char *linkname);
+
 /**
  * \brief Free all memory allocated for a LinkHashSet.
  * \param set The LinkHashSet to deallocate.
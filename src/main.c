@@ -323,40 +323,48 @@ static int parse_arg_list(int argc, char **argv, char ***fuse_argv,
     const struct option long_opts[]
 
         = {/* Note that 'L' is returned for long options */
-           {"help", no_argument, NULL, 'h'},                  /* 0 */
-           {"version", no_argument, NULL, 'V'},               /* 1 */
-           {"debug", no_argument, NULL, 'd'},                 /* 2 */
-           {"username", required_argument, NULL, 'u'},        /* 3 */
-           {"password", required_argument, NULL, 'p'},        /* 4 */
-           {"proxy", required_argument, NULL, 'P'},           /* 5 */
-           {"proxy-username", required_argument, NULL, 'L'},  /* 6 */
-           {"proxy-password", required_argument, NULL, 'L'},  /* 7 */
-           {"cache", no_argument, NULL, 'L'},                 /* 8 */
-           {"dl-seg-size", required_argument, NULL, 'L'},     /* 9 */
-           {"max-conns", required_argument, NULL, 'L'},       /* 10 */
-           {"user-agent", required_argument, NULL, 'L'},      /* 11 */
-           {"retry-wait", required_argument, NULL, 'L'},      /* 12 */
-           {"cache-location", required_argument, NULL, 'L'},  /* 13 */
-           {"sonic-username", required_argument, NULL, 'L'},  /* 14 */
-           {"sonic-password", required_argument, NULL, 'L'},  /* 15 */
-           {"sonic-id3", no_argument, NULL, 'L'},             /* 16 */
-           {"no-range-check", no_argument, NULL, 'L'},        /* 17 */
-           {"sonic-insecure", no_argument, NULL, 'L'},        /* 18 */
-           {"insecure-tls", no_argument, NULL, 'L'},          /* 19 */
-           {"config", required_argument, NULL, 'L'},          /* 20 */
-           {"single-file-mode", no_argument, NULL, 'L'},      /* 21 */
-           {"cacert", required_argument, NULL, 'L'},          /* 22 */
-           {"proxy-cacert", required_argument, NULL, 'L'},    /* 23 */
-           {"refresh-timeout", required_argument, NULL, 'L'}, /* 24 */
-           {"http-header", required_argument, NULL, 'L'},     /* 25 */
-           {"cache-clear", no_argument, NULL, 'L'},           /* 26 */
-           {"zero-len-is-dir", no_argument, NULL, 'L'},       /* 27 */
-           {"invalid-refresh", no_argument, NULL, 'L'},       /* 28 */
-           {"capath", required_argument, NULL, 'L'},          /* 29 */
-           {"proxy-capath", required_argument, NULL, 'L'},    /* 30 */
-           {"external-links", no_argument, NULL, 'L'},        /* 31 */
-           {"cache-min-size", required_argument, NULL, 'L'},  /* 32 */
-           {"cache-max-size", required_argument, NULL, 'L'},  /* 33 */
+           {"help", no_argument, NULL, 'h'},                    /* 0 */
+           {"version", no_argument, NULL, 'V'},                 /* 1 */
+           {"debug", no_argument, NULL, 'd'},                   /* 2 */
+           {"username", required_argument, NULL, 'u'},          /* 3 */
+           {"password", required_argument, NULL, 'p'},          /* 4 */
+           {"proxy", required_argument, NULL, 'P'},             /* 5 */
+           {"proxy-username", required_argument, NULL, 'L'},    /* 6 */
+           {"proxy-password", required_argument, NULL, 'L'},    /* 7 */
+           {"cache", no_argument, NULL, 'L'},                   /* 8 */
+           {"dl-seg-size", required_argument, NULL, 'L'},       /* 9 */
+           {"max-conns", required_argument, NULL, 'L'},         /* 10 */
+           {"user-agent", required_argument, NULL, 'L'},        /* 11 */
+           {"retry-wait", required_argument, NULL, 'L'},        /* 12 */
+           {"cache-location", required_argument, NULL, 'L'},    /* 13 */
+           {"sonic-username", required_argument, NULL, 'L'},    /* 14 */
+           {"sonic-password", required_argument, NULL, 'L'},    /* 15 */
+           {"sonic-id3", no_argument, NULL, 'L'},               /* 16 */
+           {"no-range-check", no_argument, NULL, 'L'},          /* 17 */
+           {"sonic-insecure", no_argument, NULL, 'L'},          /* 18 */
+           {"insecure-tls", no_argument, NULL, 'L'},            /* 19 */
+           {"config", required_argument, NULL, 'L'},            /* 20 */
+           {"single-file-mode", no_argument, NULL, 'L'},        /* 21 */
+           {"cacert", required_argument, NULL, 'L'},            /* 22 */
+           {"proxy-cacert", required_argument, NULL, 'L'},      /* 23 */
+           {"refresh-timeout", required_argument, NULL, 'L'},   /* 24 */
+           {"http-header", required_argument, NULL, 'L'},       /* 25 */
+           {"cache-clear", no_argument, NULL, 'L'},             /* 26 */
+           {"zero-len-is-dir", no_argument, NULL, 'L'},         /* 27 */
+           {"invalid-refresh", no_argument, NULL, 'L'},         /* 28 */
+           {"capath", required_argument, NULL, 'L'},            /* 29 */
+           {"proxy-capath", required_argument, NULL, 'L'},      /* 30 */
+           {"external-links", no_argument, NULL, 'L'},          /* 31 */
+           {"cache-min-size", required_argument, NULL, 'L'},    /* 32 */
+           {"cache-max-size", required_argument, NULL, 'L'},    /* 33 */
+           {"json-listing", no_argument, NULL, 'L'},            /* 34 */
+           {"manifest", required_argument, NULL, 'L'},          /* 35 */
+           {"snapshot-interval", required_argument, NULL, 'L'}, /* 36 */
+           {"crawl", no_argument, NULL, 'L'},                   /* 37 */
+           {"crawl-depth", required_argument, NULL, 'L'},       /* 38 */
+           {"crawl-conns", required_argument, NULL, 'L'},       /* 39 */
+           {"crawl-rate", required_argument, NULL, 'L'},        /* 40 */
+           {"dir-mem-limit", required_argument, NULL, 'L'},     /* 41 */
            {0, 0, 0, 0}};
     while ((c = getopt_long(argc, argv, short_opts, long_opts, &long_index))
            != -1) {
@@ -505,6 +513,32 @@ static int parse_arg_list(int argc, char **argv, char ***fuse_argv,
                 }
                 CONFIG.cache_max_size = (off_t)val;
             } break;
+            case 34:
+                CONFIG.json_listing = 1;
+                break;
+            case 35:
+                CONFIG.mode = MANIFEST;
+                CONFIG.manifest_url = STRDUP(optarg);
+                break;
+            case 36:
+                CONFIG.snapshot_interval = (int)strtol(optarg, NULL, 10);
+                break;
+            case 37:
+                CONFIG.crawl = 1;
+                break;
+            case 38:
+                CONFIG.crawl_depth = (int)strtol(optarg, NULL, 10);
+                break;
+            case 39:
+                CONFIG.crawl_conns = (int)strtol(optarg, NULL, 10);
+                break;
+            case 40:
+                CONFIG.crawl_rate = (int)strtol(optarg, NULL, 10);
+                break;
+            case 41:
+                CONFIG.dir_mem_limit
+                    = (size_t)strtoul(optarg, NULL, 10) * 1024 * 1024;
+                break;
             default:
                 fprintf(stderr, "see httpdirfs -h for usage\n");
                 exit(EXIT_FAILURE);
@@ -570,6 +604,12 @@ HTTPDirFS options:\n\
                             (default: none)\n\
         --cache-max-size    Set maximum file size threshold for caching, in bytes\n\
                             (default: none)\n\
+        --snapshot-interval Save the directory tree to the cache every\n\
+                            specified number of seconds, 0 to only save it\n\
+                            when unmounting (default: " XSTR(DEFAULT_SNAPSHOT_INTERVAL) ")\n\
+        --dir-mem-limit     Set the memory budget of the directory listings,\n\
+                            in MB. The least recently used ones are evicted\n\
+                            beyond it (default: unlimited)\n\
         --cacert            Certificate authority for the server\n\
         --capath            Certificate authority directory for the server\n\
         --dl-seg-size       Set cache download segment size, in MB (default: " XSTR(
@@ -582,7 +622,17 @@ HTTPDirFS options:\n\
         --refresh-timeout   The directories are refreshed after the specified\n\
                             time, in seconds (default: " XSTR(DEFAULT_REFRESH_TIMEOUT) ")\n\
         --retry-wait        Set delay in seconds before retrying an HTTP request\n\
-                            after encountering an error. (default: " XSTR(DEFAULT_HTTP_WAIT_SEC) ")\n\
+                            after encountering an error. (default: " XSTR(DEFAULT_HTTP_WAIT_SEC) ")\n");
+    fprintf(stderr, "\
+        --crawl             Crawl the whole directory tree in the background\n\
+                            after mounting. Sending SIGUSR1 starts a crawl at\n\
+                            any time.\n\
+        --crawl-depth       The maximum depth to crawl, 0 for unlimited\n\
+                            (default: 0)\n\
+        --crawl-conns       The number of directories crawled at the same\n\
+                            time (default: " XSTR(DEFAULT_CRAWL_CONNS) ")\n\
+        --crawl-rate        The maximum number of directories crawled per\n\
+                            second, 0 for unlimited (default: 0)\n\
         --invalid-refresh   Try refreshing invalid links when reading a directory.\n\
         --user-agent        Set user agent string (default: \"" DEFAULT_USER_AGENT "\")\n\
         --no-range-check    Disable the built-in check for the server's support\n\
@@ -592,10 +642,17 @@ HTTPDirFS options:\n\
                             setting CURLOPT_SSL_VERIFYHOST to 0\n\
         --external-links    Include external (cross-origin) links from\n\
                             directory listings (default: off)\n\
+        --json-listing      Only accept JSON directory listings, e.g. from\n\
+                            nginx with \"autoindex_format json\". JSON\n\
+                            listings are detected automatically without this.\n\
+        --manifest          Manifest mode - build the directory tree from the\n\
+                            manifest at the specified URL, rather than from\n\
+                            the directory listings. A relative URL is\n\
+                            relative to the mounted URL.\n\
         --single-file-mode  Single file mode - rather than mounting a whole\n\
                             directory, present a single file inside a virtual\n\
-                            directory.\n\
-\n\
+                            directory.\n");
+    fprintf(stderr, "\n\
     For mounting a Airsonic / Subsonic server:\n\
         --sonic-username    The username for your Airsonic / Subsonic server\n\
         --sonic-password    The password for your Airsonic / Subsonic server\n\
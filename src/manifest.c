@@ -0,0 +1,458 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+/**
+ * \file manifest.c
+ * \brief Manifest driven mount implementation
+ */
+
+#include "manifest.h"
+
+#include "cache.h"
+#include "config.h"
+#include "link.h"
+#include "log.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/**
+ * \brief The size of the buffer for the decompressed manifest
+ */
+#define MANIFEST_CHUNK_SZ (64 * 1024)
+
+/**
+ * \brief The maximum length of a line in the manifest
+ */
+#define MANIFEST_LINE_MAX (PATH_MAX + 256)
+
+/**
+ * \brief An entry of the path to Link map
+ */
+typedef struct {
+    /** \brief The path relative to the root, without the trailing '/' */
+    char *path;
+    Link *link;
+} ManifestNode;
+
+/**
+ * \brief The state used while building the LinkTable hierarchy
+ */
+typedef struct {
+    /** \brief The open addressing map from the paths to the Links */
+    ManifestNode *nodes;
+    size_t capacity;
+    size_t size;
+    /** \brief The root LinkTable */
+    LinkTable *root;
+    /** \brief The partial line carried over between chunks */
+    char line[MANIFEST_LINE_MAX + 1];
+    size_t line_len;
+    /** \brief Whether the current line is too long */
+    int line_overflow;
+    /** \brief The number of lines parsed */
+    long line_no;
+} Manifest;
+
+static uint64_t manifest_hash(const char *str)
+{
+    /* FNV-1a */
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *str; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static Link *Manifest_find(const Manifest *m, const char *path)
+{
+    size_t i = manifest_hash(path) & (m->capacity - 1);
+    while (m->nodes[i].path) {
+        if (!strcmp(m->nodes[i].path, path)) {
+            return m->nodes[i].link;
+        }
+        i = (i + 1) & (m->capacity - 1);
+    }
+    return NULL;
+}
+
+static void Manifest_insert(Manifest *m, const char *path, Link *link)
+{
+    if ((m->size + 1) * 2 > m->capacity) {
+        ManifestNode *old_nodes = m->nodes;
+        size_t old_capacity = m->capacity;
+        m->capacity *= 2;
+        m->nodes = CALLOC(m->capacity, sizeof(ManifestNode));
+        for (size_t j = 0; j < old_capacity; j++) {
+            if (old_nodes[j].path) {
+                size_t i = manifest_hash(old_nodes[j].path) & (m->capacity - 1);
+                while (m->nodes[i].path) {
+                    i = (i + 1) & (m->capacity - 1);
+                }
+                m->nodes[i] = old_nodes[j];
+            }
+        }
+        FREE(old_nodes);
+    }
+    size_t i = manifest_hash(path) & (m->capacity - 1);
+    while (m->nodes[i].path) {
+        i = (i + 1) & (m->capacity - 1);
+    }
+    m->nodes[i].path = STRDUP(path);
+    m->nodes[i].link = link;
+    m->size++;
+}
+
+/**
+ * \brief Create a fully initialised Link, and add it to its parent
+ */
+static Link *manifest_Link_new(LinkTable *parent, const char *name,
+                               LinkType type)
+{
+    Link *link = LinkTable_add(parent, name, type);
+
+    char *escaped_name = curl_easy_escape(NULL, name, 0);
+    char *url = path_append(parent->links[0]->url,
+                            escaped_name ? escaped_name : name);
+    char full_url[PATH_MAX + 1];
+    snprintf(full_url, sizeof(full_url), "%s%s", url,
+             type == LINK_DIR ? "/" : "");
+    Link_set_url(link, full_url);
+    FREE(url);
+    if (escaped_name) {
+        curl_free(escaped_name);
+    }
+
+    return link;
+}
+
+/**
+ * \brief Find or create the LinkTable for a directory
+ * \param[in] path the path of the directory, "" for the root
+ * \return the LinkTable, or NULL if the path clashes with a file
+ */
+static LinkTable *Manifest_dir(Manifest *m, const char *path)
+{
+    if (path[0] == '\0') {
+        return m->root;
+    }
+
+    Link *link = Manifest_find(m, path);
+    if (link) {
+        return link->type == LINK_DIR ? link->next_table : NULL;
+    }
+
+    LinkTable *parent;
+    const char *name;
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        char *parent_path = STRNDUP(path, (size_t)(slash - path));
+        parent = Manifest_dir(m, parent_path);
+        FREE(parent_path);
+        name = slash + 1;
+    } else {
+        parent = m->root;
+        name = path;
+    }
+    if (!parent) {
+        return NULL;
+    }
+
+    link = manifest_Link_new(parent, name, LINK_DIR);
+    char *url = Link_get_url(link);
+    LinkTable *linktbl = LinkTable_alloc(url);
+    linktbl->index_time = parent->index_time;
+    linktbl->parent_tbl = parent;
+    linktbl->parent_link = link;
+    link->next_table = linktbl;
+    parent->refcount++;
+    Manifest_insert(m, path, link);
+
+    if (CACHE_SYSTEM_INIT) {
+        char *cache_path = url_to_cache_path(url);
+        CacheDir_create(cache_path);
+        FREE(cache_path);
+    }
+    FREE(url);
+    return linktbl;
+}
+
+/**
+ * \brief Check that none of the components of a path are special
+ */
+static int manifest_path_valid(const char *path)
+{
+    const char *start = path;
+    while (1) {
+        const char *end = strchr(start, '/');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len == 0 || len > NAME_MAX || (len == 1 && start[0] == '.')
+            || (len == 2 && start[0] == '.' && start[1] == '.')) {
+            return 0;
+        }
+        if (!end) {
+            return 1;
+        }
+        start = end + 1;
+    }
+}
+
+static void Manifest_parse_line(Manifest *m, char *line)
+{
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    if (line[0] == '\0' || line[0] == '#') {
+        return;
+    }
+
+    char *fields[4] = {line, NULL, NULL, NULL};
+    for (int i = 1; i < 4; i++) {
+        char *tab = strchr(fields[i - 1], '\t');
+        if (!tab) {
+            break;
+        }
+        *tab = '\0';
+        fields[i] = tab + 1;
+    }
+
+    char *path = fields[0];
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    while (path[0] == '/') {
+        path++;
+    }
+    len = strlen(path);
+    int is_dir = 0;
+    while (len > 0 && path[len - 1] == '/') {
+        path[--len] = '\0';
+        is_dir = 1;
+    }
+    if (len == 0) {
+        return;
+    }
+    if (!manifest_path_valid(path)) {
+        lprintf(warning, "line %ld: invalid path: %s\n", m->line_no, path);
+        return;
+    }
+
+    long mtime = fields[2] ? strtol(fields[2], NULL, 10) : 0;
+
+    if (is_dir) {
+        LinkTable *linktbl = Manifest_dir(m, path);
+        if (!linktbl) {
+            lprintf(warning, "line %ld: %s is not a directory\n", m->line_no,
+                    path);
+            return;
+        }
+        linktbl->parent_link->time = mtime;
+        return;
+    }
+
+    char *end = NULL;
+    long long size = fields[1] ? strtoll(fields[1], &end, 10) : -1;
+    if (!fields[1] || end == fields[1] || size < 0) {
+        lprintf(warning, "line %ld: invalid size for %s\n", m->line_no, path);
+        return;
+    }
+
+    if (Manifest_find(m, path)) {
+        lprintf(warning, "line %ld: duplicated path: %s\n", m->line_no, path);
+        return;
+    }
+
+    LinkTable *parent;
+    const char *name;
+    char *slash = strrchr(path, '/');
+    if (slash) {
+        *slash = '\0';
+        parent = Manifest_dir(m, path);
+        *slash = '/';
+        name = slash + 1;
+    } else {
+        parent = m->root;
+        name = path;
+    }
+    if (!parent) {
+        lprintf(warning, "line %ld: the parent of %s is not a directory\n",
+                m->line_no, path);
+        return;
+    }
+
+    Link *link = manifest_Link_new(parent, name, LINK_FILE);
+    link->content_length = (size_t)size;
+    link->time = mtime;
+    Manifest_insert(m, path, link);
+}
+
+/**
+ * \brief Feed a chunk of the uncompressed manifest into the line parser
+ */
+static void Manifest_feed(Manifest *m, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\n') {
+            m->line_no++;
+            if (m->line_overflow) {
+                lprintf(warning, "line %ld is too long\n", m->line_no);
+            } else {
+                m->line[m->line_len] = '\0';
+                Manifest_parse_line(m, m->line);
+            }
+            m->line_len = 0;
+            m->line_overflow = 0;
+        } else if (m->line_len < MANIFEST_LINE_MAX) {
+            m->line[m->line_len++] = data[i];
+        } else {
+            m->line_overflow = 1;
+        }
+    }
+}
+
+/**
+ * \brief Decompress a gzip compressed manifest into the line parser
+ * \return 0 on success, -1 on failure
+ */
+static int Manifest_feed_gzip(Manifest *m, const char *data, size_t len)
+{
+    z_stream strm = {0};
+    /* 32 enables the automatic gzip / zlib header detection */
+    if (inflateInit2(&strm, 15 + 32) != Z_OK) {
+        lprintf(error, "inflateInit2() failed\n");
+        return -1;
+    }
+
+    char *out = CALLOC(MANIFEST_CHUNK_SZ, sizeof(char));
+    const char *in = data;
+    size_t in_remaining = len;
+    int res = 0;
+    int ret = Z_OK;
+    while (1) {
+        if (strm.avail_in == 0 && in_remaining > 0) {
+            uInt chunk = in_remaining > UINT_MAX ? UINT_MAX : in_remaining;
+            strm.next_in = (Bytef *)in;
+            strm.avail_in = chunk;
+            in += chunk;
+            in_remaining -= chunk;
+        }
+        strm.next_out = (Bytef *)out;
+        strm.avail_out = MANIFEST_CHUNK_SZ;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            lprintf(error, "inflate(): %s\n", strm.msg ? strm.msg : "error");
+            res = -1;
+            break;
+        }
+        Manifest_feed(m, out, MANIFEST_CHUNK_SZ - strm.avail_out);
+        if (ret == Z_STREAM_END) {
+            /* There might be several concatenated gzip members */
+            if (strm.avail_in == 0 && in_remaining == 0) {
+                break;
+            }
+            inflateReset(&strm);
+        } else if (ret == Z_BUF_ERROR && strm.avail_in == 0
+                   && in_remaining == 0) {
+            lprintf(error, "The compressed manifest is truncated\n");
+            res = -1;
+            break;
+        }
+    }
+
+    FREE(out);
+    inflateEnd(&strm);
+    return res;
+}
+
+LinkTable *manifest_parse(const char *base_url, const char *data, size_t len)
+{
+    Manifest *m = CALLOC(1, sizeof(Manifest));
+    m->capacity = 1024;
+    m->nodes = CALLOC(m->capacity, sizeof(ManifestNode));
+    m->root = LinkTable_alloc(base_url);
+    m->root->index_time = time(NULL);
+
+    int res = 0;
+    if (len >= 2 && (unsigned char)data[0] == 0x1f
+        && (unsigned char)data[1] == 0x8b) {
+        res = Manifest_feed_gzip(m, data, len);
+    } else {
+        Manifest_feed(m, data, len);
+    }
+    /* The last line might not have a trailing newline */
+    if (m->line_len > 0) {
+        Manifest_feed(m, "\n", 1);
+    }
+
+    lprintf(info, "Loaded %zu entries from the manifest\n", m->size);
+
+    LinkTable *root = m->root;
+    if (res) {
+        LinkTable_free(root);
+        root = NULL;
+    }
+    for (size_t i = 0; i < m->capacity; i++) {
+        FREE(m->nodes[i].path);
+    }
+    FREE(m->nodes);
+    FREE(m);
+    return root;
+}
+
+LinkTable *manifest_LinkTable_new(const char *base_url,
+                                  const char *manifest_url)
+{
+    char *url;
+    if (!strncasecmp(manifest_url, "http://", 7)
+        || !strncasecmp(manifest_url, "https://", 8)) {
+        url = STRDUP(manifest_url);
+    } else {
+        /* A relative manifest URL is relative to the base URL */
+        url = path_append(base_url, manifest_url);
+    }
+
+    LinkTable *manifest_tbl = LinkTable_alloc(url);
+    FREE(url);
+    TransferStruct ts = Link_download_full(manifest_tbl->links[0]);
+    if (ts.curr_size == 0) {
+        lprintf(error, "Failed to download the manifest from %s\n",
+                manifest_tbl->links[0]->url);
+        LinkTable_free(manifest_tbl);
+        return NULL;
+    }
+    LinkTable_free(manifest_tbl);
+
+    LinkTable *linktbl = manifest_parse(base_url, ts.data, ts.curr_size);
+    FREE(ts.data);
+    if (linktbl) {
+        LinkTable_print(linktbl);
+    }
+    return linktbl;
+}
@@ -0,0 +1,67 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+/**
+ * \file manifest.h
+ * \brief Manifest driven mount header
+ * \details In manifest mode, the whole directory tree is built from a single
+ * index file, rather than by crawling the directory listings. The manifest
+ * is a text file, optionally compressed with gzip, with one entry per line:
+ *
+ *     path<TAB>size<TAB>mtime[<TAB>hash]
+ *
+ * - path is relative to the base URL, a trailing '/' denotes a directory.
+ * - size is in bytes, it is ignored for directories.
+ * - mtime is in seconds since epoch.
+ * - hash is optional, and it is currently unused.
+ *
+ * Empty lines and lines which start with '#' are ignored. Parent directories
+ * do not need their own entries.
+ */
+
+#include <stddef.h>
+
+typedef struct LinkTable LinkTable;
+
+/**
+ * \brief Create the root LinkTable in manifest mode
+ * \details This downloads the manifest, and builds the entire LinkTable
+ * hierarchy from it.
+ * \param[in] base_url the URL which the paths in the manifest are relative to
+ * \param[in] manifest_url the URL of the manifest
+ * \return the root LinkTable, or NULL if the manifest cannot be downloaded
+ */
+LinkTable *manifest_LinkTable_new(const char *base_url,
+                                  const char *manifest_url);
+
+/**
+ * \brief Build a LinkTable hierarchy from manifest data in memory
+ * \details The data can be either plain text or gzip compressed.
+ * \return the root LinkTable, or NULL if the data cannot be decompressed
+ */
+LinkTable *manifest_parse(const char *base_url, const char *data, size_t len);
+
+#endif
@@ -30,6 +30,7 @@
 
 
 #include <stddef.h>
+#include <time.h>
 
 typedef struct Link Link;
 typedef struct Cache Cache;
@@ -58,6 +59,18 @@ typedef struct TransferStruct {
     Cache *cache_ptr;
     /** \brief The ActiveDownload structure associated with the transfer */
     struct ActiveDownload *ad_ptr;
+    /**
+     * \brief Called by the network thread once a transfer started by
+     * transfer_async() has finished
+     */
+    void (*done)(struct TransferStruct *ts);
+    /** \brief The next finished transfer waiting for its done callback */
+    struct TransferStruct *next;
+    /**
+     * \brief When a transfer deferred by transfer_async_defer() is due, on
+     * the CLOCK_MONOTONIC clock
+     */
+    struct timespec due;
 } TransferStruct;
 
 /**
@@ -56,6 +56,18 @@ static pthread_mutex_t transfer_lock;
 static pthread_mutex_t *crypto_lockarray;
 /** \brief mutex for curl share interface itself */
 static pthread_mutex_t curl_lock;
+/** \brief the number of transfers started by transfer_async() in progress */
+static int n_async;
+/** \brief finished transfers whose done callback has not been called yet */
+static TransferStruct *async_done;
+/** \brief transfers deferred by transfer_async_defer(), the earliest first */
+static TransferStruct *async_deferred;
+/** \brief signalled when the network thread has something to do */
+static pthread_cond_t async_cond;
+/** \brief whether the network thread has been started */
+static int async_started;
+/** \brief the network thread */
+static pthread_t async_thread;
 
 /*
  * -------------------- Functions --------------------------
@@ -170,7 +182,7 @@ static void curl_process_msgs(CURLMsg *curl_msg, int n_running_curl,
              * fill function can proceed.
              */
             if (ts->type == FILESTAT) {
-                ts->link->type = LINK_INVALID;
+                Link_probe_failed(ts->link);
             }
         }
         curl_multi_remove_handle(curl_multi, curl);
@@ -180,6 +192,15 @@ static void curl_process_msgs(CURLMsg *curl_msg, int n_running_curl,
         if (ts->type == FILESTAT) {
             curl_easy_cleanup(curl);
             FREE(ts);
+        } else if (ts->done) {
+            /*
+             * The callback is called by the network thread, once
+             * transfer_lock is released
+             */
+            n_async--;
+            ts->next = async_done;
+            async_done = ts;
+            PTHREAD_COND_BROADCAST(&async_cond);
         }
     } else {
         lprintf(warning, "curl_msg->msg: %d\n", curl_msg->msg);
@@ -228,6 +249,76 @@ int curl_multi_perform_once(void)
     return n_running_curl;
 }
 
+/** \brief whether a is not later than b */
+static int timespec_not_after(const struct timespec *a,
+                              const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec
+        || (a->tv_sec == b->tv_sec && a->tv_nsec <= b->tv_nsec);
+}
+
+/**
+ * \brief Move the deferred transfers which are due to async_done
+ * \note The caller must hold transfer_lock.
+ */
+static void async_deferred_collect(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (async_deferred && timespec_not_after(&async_deferred->due, &now)) {
+        TransferStruct *ts = async_deferred;
+        async_deferred = ts->next;
+        ts->next = async_done;
+        async_done = ts;
+    }
+}
+
+/**
+ * \brief The network thread
+ * \details It drives the transfers started by transfer_async(), and calls
+ * their done callbacks once they have finished. Threads which wait in
+ * transfer_blocking() drive the multi handle as well, so the transfers may
+ * finish on any of them, but the callbacks are only ever called here.
+ */
+static void *transfer_async_thread(void *arg)
+{
+    (void)arg;
+    while (1) {
+        PTHREAD_MUTEX_LOCK(&transfer_lock);
+        async_deferred_collect();
+        while (!n_async && !async_done) {
+            if (async_deferred) {
+                /*
+                 * async_cond uses CLOCK_MONOTONIC, see NetworkSystem_init()
+                 */
+                pthread_cond_timedwait(&async_cond, &transfer_lock,
+                                       &async_deferred->due);
+            } else {
+                PTHREAD_COND_WAIT(&async_cond, &transfer_lock);
+            }
+            async_deferred_collect();
+        }
+        int running = n_async;
+        PTHREAD_MUTEX_UNLOCK(&transfer_lock);
+
+        if (running) {
+            curl_multi_perform_once();
+        }
+
+        PTHREAD_MUTEX_LOCK(&transfer_lock);
+        TransferStruct *ts = async_done;
+        async_done = NULL;
+        PTHREAD_MUTEX_UNLOCK(&transfer_lock);
+
+        while (ts) {
+            TransferStruct *next = ts->next;
+            ts->done(ts);
+            ts = next;
+        }
+    }
+    return NULL;
+}
+
 void NetworkSystem_init(void)
 {
     /*
@@ -270,6 +361,11 @@ void NetworkSystem_init(void)
      * ------------ Initialise locks ---------
      */
     PTHREAD_MUTEX_INIT(&transfer_lock, NULL);
+    pthread_condattr_t async_cond_attr;
+    pthread_condattr_init(&async_cond_attr);
+    pthread_condattr_setclock(&async_cond_attr, CLOCK_MONOTONIC);
+    PTHREAD_COND_INIT(&async_cond, &async_cond_attr);
+    pthread_condattr_destroy(&async_cond_attr);
 
     /*
      * cryptographic lock functions were shamelessly copied from
@@ -320,6 +416,62 @@ void transfer_nonblocking(CURL *curl)
     PTHREAD_MUTEX_UNLOCK(&transfer_lock);
 }
 
+/**
+ * \brief Start the network thread, if it is not running yet
+ * \details The thread is started on first use, as the process may daemonise
+ * after the network module is initialised.
+ * \note The caller must hold transfer_lock.
+ */
+static void async_thread_start(void)
+{
+    if (!async_started) {
+        int res = pthread_create(&async_thread, NULL, transfer_async_thread,
+                                 NULL);
+        if (res) {
+            lprintf(fatal, "pthread_create(): %s\n", strerror(res));
+        }
+        pthread_detach(async_thread);
+        async_started = 1;
+    }
+}
+
+void transfer_async(CURL *curl)
+{
+    lprintf(network_lock_debug, "thread %lx: locking transfer_lock;\n",
+            (unsigned long)pthread_self());
+    PTHREAD_MUTEX_LOCK(&transfer_lock);
+
+    async_thread_start();
+
+    CURLMcode res = curl_multi_add_handle(curl_multi, curl);
+    if (res > 0) {
+        lprintf(error, "%s\n", curl_multi_strerror(res));
+    }
+    n_async++;
+    PTHREAD_COND_BROADCAST(&async_cond);
+
+    lprintf(network_lock_debug, "thread %lx: unlocking transfer_lock;\n",
+            (unsigned long)pthread_self());
+    PTHREAD_MUTEX_UNLOCK(&transfer_lock);
+}
+
+void transfer_async_defer(TransferStruct *ts, unsigned int delay)
+{
+    clock_gettime(CLOCK_MONOTONIC, &ts->due);
+    ts->due.tv_sec += delay;
+
+    PTHREAD_MUTEX_LOCK(&transfer_lock);
+    async_thread_start();
+    TransferStruct **p = &async_deferred;
+    while (*p && timespec_not_after(&(*p)->due, &ts->due)) {
+        p = &(*p)->next;
+    }
+    ts->next = *p;
+    *p = ts;
+    PTHREAD_COND_BROADCAST(&async_cond);
+    PTHREAD_MUTEX_UNLOCK(&transfer_lock);
+}
+
 int HTTP_temp_failure(HTTPResponseCode http_resp)
 {
     switch (http_resp) {
@@ -29,12 +29,15 @@
  * \brief Network transfer and cURL wrapper header
  */
 
+#include "memcache.h"
+
 #include <curl/curl.h>
 
 /** \brief HTTP response codes */
 typedef enum {
     HTTP_OK = 200,
     HTTP_PARTIAL_CONTENT = 206,
+    HTTP_NOT_MODIFIED = 304,
     HTTP_RANGE_NOT_SATISFIABLE = 416,
     HTTP_TOO_MANY_REQUESTS = 429,
     HTTP_CLOUDFLARE_UNKNOWN_ERROR = 520,
@@ -56,6 +59,24 @@ void transfer_blocking(CURL *curl);
 /** \brief non blocking file transfer */
 void transfer_nonblocking(CURL *curl);
 
+/**
+ * \brief non blocking file transfer with a completion callback
+ * \details The transfer is driven by the network thread, which calls the
+ * done callback of the TransferStruct set as CURLOPT_PRIVATE once the
+ * transfer has finished. The handle is removed from the multi handle, but
+ * not cleaned up.
+ */
+void transfer_async(CURL *curl);
+
+/**
+ * \brief call the done callback of a transfer again after a delay
+ * \details The network thread calls the done callback of the TransferStruct
+ * once delay seconds have passed, so a done callback can retry its transfer
+ * without holding back the others. The callback is usually changed before
+ * this is called.
+ */
+void transfer_async_defer(TransferStruct *ts, unsigned int delay);
+
 /**
  * \brief check if a HTTP response code corresponds to a temporary failure
  */
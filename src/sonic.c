@@ -177,6 +177,45 @@ static char *sonic_stream_link(const char *id)
     return url;
 }
 
+/**
+ * \brief Make a name from the Sonic server usable as a file name
+ * \param[in,out] linkname a buffer of NAME_MAX + 1 bytes
+ */
+static void sanitise_linkname(char *linkname)
+{
+    if (!strcmp(linkname, ".")) {
+        /* Note the super long sanitised name to avoid collision */
+        strcpy(linkname, "__DOT__");
+    }
+
+    if (!strcmp(linkname, "/")) {
+        /* Ditto */
+        strcpy(linkname, "__FORWARD-SLASH__");
+    }
+
+    for (size_t j = 0; linkname[j] != '\0'; j++) {
+        if (linkname[j] == '/') {
+            linkname[j] = '-';
+        }
+    }
+}
+
+/**
+ * \brief Add a Link which was parsed into a temporary Link to a LinkTable
+ * \details The Links of a LinkTable are allocated from its arena, so they are
+ * parsed into a temporary Link with its own name buffer first.
+ */
+static Link *sonic_LinkTable_add(LinkTable *linktbl, Link *parsed)
+{
+    sanitise_linkname(parsed->linkname);
+    Link *link = LinkTable_add(linktbl, parsed->linkname, parsed->type);
+    link->content_length = parsed->content_length;
+    link->time = parsed->time;
+    link->next_table = parsed->next_table;
+    link->sonic = parsed->sonic;
+    return link;
+}
+
 /**
  * \brief The parser for Sonic index mode
  * \details This is the callback function called by the the XML parser.
@@ -205,7 +244,9 @@ static void XMLCALL XML_parser_general(void *data, const char *elem,
     }
 
     LinkTable *linktbl = (LinkTable *)data;
-    Link *link;
+    char linkname[NAME_MAX + 1] = { 0 };
+    Link parsed = { .linkname = linkname };
+    Link *link = &parsed;
 
     /*
      * Please refer to the documentation at the function prototype of
@@ -213,17 +254,14 @@ static void XMLCALL XML_parser_general(void *data, const char *elem,
      */
     if (!strcmp(elem, "child")
         || (!strcmp(elem, "artist") && linktbl->links[0]->sonic.depth != 3)) {
-        link = CALLOC(1, sizeof(Link));
         link->type = LINK_DIR;
     } else if (!strcmp(elem, "album") && linktbl->links[0]->sonic.depth == 3) {
-        link = CALLOC(1, sizeof(Link));
         link->type = LINK_DIR;
         /*
          * The new table should be a level 4 song table
          */
         link->sonic.depth = 4;
     } else if (!strcmp(elem, "song") && linktbl->links[0]->sonic.depth == 4) {
-        link = CALLOC(1, sizeof(Link));
         link->type = LINK_FILE;
     } else {
         /*
@@ -320,42 +358,16 @@ static void XMLCALL XML_parser_general(void *data, const char *elem,
      * Clean up if linkname or id is not set
      */
     if (!linkname_set || !id_set) {
-        FREE(link);
+        FREE(link->sonic.id);
         return;
     }
 
+    link = sonic_LinkTable_add(linktbl, link);
     if (link->type == LINK_FILE) {
         char *url = sonic_stream_link(link->sonic.id);
-        strncpy(link->f_url, url, PATH_MAX);
+        Link_set_url(link, url);
         FREE(url);
     }
-
-    LinkTable_add(linktbl, link);
-}
-
-static void sanitise_LinkTable(LinkTable *linktbl)
-{
-    for (int i = 0; i < linktbl->size; i++) {
-        if (!strcmp(linktbl->links[i]->linkname, ".")) {
-            /* Note the super long sanitised name to avoid collision */
-            strcpy(linktbl->links[i]->linkname, "__DOT__");
-        }
-
-        if (!strcmp(linktbl->links[i]->linkname, "/")) {
-            /* Ditto */
-            strcpy(linktbl->links[i]->linkname, "__FORWARD-SLASH__");
-        }
-
-        for (size_t j = 0; linktbl->links[i]->linkname[j] != '\0'; j++) {
-            if (linktbl->links[i]->linkname[j] == '/') {
-                linktbl->links[i]->linkname[j] = '-';
-            }
-        }
-
-        if (linktbl->links[i]->next_table != NULL) {
-            sanitise_LinkTable(linktbl->links[i]->next_table);
-        }
-    }
 }
 
 /*
@@ -420,8 +432,6 @@ static LinkTable *sonic_url_to_LinkTable(const char *url,
 
     LinkTable_print(linktbl);
 
-    sanitise_LinkTable(linktbl);
-
     return linktbl;
 }
 
@@ -452,12 +462,13 @@ static void XMLCALL XML_parser_id3_root(void *data, const char *elem,
 
     int id_set = 0;
     int linkname_set = 0;
-    Link *link;
+    char linkname[NAME_MAX + 1] = { 0 };
+    Link parsed = { .linkname = linkname };
+    Link *link = &parsed;
     if (!strcmp(elem, "index")) {
         /*
          * Add a subdirectory
          */
-        link = CALLOC(1, sizeof(Link));
         link->type = LINK_DIR;
         for (int i = 0; attr[i]; i += 2) {
             if (!strcmp("name", attr[i])) {
@@ -473,10 +484,10 @@ static void XMLCALL XML_parser_id3_root(void *data, const char *elem,
          * Make sure we don't add an empty directory
          */
         if (linkname_set) {
-            LinkTable_add(root_linktbl, link);
+            link = sonic_LinkTable_add(root_linktbl, link);
             id3_current_index_table = link->next_table;
         } else {
-            FREE(link);
+            LinkTable_free(link->next_table);
         }
         return;
     } else if (!strcmp(elem, "artist")) {
@@ -484,7 +495,6 @@ static void XMLCALL XML_parser_id3_root(void *data, const char *elem,
             lprintf(warning, "Ignoring <artist> outside of any <index>\n");
             return;
         }
-        link = CALLOC(1, sizeof(Link));
         link->type = LINK_DIR;
         /*
          * The new table should be a level 3 album table
@@ -512,12 +522,10 @@ static void XMLCALL XML_parser_id3_root(void *data, const char *elem,
             if (link->sonic.id) {
                 FREE(link->sonic.id);
             }
-
-            FREE(link);
             return;
         }
 
-        LinkTable_add(id3_current_index_table, link);
+        sonic_LinkTable_add(id3_current_index_table, link);
     }
     /*
      * If we reach here, then this element does not contain directory structural
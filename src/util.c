@@ -161,6 +161,42 @@ void pthread_mutex_lock_wrapper(const char *file, const char *func, int line,
     }
 }
 
+void pthread_rwlock_rdlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x)
+{
+    int i;
+    i = pthread_rwlock_rdlock(x);
+    if (i) {
+        fatal_log_printf(file, func, line,
+                         "%lx pthread_rwlock_rdlock: %d, %s\n",
+                         (unsigned long)pthread_self(), i, strerror(i));
+    }
+}
+
+void pthread_rwlock_wrlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x)
+{
+    int i;
+    i = pthread_rwlock_wrlock(x);
+    if (i) {
+        fatal_log_printf(file, func, line,
+                         "%lx pthread_rwlock_wrlock: %d, %s\n",
+                         (unsigned long)pthread_self(), i, strerror(i));
+    }
+}
+
+void pthread_rwlock_unlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x)
+{
+    int i;
+    i = pthread_rwlock_unlock(x);
+    if (i) {
+        fatal_log_printf(file, func, line,
+                         "%lx pthread_rwlock_unlock: %d, %s\n",
+                         (unsigned long)pthread_self(), i, strerror(i));
+    }
+}
+
 #ifdef __APPLE__
 
 void sem_init_wrapper(sys_sem_t *sem, int pshared, unsigned int value,
@@ -735,10 +771,7 @@ void mem_cleanup(void)
 
 #ifdef DEBUG
     // 1. Traverse and tear down the whole filesystem recursively
-    if (ROOT_LINK_TBL) {
-        LinkTable_free(ROOT_LINK_TBL);
-        ROOT_LINK_TBL = NULL;
-    }
+    LinkSystem_cleanup();
 
     // 2. Clean up any other heap-allocated cache directories
     CacheSystem_cleanup();
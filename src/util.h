@@ -86,6 +86,30 @@ void pthread_mutex_unlock_wrapper(const char *file, const char *func, int line,
 #define PTHREAD_MUTEX_UNLOCK(x)                                                \
     pthread_mutex_unlock_wrapper(__FILE__, __func__, __LINE__, x)
 
+/**
+ * \brief wrapper for pthread_rwlock_rdlock(), with error handling
+ */
+void pthread_rwlock_rdlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x);
+#define PTHREAD_RWLOCK_RDLOCK(x)                                               \
+    pthread_rwlock_rdlock_wrapper(__FILE__, __func__, __LINE__, x)
+
+/**
+ * \brief wrapper for pthread_rwlock_wrlock(), with error handling
+ */
+void pthread_rwlock_wrlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x);
+#define PTHREAD_RWLOCK_WRLOCK(x)                                               \
+    pthread_rwlock_wrlock_wrapper(__FILE__, __func__, __LINE__, x)
+
+/**
+ * \brief wrapper for pthread_rwlock_unlock(), with error handling
+ */
+void pthread_rwlock_unlock_wrapper(const char *file, const char *func,
+                                   int line, pthread_rwlock_t *x);
+#define PTHREAD_RWLOCK_UNLOCK(x)                                               \
+    pthread_rwlock_unlock_wrapper(__FILE__, __func__, __LINE__, x)
+
 /**
  * \brief wrapper for sem_init(), with error handling
  * */
@@ -0,0 +1,175 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+/**
+ * \file bench_link_lookup.c
+ * \brief Lock contention benchmark for path_to_Link()
+ * \details This builds a synthetic tree of LinkTables, then looks up paths in
+ * it from an increasing number of threads. If lookups do not contend with
+ * each other, the throughput grows with the number of threads.
+ */
+
+#include "../src/config.h"
+#include "../src/link.h"
+#include "../src/util.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** \brief The number of entries in each directory of the synthetic tree */
+#define FANOUT 32
+/** \brief The number of lookups done by each thread */
+#define LOOKUPS_PER_THREAD 200000
+/** \brief The maximum number of threads */
+#define MAX_THREADS 16
+
+static char **paths;
+static int n_paths;
+
+/**
+ * \brief Fill a LinkTable with FANOUT directories or files
+ */
+static LinkTable *bench_LinkTable_new(const char *url, int dirs)
+{
+    LinkTable *linktbl = LinkTable_alloc(url);
+    char *html = CALLOC(FANOUT, 32);
+    for (int i = 0; i < FANOUT; i++) {
+        char entry[32];
+        snprintf(entry, sizeof(entry), "<a href=\"%c%d%s\"></a>",
+                 dirs ? 'd' : 'f', i, dirs ? "/" : "");
+        strcat(html, entry);
+    }
+    LinkTable_parse_html(linktbl, url, html);
+    FREE(html);
+    return linktbl;
+}
+
+/**
+ * \brief Build a tree two directories deep, with FANOUT files at the bottom
+ */
+static void bench_tree_new(void)
+{
+    ROOT_LINK_TBL = bench_LinkTable_new("http://localhost/", 1);
+    paths = CALLOC(FANOUT * FANOUT * FANOUT, sizeof(char *));
+    for (int i = 1; i < ROOT_LINK_TBL->size; i++) {
+        Link *dir_link = ROOT_LINK_TBL->links[i];
+        char *url = Link_get_url(dir_link);
+        LinkTable *dir = bench_LinkTable_new(url, 1);
+        FREE(url);
+        dir->parent_tbl = ROOT_LINK_TBL;
+        dir->parent_link = dir_link;
+        dir_link->next_table = dir;
+        ROOT_LINK_TBL->refcount++;
+        for (int j = 1; j < dir->size; j++) {
+            Link *subdir_link = dir->links[j];
+            url = Link_get_url(subdir_link);
+            LinkTable *subdir = bench_LinkTable_new(url, 0);
+            FREE(url);
+            subdir->parent_tbl = dir;
+            subdir->parent_link = subdir_link;
+            subdir_link->next_table = subdir;
+            dir->refcount++;
+            for (int k = 1; k < subdir->size; k++) {
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "/%s/%s/%s", dir_link->linkname,
+                         subdir_link->linkname, subdir->links[k]->linkname);
+                paths[n_paths++] = STRNDUP(path, PATH_MAX);
+            }
+        }
+    }
+}
+
+static void *bench_thread(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg;
+    long *failures = CALLOC(1, sizeof(long));
+    for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+        /* Favour a working set which fits in the path cache */
+        int n = (rand_r(&seed) & 7) ? n_paths / 16 : n_paths;
+        Link *link = path_to_Link(paths[rand_r(&seed) % n]);
+        if (!link) {
+            (*failures)++;
+            continue;
+        }
+        LinkTable_unref(link->parent_table);
+    }
+    return failures;
+}
+
+static double bench_run(int n_threads)
+{
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+    long failures = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_create(&threads[i], NULL, bench_thread,
+                           (void *)(size_t)(i + 1))) {
+            fprintf(stderr, "pthread_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < n_threads; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        failures += *(long *)ret;
+        FREE(ret);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (failures) {
+        fprintf(stderr, "%ld lookups failed\n", failures);
+        exit(EXIT_FAILURE);
+    }
+    double seconds = (double)(end.tv_sec - start.tv_sec)
+                     + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)n_threads * LOOKUPS_PER_THREAD / seconds;
+}
+
+int main(void)
+{
+    Config_init();
+    bench_tree_new();
+
+    printf("%d paths, %d lookups per thread\n", n_paths, LOOKUPS_PER_THREAD);
+    double base = 0;
+    for (int n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+        double rate = bench_run(n_threads);
+        if (n_threads == 1) {
+            base = rate;
+        }
+        printf("%2d threads: %12.0f lookups/s, %5.2fx\n", n_threads, rate,
+               rate / base);
+    }
+
+    for (int i = 0; i < n_paths; i++) {
+        FREE(paths[i]);
+    }
+    FREE(paths);
+    LinkSystem_cleanup();
+    return 0;
+}
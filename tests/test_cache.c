@@ -149,6 +149,56 @@ void test_Cache_read_null_link(void)
     TEST_ASSERT_EQUAL_INT(-EINVAL, res);
 }
 
+void test_Cache_data_fd(void)
+{
+    Cache cf = {0};
+    Link link = {0};
+    _Atomic(Seg) seg[3] = {1, 0, 1};
+    link.content_length = 10000;
+    cf.link = &link;
+    cf.blksz = 4096;
+    cf.segbc = 3;
+    cf.seg = seg;
+    cf.dfd = 42;
+
+    /* The last segment is cached, the range is cut at the end of the file */
+    size_t len = 4096;
+    TEST_ASSERT_EQUAL_INT(42, Cache_data_fd(&cf, 8192, &len));
+    TEST_ASSERT_EQUAL_size_t(10000 - 8192, len);
+
+    /* The range runs into the second segment, which is not cached */
+    len = 200;
+    TEST_ASSERT_EQUAL_INT(-1, Cache_data_fd(&cf, 4000, &len));
+    len = 100;
+    TEST_ASSERT_EQUAL_INT(-1, Cache_data_fd(&cf, 5000, &len));
+
+    len = 100;
+    TEST_ASSERT_EQUAL_INT(-1, Cache_data_fd(&cf, 10000, &len));
+}
+
+void test_Cache_complete(void)
+{
+    Cache cf = {0};
+    Link link = {0};
+    _Atomic(Seg) seg[3] = {1, 0, 1};
+    link.content_length = 10000;
+    cf.link = &link;
+    cf.blksz = 4096;
+    cf.segbc = 3;
+    cf.seg = seg;
+    cf.dfd = 42;
+    atomic_store(&cf.seg_cached, 2);
+    TEST_ASSERT_FALSE(Cache_complete(&cf));
+
+    /* Once every segment is cached, any range can be read from the file */
+    seg[1] = 1;
+    atomic_store(&cf.seg_cached, 3);
+    TEST_ASSERT_TRUE(Cache_complete(&cf));
+    size_t len = 200;
+    TEST_ASSERT_EQUAL_INT(42, Cache_data_fd(&cf, 4000, &len));
+    TEST_ASSERT_EQUAL_size_t(200, len);
+}
+
 static void cleanup_temp_dir(const char *tmp_cache_dir)
 {
     char filepath[512];
@@ -179,13 +229,11 @@ static void cleanup_temp_dir(const char *tmp_cache_dir)
 static LinkTable *setup_mock_link_table(const char *link_name)
 {
     LinkTable *table = LinkTable_alloc("https://example.com/");
-    Link *link = CALLOC(1, sizeof(Link));
-    link->type = LINK_FILE;
+    Link *link = LinkTable_add(table, link_name, LINK_FILE);
     link->content_length = 100;
-    link->parent_table = table;
-    strncpy(link->linkname, link_name, NAME_MAX);
-    snprintf(link->f_url, PATH_MAX, "https://example.com/%s", link_name);
-    LinkTable_add(table, link);
+    char url[PATH_MAX];
+    snprintf(url, sizeof(url), "https://example.com/%s", link_name);
+    Link_set_url(link, url);
     return table;
 }
 
@@ -243,7 +291,7 @@ void test_Cache_invalid_zero_length_disk_files(void)
     Cache *cf = Cache_open("file.bin");
     TEST_ASSERT_NOT_NULL(cf);
     TEST_ASSERT_NOT_NULL(cf->mfp);
-    TEST_ASSERT_NOT_NULL(cf->dfp);
+    TEST_ASSERT_TRUE(cf->dfd >= 0);
 
     // Verify that the recreated meta file is now not empty (it has valid
     // metadata written)
@@ -272,7 +320,7 @@ void test_Cache_invalid_zero_length_disk_files(void)
     cf = Cache_open("file.bin");
     TEST_ASSERT_NOT_NULL(cf);
     TEST_ASSERT_NOT_NULL(cf->mfp);
-    TEST_ASSERT_NOT_NULL(cf->dfp);
+    TEST_ASSERT_TRUE(cf->dfd >= 0);
 
     // Verify it was again invalidated, recreated, and now has a valid non-zero
     // content_length
@@ -492,6 +540,167 @@ void test_Cache_free_active_downloads_with_waiters(void)
     cleanup_temp_dir(tmp_cache_dir);
 }
 
+void test_LinkTable_disk_save_validators(void)
+{
+    const char *tmp_cache_dir = "./test_cache_linktable_dir";
+    setup_temp_cache_dir(tmp_cache_dir);
+    CacheSystem_init(tmp_cache_dir, 0);
+
+    LinkTable *table = setup_mock_link_table("file.bin");
+    table->index_time = 1234;
+    strncpy(table->etag, "\"abc\"", LINKTABLE_VALIDATOR_LEN - 1);
+    strncpy(table->last_modified, "Wed, 21 Oct 2015 07:28:00 GMT",
+            LINKTABLE_VALIDATOR_LEN - 1);
+    TEST_ASSERT_EQUAL_INT(0, LinkTable_disk_save(table, ""));
+
+    LinkTable *loaded = LinkTable_disk_open("");
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_INT(2, loaded->size);
+    TEST_ASSERT_EQUAL_INT64(1234, loaded->index_time);
+    TEST_ASSERT_EQUAL_STRING("\"abc\"", loaded->etag);
+    TEST_ASSERT_EQUAL_STRING("Wed, 21 Oct 2015 07:28:00 GMT",
+                             loaded->last_modified);
+    TEST_ASSERT_EQUAL_STRING("file.bin", loaded->links[1]->linkname);
+    TEST_ASSERT_EQUAL_STRING("https://example.com/", loaded->links[0]->url);
+    TEST_ASSERT_EQUAL_STRING("file.bin", loaded->links[1]->url);
+    TEST_ASSERT_EQUAL_INT(100, loaded->links[1]->content_length);
+    LinkTable_free(loaded);
+
+    // A corrupted LinkTable is rejected and deleted
+    char path[512];
+    snprintf(path, sizeof(path), "%s/meta/.LinkTable", tmp_cache_dir);
+    struct stat st;
+    TEST_ASSERT_EQUAL_INT(0, stat(path, &st));
+    FILE *fp = fopen(path, "r+");
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_EQUAL_INT(0, fseek(fp, st.st_size - 2, SEEK_SET));
+    TEST_ASSERT_EQUAL_INT('X', fputc('X', fp));
+    TEST_ASSERT_EQUAL_INT(0, fclose(fp));
+    TEST_ASSERT_NULL(LinkTable_disk_open(""));
+    TEST_ASSERT_EQUAL_INT(-1, stat(path, &st));
+
+    // Cleanup
+    LinkTable_free(table);
+    CacheSystem_cleanup();
+    cleanup_temp_dir(tmp_cache_dir);
+}
+
+void test_LinkTable_disk_open_legacy(void)
+{
+    const char *tmp_cache_dir = "./test_cache_linktable_legacy_dir";
+    setup_temp_cache_dir(tmp_cache_dir);
+    CacheSystem_init(tmp_cache_dir, 0);
+
+    // The format with fixed size fields, saved without the validators
+    char path[512];
+    snprintf(path, sizeof(path), "%s/meta/.LinkTable", tmp_cache_dir);
+    FILE *fp = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    int size = 2;
+    time_t index_time = 1234;
+    fwrite(&size, sizeof(int), 1, fp);
+    fwrite(&index_time, sizeof(time_t), 1, fp);
+    const char *names[] = { "", "file.bin" };
+    const char *urls[] = { "https://example.com/",
+                           "https://example.com/file.bin" };
+    LinkType types[] = { LINK_HEAD, LINK_FILE };
+    for (int i = 0; i < size; i++) {
+        char linkname[NAME_MAX] = { 0 };
+        char url[PATH_MAX] = { 0 };
+        size_t content_length = 100;
+        long mtime = 5678;
+        strncpy(linkname, names[i], NAME_MAX - 1);
+        strncpy(url, urls[i], PATH_MAX - 1);
+        fwrite(linkname, sizeof(char), NAME_MAX, fp);
+        fwrite(url, sizeof(char), PATH_MAX, fp);
+        fwrite(&types[i], sizeof(LinkType), 1, fp);
+        fwrite(&content_length, sizeof(size_t), 1, fp);
+        fwrite(&mtime, sizeof(long), 1, fp);
+    }
+    TEST_ASSERT_EQUAL_INT(0, fclose(fp));
+    struct stat legacy_st;
+    TEST_ASSERT_EQUAL_INT(0, stat(path, &legacy_st));
+
+    LinkTable *loaded = LinkTable_disk_open("");
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_INT(2, loaded->size);
+    TEST_ASSERT_EQUAL_INT64(1234, loaded->index_time);
+    TEST_ASSERT_EQUAL_STRING("", loaded->etag);
+    TEST_ASSERT_EQUAL_STRING("file.bin", loaded->links[1]->linkname);
+    TEST_ASSERT_EQUAL_INT(5678, loaded->links[1]->time);
+    LinkTable_free(loaded);
+
+    // It has been converted to the current format, which is much smaller
+    struct stat st;
+    TEST_ASSERT_EQUAL_INT(0, stat(path, &st));
+    TEST_ASSERT_TRUE(st.st_size < legacy_st.st_size);
+    loaded = LinkTable_disk_open("");
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_INT(2, loaded->size);
+    TEST_ASSERT_EQUAL_STRING("file.bin", loaded->links[1]->linkname);
+    TEST_ASSERT_EQUAL_STRING("file.bin", loaded->links[1]->url);
+    TEST_ASSERT_EQUAL_INT(100, loaded->links[1]->content_length);
+    LinkTable_free(loaded);
+
+    // Cleanup
+    (void)unlink(path);
+    CacheSystem_cleanup();
+    cleanup_temp_dir(tmp_cache_dir);
+}
+
+void test_LinkTree_disk_save(void)
+{
+    const char *tmp_cache_dir = "./test_cache_linktree_dir";
+    setup_temp_cache_dir(tmp_cache_dir);
+    CacheSystem_init(tmp_cache_dir, 0);
+
+    LinkTable *root = LinkTable_alloc("https://example.com/");
+    Link *dir_link = LinkTable_add(root, "dir", LINK_DIR);
+    Link_set_url(dir_link, "https://example.com/dir/");
+    LinkTable *dir = LinkTable_alloc("https://example.com/dir/");
+    Link *link = LinkTable_add(dir, "file.bin", LINK_FILE);
+    Link_set_url(link, "https://example.com/dir/file.bin");
+    link->content_length = 100;
+    dir_link->next_table = dir;
+    dir->parent_tbl = root;
+    dir->parent_link = dir_link;
+    root->refcount++;
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+    TEST_ASSERT_EQUAL_INT(0, LinkTree_disk_save());
+    LinkSystem_cleanup();
+    CacheSystem_cleanup();
+
+    // The next mount loads the whole tree without any network access
+    CONFIG.cache_enabled = 1;
+    CONFIG.cache_dir = (char *)tmp_cache_dir;
+    TEST_ASSERT_NOT_NULL(LinkSystem_init("https://example.com/"));
+    TEST_ASSERT_EQUAL_INT(2, ROOT_LINK_TBL->size);
+    dir = ROOT_LINK_TBL->links[1]->next_table;
+    TEST_ASSERT_NOT_NULL(dir);
+    TEST_ASSERT_EQUAL_PTR(ROOT_LINK_TBL, dir->parent_tbl);
+    TEST_ASSERT_EQUAL_PTR(ROOT_LINK_TBL->links[1], dir->parent_link);
+    link = path_to_Link("/dir/file.bin");
+    TEST_ASSERT_NOT_NULL(link);
+    TEST_ASSERT_EQUAL_PTR(dir, link->parent_table);
+    TEST_ASSERT_EQUAL_INT(100, link->content_length);
+    char *url = Link_get_url(link);
+    TEST_ASSERT_EQUAL_STRING("https://example.com/dir/file.bin", url);
+    FREE(url);
+    LinkTable_unref(link->parent_table);
+
+    // Cleanup
+    LinkSystem_cleanup();
+    ROOT_LINK_TBL = old_root_link_tbl;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/meta/.LinkTree", tmp_cache_dir);
+    (void)unlink(path);
+    CacheSystem_cleanup();
+    CONFIG.cache_dir = NULL;
+    cleanup_temp_dir(tmp_cache_dir);
+}
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -502,9 +711,14 @@ int main(void)
     RUN_TEST(test_Cache_read_negative_len);
     RUN_TEST(test_Cache_read_null_cf);
     RUN_TEST(test_Cache_read_null_link);
+    RUN_TEST(test_Cache_data_fd);
+    RUN_TEST(test_Cache_complete);
     RUN_TEST(test_Cache_invalid_zero_length_disk_files);
     RUN_TEST(test_Cache_alloc_num_bg_workers);
     RUN_TEST(test_Cache_free_active_downloads);
     RUN_TEST(test_Cache_free_active_downloads_with_waiters);
+    RUN_TEST(test_LinkTable_disk_save_validators);
+    RUN_TEST(test_LinkTable_disk_open_legacy);
+    RUN_TEST(test_LinkTree_disk_save);
     return UNITY_END();
 }
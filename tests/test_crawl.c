@@ -0,0 +1,240 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+/**
+ * \file test_crawl.c
+ * \brief Unit tests for crawl.c, against a directory tree served locally
+ */
+
+#include "../src/config.h"
+#include "../src/crawl.h"
+#include "../src/link.h"
+#include "../src/network.h"
+#include "../src/util.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+/**
+ * \brief The directory tree the server lists, by path
+ */
+static const char *const crawl_tree[][2] = {
+    {"/", "<a href=\"a/\"></a><a href=\"b/\"></a><a href=\"f.txt\"></a>"},
+    {"/a/", "<a href=\"c/\"></a>"},
+    {"/a/c/", "<a href=\"d/\"></a>"},
+    {"/a/c/d/", ""},
+    {"/b/", ""},
+};
+
+#define CRAWL_LOG_MAX 32
+
+/**
+ * \brief A local HTTP server, which records the listings it sends
+ */
+static struct {
+    int fd;
+    int port;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    char paths[CRAWL_LOG_MAX][16];
+    struct timespec times[CRAWL_LOG_MAX];
+    int n_gets;
+} server = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void server_reply(int fd)
+{
+    char req[4096];
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(req) - 1
+           && (n = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    char method[8] = "";
+    char path[256] = "";
+    sscanf(req, "%7s %255s", method, path);
+
+    const char *body = NULL;
+    for (size_t i = 0; i < sizeof(crawl_tree) / sizeof(crawl_tree[0]); i++) {
+        if (!strcmp(path, crawl_tree[i][0])) {
+            body = crawl_tree[i][1];
+        }
+    }
+    if (!strcmp(path, "/f.txt")) {
+        body = "hello";
+    }
+
+    char head[256];
+    if (!body) {
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                 "Connection: close\r\n\r\n");
+    } else {
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+                 "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                 strlen(body));
+    }
+    int is_get = !strcmp(method, "GET");
+    if (is_get && body && path[strlen(path) - 1] == '/') {
+        pthread_mutex_lock(&server.lock);
+        if (server.n_gets < CRAWL_LOG_MAX) {
+            snprintf(server.paths[server.n_gets], sizeof(server.paths[0]),
+                     "%s", path);
+            clock_gettime(CLOCK_MONOTONIC, &server.times[server.n_gets]);
+            server.n_gets++;
+        }
+        pthread_mutex_unlock(&server.lock);
+    }
+    (void)!write(fd, head, strlen(head));
+    if (is_get && body) {
+        (void)!write(fd, body, strlen(body));
+    }
+}
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    int fd;
+    while ((fd = accept(server.fd, NULL, NULL)) >= 0) {
+        server_reply(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void server_start(void)
+{
+    server.fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL_INT(
+        0, bind(server.fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(server.fd, 16));
+    getsockname(server.fd, (struct sockaddr *)&addr, &addr_len);
+    server.port = ntohs(addr.sin_port);
+    pthread_create(&server.thread, NULL, server_thread, NULL);
+}
+
+static void server_stop(void)
+{
+    /* This makes accept() fail */
+    shutdown(server.fd, SHUT_RDWR);
+    pthread_join(server.thread, NULL);
+    close(server.fd);
+}
+
+/**
+ * \brief Mount the local server, crawl it, and wait for the crawl to finish
+ */
+static void crawl(void)
+{
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", server.port);
+    TEST_ASSERT_NOT_NULL(LinkSystem_init(url));
+    /* The root listing is downloaded before the crawl */
+    pthread_mutex_lock(&server.lock);
+    server.n_gets = 0;
+    pthread_mutex_unlock(&server.lock);
+    Crawler_start();
+    Crawler_wait();
+}
+
+static void assert_crawled(int n, const char *const *paths)
+{
+    TEST_ASSERT_EQUAL_INT(n, server.n_gets);
+    for (int i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_STRING(paths[i], server.paths[i]);
+    }
+}
+
+void setUp(void)
+{
+    Config_init();
+    CONFIG.crawl_conns = 1;
+}
+
+void tearDown(void)
+{
+    LinkSystem_cleanup();
+}
+
+void test_Crawler_breadth_first(void)
+{
+    crawl();
+    /* The directories of one level are crawled before the next level */
+    const char *const paths[] = {"/a/", "/b/", "/a/c/", "/a/c/d/"};
+    assert_crawled(4, paths);
+}
+
+void test_Crawler_depth(void)
+{
+    CONFIG.crawl_depth = 2;
+    crawl();
+    /* The root directory is at depth 0 */
+    const char *const paths[] = {"/a/", "/b/", "/a/c/"};
+    assert_crawled(3, paths);
+}
+
+void test_Crawler_rate(void)
+{
+    CONFIG.crawl_rate = 5;
+    crawl();
+    TEST_ASSERT_EQUAL_INT(4, server.n_gets);
+    /* The directories are started at least 200 ms apart */
+    for (int i = 1; i < server.n_gets; i++) {
+        long gap_ms
+            = (server.times[i].tv_sec - server.times[i - 1].tv_sec) * 1000
+              + (server.times[i].tv_nsec - server.times[i - 1].tv_nsec)
+                    / 1000000;
+        TEST_ASSERT_TRUE(gap_ms >= 190);
+    }
+}
+
+int main(void)
+{
+    Config_init();
+    NetworkSystem_init();
+    server_start();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_Crawler_breadth_first);
+    RUN_TEST(test_Crawler_depth);
+    RUN_TEST(test_Crawler_rate);
+    int res = UNITY_END();
+
+    server_stop();
+    return res;
+}
@@ -27,11 +27,21 @@
  */
 
 #include "../src/config.h"
+#include "../src/html.h"
+#include "../src/json.h"
 #include "../src/link.h"
+#include "../src/network.h"
 #include "../src/util.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
 #include <unity.h>
 
 void setUp(void)
@@ -48,6 +58,13 @@ void tearDown(void)
     }
 }
 
+static void assert_Link_url(const char *expected, const Link *link)
+{
+    char *url = Link_get_url(link);
+    TEST_ASSERT_EQUAL_STRING(expected, url);
+    FREE(url);
+}
+
 /* ========================================================================= */
 /* is_external_url() tests                                                   */
 /* ========================================================================= */
@@ -303,8 +320,7 @@ void test_HTML_external_link_file(void)
     /* Expect 2 entries: head link + one external file link */
     TEST_ASSERT_EQUAL_INT(2, tbl->size);
     TEST_ASSERT_EQUAL_STRING("file.iso", tbl->links[1]->linkname);
-    TEST_ASSERT_EQUAL_STRING("http://external.com/file.iso",
-                             tbl->links[1]->f_url);
+    assert_Link_url("http://external.com/file.iso", tbl->links[1]);
     TEST_ASSERT_EQUAL_INT(LINK_UNINITIALISED_FILE, tbl->links[1]->type);
     LinkTable_free(tbl);
     CONFIG.external_links = 0;
@@ -381,8 +397,7 @@ void test_HTML_external_link_dedup_first_wins(void)
 
     /* Only one link: the first one wins */
     TEST_ASSERT_EQUAL_INT(2, tbl->size);
-    TEST_ASSERT_EQUAL_STRING("http://server-a.com/file.iso",
-                             tbl->links[1]->f_url);
+    assert_Link_url("http://server-a.com/file.iso", tbl->links[1]);
     LinkTable_free(tbl);
     CONFIG.external_links = 0;
 }
@@ -410,19 +425,63 @@ void test_HTML_external_link_dot_and_dotdot(void)
 
 void test_Link_preserves_preset_f_url(void)
 {
-    /* Verify the invariant: a link with f_url pre-set by HTML_to_LinkTable
-     * retains its f_url.  We check this directly on the link struct rather
+    /* Verify the invariant: a link with its URL pre-set by HTML_to_LinkTable
+     * retains its URL.  We check this directly on the link struct rather
      * than calling LinkTable_fill() (which would make real HTTP requests). */
     LinkTable *tbl = LinkTable_alloc("http://localhost/");
 
-    Link *ext = CALLOC(1, sizeof(Link));
-    strncpy(ext->linkname, "file.iso", NAME_MAX);
-    strncpy(ext->linkpath, "file.iso", NAME_MAX);
-    strncpy(ext->f_url, "http://external.com/file.iso", PATH_MAX);
-    ext->type = LINK_UNINITIALISED_FILE;
-    LinkTable_add(tbl, ext);
+    Link *ext = LinkTable_add(tbl, "file.iso", LINK_UNINITIALISED_FILE);
+    Link_set_url(ext, "http://external.com/file.iso");
 
-    TEST_ASSERT_EQUAL_STRING("http://external.com/file.iso", ext->f_url);
+    TEST_ASSERT_TRUE(ext->url_absolute);
+    assert_Link_url("http://external.com/file.iso", ext);
+    LinkTable_free(tbl);
+}
+
+void test_Link_url_relative(void)
+{
+    LinkTable *tbl = LinkTable_alloc("http://localhost/dir/");
+    Link *file = LinkTable_add(tbl, "a b.txt", LINK_FILE);
+    Link_set_url(file, "http://localhost/dir/a%20b.txt");
+    Link *dir = LinkTable_add(tbl, "sub/", LINK_DIR);
+    Link_set_url(dir, "http://localhost/dir/sub/");
+    Link *same = LinkTable_add(tbl, "c.txt", LINK_FILE);
+    Link_set_url(same, "http://localhost/dir/c.txt");
+
+    /* Only the part after the URL of the LinkTable is stored */
+    TEST_ASSERT_FALSE(file->url_absolute);
+    TEST_ASSERT_EQUAL_STRING("a%20b.txt", file->url);
+    assert_Link_url("http://localhost/dir/a%20b.txt", file);
+    TEST_ASSERT_EQUAL_STRING("sub", dir->linkname);
+    TEST_ASSERT_EQUAL_STRING("sub/", dir->url);
+    assert_Link_url("http://localhost/dir/sub/", dir);
+    /* The name is shared when it is the same as the URL */
+    TEST_ASSERT_EQUAL_PTR(same->linkname, same->url);
+    assert_Link_url("http://localhost/dir/c.txt", same);
+
+    TEST_ASSERT_TRUE(tbl->links[0]->url_absolute);
+    assert_Link_url("http://localhost/dir/", tbl->links[0]);
+    LinkTable_free(tbl);
+}
+
+void test_LinkTable_fill_escaped_href(void)
+{
+    const char *url = "http://localhost/dir/";
+    LinkTable *tbl = LinkTable_alloc(url);
+    LinkTable_parse_html(tbl, url,
+                         "<a href=\"a%20b.txt\"></a><a href=\"c.txt\"></a>"
+                         "<a href=\"sub%20dir/\"></a>");
+    LinkTable_fill(tbl, NULL);
+
+    Link *file = tbl->links[1];
+    TEST_ASSERT_EQUAL_STRING("a b.txt", file->linkname);
+    TEST_ASSERT_NOT_EQUAL(file->linkname, file->url);
+    assert_Link_url("http://localhost/dir/a%20b.txt", file);
+    /* The name is only shared with the URL if it does not need escaping */
+    TEST_ASSERT_EQUAL_PTR(tbl->links[2]->linkname, tbl->links[2]->url);
+    assert_Link_url("http://localhost/dir/c.txt", tbl->links[2]);
+    TEST_ASSERT_EQUAL_STRING("sub dir", tbl->links[3]->linkname);
+    assert_Link_url("http://localhost/dir/sub%20dir/", tbl->links[3]);
     LinkTable_free(tbl);
 }
 
@@ -465,8 +524,7 @@ void test_LinkTable_alloc(void)
     TEST_ASSERT_EQUAL_INT(1, table->size);
     TEST_ASSERT_NOT_NULL(table->links);
     TEST_ASSERT_NOT_NULL(table->links[0]);
-    TEST_ASSERT_EQUAL_STRING("https://example.com/dir/",
-                             table->links[0]->f_url);
+    assert_Link_url("https://example.com/dir/", table->links[0]);
     TEST_ASSERT_EQUAL_STRING("", table->links[0]->linkname);
     LinkTable_free(table);
 }
@@ -477,35 +535,60 @@ void test_LinkTable_add(void)
     TEST_ASSERT_NOT_NULL(table);
     TEST_ASSERT_EQUAL_INT(1, table->size);
 
-    Link *new_link = CALLOC(1, sizeof(Link));
+    Link *new_link = LinkTable_add(table, "file.txt", LINK_FILE);
     TEST_ASSERT_NOT_NULL(new_link);
-    strncpy(new_link->linkname, "file.txt", NAME_MAX);
-    new_link->type = LINK_FILE;
-
-    LinkTable_add(table, new_link);
 
     TEST_ASSERT_EQUAL_INT(2, table->size);
     TEST_ASSERT_EQUAL_PTR(new_link, table->links[1]);
+    TEST_ASSERT_EQUAL_PTR(table, new_link->parent_table);
+    TEST_ASSERT_EQUAL_STRING("file.txt", new_link->linkname);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, new_link->type);
+
+    /* Links keep their addresses as the LinkTable grows */
+    for (int i = 0; i < 1000; i++) {
+        LinkTable_add(table, "x", LINK_FILE);
+    }
+    TEST_ASSERT_EQUAL_PTR(new_link, table->links[1]);
+    TEST_ASSERT_EQUAL_STRING("file.txt", new_link->linkname);
 
     LinkTable_free(table);
 }
 
 void test_Link_download_zero_length(void)
 {
-    Link link = {0};
-    link.content_length = 0;
-    link.type = LINK_FILE;
-    strncpy(link.linkname, "empty.txt", NAME_MAX);
-    strncpy(link.f_url, "https://example.com/empty.txt", PATH_MAX);
+    LinkTable *table = LinkTable_alloc("https://example.com/");
+    Link *link = LinkTable_add(table, "empty.txt", LINK_FILE);
+    Link_set_url(link, "https://example.com/empty.txt");
 
     char buf[10];
     memset(buf, 0xff, sizeof(buf));
-    long res = Link_download(&link, buf, sizeof(buf), 0, NULL);
+    long res = Link_download(link, buf, sizeof(buf), 0, NULL);
     TEST_ASSERT_EQUAL_INT(0, res);
 
     for (size_t i = 0; i < sizeof(buf); i++) {
         TEST_ASSERT_EQUAL_HEX8(0xff, (unsigned char)buf[i]);
     }
+    LinkTable_free(table);
+}
+
+static void download_async_callback(const char *buf, long recv,
+                                    void *userdata)
+{
+    TEST_ASSERT_NULL(buf);
+    *(long *)userdata = recv;
+}
+
+void test_Link_download_async_zero_length(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/");
+    Link *link = LinkTable_add(table, "empty.txt", LINK_FILE);
+    Link_set_url(link, "https://example.com/empty.txt");
+
+    /* There is nothing to download, so the callback is called straight away */
+    long res = -1;
+    Link_download_async(link, 10, 0, download_async_callback, &res);
+    TEST_ASSERT_EQUAL_INT(0, res);
+    LinkTable_free(table);
 }
 
 void test_link_linknames_equal(void)
@@ -559,6 +642,61 @@ void test_LinkHashSet(void)
     LinkHashSet_free(set);
 }
 
+void test_LinkHashSet_get(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/dir/");
+    LinkTable_parse_html(table, "https://example.com/dir/",
+                         "<a href=\"a.txt\"></a><a href=\"b/\"></a>");
+    TEST_ASSERT_EQUAL_INT(3, table->size);
+
+    LinkHashSet *set = LinkHashSet_new(2);
+    for (int i = 1; i < table->size; i++) {
+        TEST_ASSERT_EQUAL_INT(1, LinkHashSet_add_link(
+                                     set, table->links[i]->linkname,
+                                     table->links[i]));
+    }
+    TEST_ASSERT_EQUAL_INT(1, LinkHashSet_add(set, "c.txt"));
+    // Trigger a resize, the stored Links must survive it
+    TEST_ASSERT_EQUAL_INT(1, LinkHashSet_add(set, "d.txt"));
+    TEST_ASSERT_EQUAL_INT(0, LinkHashSet_add_link(set, "a.txt", NULL));
+
+    TEST_ASSERT_EQUAL_PTR(table->links[1], LinkHashSet_get(set, "a.txt"));
+    TEST_ASSERT_EQUAL_PTR(table->links[2], LinkHashSet_get(set, "b"));
+    TEST_ASSERT_EQUAL_PTR(table->links[2], LinkHashSet_get(set, "b/"));
+    TEST_ASSERT_NULL(LinkHashSet_get(set, "c.txt"));
+    TEST_ASSERT_NULL(LinkHashSet_get(set, "missing.txt"));
+
+    LinkHashSet_free(set);
+    LinkTable_free(table);
+}
+
+void test_LinkTable_lookup(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/dir/");
+    char html[64 * 32] = "";
+    for (int i = 0; i < 64; i++) {
+        char a[32];
+        snprintf(a, sizeof(a), "<a href=\"f%d\"></a>", i);
+        strcat(html, a);
+    }
+    LinkTable_parse_html(table, "https://example.com/dir/", html);
+    TEST_ASSERT_EQUAL_INT(65, table->size);
+
+    for (int i = 1; i < table->size; i++) {
+        Link *link = table->links[i];
+        TEST_ASSERT_EQUAL_PTR(link, LinkTable_lookup(table, link->linkname));
+    }
+    TEST_ASSERT_NULL(LinkTable_lookup(table, "f64"));
+    TEST_ASSERT_NULL(LinkTable_lookup(table, ""));
+
+    // The index is rebuilt when more Links are added
+    LinkTable_parse_html(table, "https://example.com/dir/",
+                         "<a href=\"f64\"></a>");
+    TEST_ASSERT_EQUAL_PTR(table->links[65], LinkTable_lookup(table, "f64"));
+
+    LinkTable_free(table);
+}
+
 void test_LinkTable_parse_html_duplicates(void)
 {
     LinkTable *table = LinkTable_alloc("https://example.com/dir/");
@@ -587,8 +725,804 @@ void test_LinkTable_parse_html_duplicates(void)
     LinkTable_free(table);
 }
 
+void test_LinkTable_parse_html_skips_non_markup(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/dir/");
+    const char *html
+        = "<!DOCTYPE html><html><head><title><a href=\"t.txt\"></title>\n"
+          "<script>var s = '<a href=\"s.txt\">'; if (a </b) {}</script>\n"
+          "<style>a[href=\"c.txt\"] {}</style></head>\n"
+          "<body><!-- <a href=\"comment.txt\"> -- > -->\n"
+          "<A class=x HREF=one.txt>1</A>\n"
+          "<a data-x='>' href='two&amp;three.txt' href=\"ignored.txt\">\n"
+          "<a\nhref\n=\n\"f&#111;&#x6F;.txt\"/>\n"
+          "<area href=\"area.txt\"><abbr href=\"abbr.txt\">\n"
+          "</body></html>\n";
+
+    LinkTable_parse_html(table, "https://example.com/dir/", html);
+
+    TEST_ASSERT_EQUAL_INT(4, table->size);
+    TEST_ASSERT_EQUAL_STRING("one.txt", table->links[1]->linkname);
+    TEST_ASSERT_EQUAL_STRING("two&three.txt", table->links[2]->linkname);
+    TEST_ASSERT_EQUAL_STRING("foo.txt", table->links[3]->linkname);
+
+    LinkTable_free(table);
+}
+
+static void count_html_href(void *userdata, const char *href)
+{
+    int *count = userdata;
+    TEST_ASSERT_EQUAL_STRING("a b.txt", href);
+    (*count)++;
+}
+
+void test_HtmlLinks_feed_byte_by_byte(void)
+{
+    const char *html = "<p>x</p><!----><script></scripts><a href=x>"
+                       "</script><a href=\"a&#32;b.txt\">";
+    int count = 0;
+    HtmlLinks *parser = HtmlLinks_new(count_html_href, &count);
+    for (size_t i = 0; i < strlen(html); i++) {
+        HtmlLinks_feed(parser, html + i, 1);
+    }
+    HtmlLinks_free(parser);
+    TEST_ASSERT_EQUAL_INT(1, count);
+}
+
+static LinkTable *attach_child_table(LinkTable *parent, Link *link)
+{
+    char *url = Link_get_url(link);
+    LinkTable *child = LinkTable_alloc(url);
+    FREE(url);
+    child->parent_tbl = parent;
+    child->parent_link = link;
+    link->next_table = child;
+    parent->refcount++;
+    return child;
+}
+
+void test_LinkTable_replace(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *old_tbl = LinkTable_alloc(url);
+    LinkTable_parse_html(old_tbl, url,
+                         "<a href=\"kept/\"></a><a href=\"gone/\"></a>"
+                         "<a href=\"a.txt\"></a>");
+    LinkTable_fill(old_tbl, NULL);
+    LinkTable *new_tbl = LinkTable_alloc(url);
+    LinkTable_parse_html(new_tbl, url,
+                         "<a href=\"new/\"></a><a href=\"kept/\"></a>"
+                         "<a href=\"a.txt\"></a>");
+    LinkTable_fill(new_tbl, NULL);
+    TEST_ASSERT_EQUAL_INT(4, old_tbl->size);
+    TEST_ASSERT_EQUAL_INT(4, new_tbl->size);
+
+    Link *kept_link = old_tbl->links[1];
+    Link *a_link = old_tbl->links[3];
+    a_link->type = LINK_FILE;
+    a_link->content_length = 1;
+    new_tbl->links[3]->type = LINK_FILE;
+    new_tbl->links[3]->content_length = 2;
+    LinkTable *kept = attach_child_table(old_tbl, kept_link);
+    attach_child_table(old_tbl, old_tbl->links[2]);
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = old_tbl;
+
+    /* new_tbl and the "gone" subdirectory are freed here */
+    LinkTable_replace(old_tbl, new_tbl);
+
+    TEST_ASSERT_EQUAL_PTR(old_tbl, ROOT_LINK_TBL);
+    TEST_ASSERT_EQUAL_INT(4, old_tbl->size);
+    TEST_ASSERT_EQUAL_STRING("new", old_tbl->links[1]->linkname);
+    TEST_ASSERT_EQUAL_PTR(old_tbl, old_tbl->links[1]->parent_table);
+    TEST_ASSERT_NULL(old_tbl->links[1]->next_table);
+    /* The entries which are still listed keep their Links */
+    TEST_ASSERT_EQUAL_PTR(kept_link, old_tbl->links[2]);
+    TEST_ASSERT_EQUAL_PTR(kept, kept_link->next_table);
+    TEST_ASSERT_EQUAL_PTR(kept_link, kept->parent_link);
+    TEST_ASSERT_EQUAL_PTR(a_link, old_tbl->links[3]);
+    TEST_ASSERT_EQUAL_UINT64(2, a_link->content_length);
+    TEST_ASSERT_EQUAL_PTR(a_link, LinkTable_lookup(old_tbl, "a.txt"));
+    TEST_ASSERT_EQUAL_INT(1, old_tbl->refcount);
+
+    char *new_url = Link_get_url(old_tbl->links[1]);
+    TEST_ASSERT_EQUAL_STRING("https://example.com/new/", new_url);
+    FREE(new_url);
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(old_tbl);
+}
+
+static Link *replaced_dir_link;
+static LinkTable *replaced_tbl;
+static int replaced_n_added;
+static const char *replaced_added;
+static const char *replaced_removed;
+static Link *replaced_changed;
+
+static void replace_callback(Link *dir_link, LinkTable *linktbl,
+                             const LinkTableDiff *diff)
+{
+    replaced_dir_link = dir_link;
+    replaced_tbl = linktbl;
+    replaced_n_added = diff->n_added;
+    TEST_ASSERT_EQUAL_INT(1, diff->n_added);
+    TEST_ASSERT_EQUAL_INT(1, diff->n_removed);
+    TEST_ASSERT_EQUAL_INT(1, diff->n_changed);
+    replaced_added = diff->added[0]->linkname;
+    replaced_removed = diff->removed[0]->linkname;
+    replaced_changed = diff->changed[0];
+    TEST_ASSERT_EQUAL_PTR(linktbl, dir_link->next_table);
+}
+
+void test_LinkSystem_on_replace(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"a/\"></a>");
+    LinkTable *a = attach_child_table(root, root->links[1]);
+    LinkTable_parse_html(a, a->links[0]->url,
+                         "<a href=\"f.txt\"></a><a href=\"g.txt\"></a>");
+    LinkTable_fill(a, NULL);
+    LinkTable *a2 = LinkTable_alloc(a->links[0]->url);
+    LinkTable_parse_html(a2, a2->links[0]->url,
+                         "<a href=\"g.txt\"></a><a href=\"h.txt\"></a>");
+    LinkTable_fill(a2, NULL);
+    a2->links[1]->type = LINK_FILE;
+    Link *g = a->links[2];
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    LinkSystem_on_replace(replace_callback);
+    LinkTable_replace(a, a2);
+    LinkSystem_on_replace(NULL);
+    TEST_ASSERT_EQUAL_PTR(root->links[1], replaced_dir_link);
+    TEST_ASSERT_EQUAL_PTR(a, replaced_tbl);
+    TEST_ASSERT_EQUAL_INT(1, replaced_n_added);
+    TEST_ASSERT_EQUAL_STRING("h.txt", replaced_added);
+    /* The Link of a removed entry stays valid with its LinkTable */
+    TEST_ASSERT_EQUAL_STRING("f.txt", replaced_removed);
+    TEST_ASSERT_EQUAL_PTR(g, replaced_changed);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, g->type);
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(root);
+}
+
+static pthread_mutex_t slow_replace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slow_replace_cond = PTHREAD_COND_INITIALIZER;
+static int slow_replace_entered;
+static int slow_replace_returned;
+
+static void slow_replace_callback(Link *dir_link, LinkTable *linktbl,
+                                  const LinkTableDiff *diff)
+{
+    (void)dir_link;
+    (void)linktbl;
+    (void)diff;
+    pthread_mutex_lock(&slow_replace_lock);
+    slow_replace_entered = 1;
+    pthread_cond_broadcast(&slow_replace_cond);
+    pthread_mutex_unlock(&slow_replace_lock);
+
+    usleep(100000);
+
+    pthread_mutex_lock(&slow_replace_lock);
+    slow_replace_returned = 1;
+    pthread_mutex_unlock(&slow_replace_lock);
+}
+
+static void *replace_thread(void *arg)
+{
+    LinkTable **tables = arg;
+    LinkTable_replace(tables[0], tables[1]);
+    return NULL;
+}
+
+void test_LinkSystem_on_replace_wait(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"a/\"></a>");
+    LinkTable *a = attach_child_table(root, root->links[1]);
+    LinkTable_parse_html(a, a->links[0]->url, "<a href=\"f.txt\"></a>");
+    LinkTable_fill(a, NULL);
+    LinkTable *a2 = LinkTable_alloc(a->links[0]->url);
+    LinkTable_parse_html(a2, a2->links[0]->url, "<a href=\"g.txt\"></a>");
+    LinkTable_fill(a2, NULL);
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    LinkSystem_on_replace(slow_replace_callback);
+    LinkTable *tables[] = {a, a2};
+    pthread_t thread;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, replace_thread,
+                                            tables));
+    pthread_mutex_lock(&slow_replace_lock);
+    while (!slow_replace_entered) {
+        pthread_cond_wait(&slow_replace_cond, &slow_replace_lock);
+    }
+    pthread_mutex_unlock(&slow_replace_lock);
+
+    /* The callback is still running, it must return before this does */
+    LinkSystem_on_replace(NULL);
+    pthread_mutex_lock(&slow_replace_lock);
+    TEST_ASSERT_EQUAL_INT(1, slow_replace_returned);
+    pthread_mutex_unlock(&slow_replace_lock);
+    pthread_join(thread, NULL);
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(root);
+}
+
+void test_path_to_Link_cache(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *old_tbl = LinkTable_alloc(url);
+    LinkTable_parse_html(old_tbl, url, "<a href=\"a.txt\"></a>");
+    LinkTable *new_tbl = LinkTable_alloc(url);
+    LinkTable_parse_html(new_tbl, url, "<a href=\"b.txt\"></a>"
+                                       "<a href=\"a.txt\"></a>");
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = old_tbl;
+
+    Link *link = path_to_Link("/a.txt");
+    TEST_ASSERT_EQUAL_PTR(old_tbl->links[1], link);
+    LinkTable_unref(link->parent_table);
+    /* This is served by the path cache */
+    link = path_to_Link("/a.txt");
+    TEST_ASSERT_EQUAL_PTR(old_tbl->links[1], link);
+    TEST_ASSERT_EQUAL_INT(1, old_tbl->refcount);
+    LinkTable_unref(link->parent_table);
+    TEST_ASSERT_NULL(path_to_Link("/b.txt"));
+
+    /* Refreshing the table invalidates the cached lookups */
+    Link *a = old_tbl->links[1];
+    LinkTable_replace(old_tbl, new_tbl);
+    link = path_to_Link("/a.txt");
+    TEST_ASSERT_EQUAL_PTR(a, link);
+    LinkTable_unref(link->parent_table);
+    link = path_to_Link("/b.txt");
+    TEST_ASSERT_EQUAL_PTR(old_tbl->links[1], link);
+    LinkTable_unref(link->parent_table);
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(old_tbl);
+}
+
+void test_Link_get_path(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"a/\"></a>");
+    LinkTable *a = attach_child_table(root, root->links[1]);
+    LinkTable_parse_html(a, a->links[0]->url, "<a href=\"f.txt\"></a>");
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    Link *link = LinkTable_find(a, "f.txt");
+    TEST_ASSERT_EQUAL_PTR(a->links[1], link);
+    TEST_ASSERT_EQUAL_INT(1, a->refcount);
+    TEST_ASSERT_NULL(LinkTable_find(a, "g.txt"));
+    char *path = Link_get_path(link);
+    TEST_ASSERT_EQUAL_STRING("/a/f.txt", path);
+    FREE(path);
+    LinkTable_unref(a);
+
+    /* A table which is no longer in the tree has no path */
+    a->parent_link = NULL;
+    TEST_ASSERT_NULL(Link_get_path(a->links[1]));
+    a->parent_link = root->links[1];
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(root);
+}
+
+void test_LinkTable_evict(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"a/\"></a><a href=\"b/\"></a>");
+    LinkTable *a = attach_child_table(root, root->links[1]);
+    LinkTable *b = attach_child_table(root, root->links[2]);
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+    size_t resident = LinkSystem_resident_bytes();
+    unsigned long evictions = LinkSystem_evictions();
+
+    /* The refreshed tables count as resident */
+    LinkTable *b2 = LinkTable_alloc(b->links[0]->url);
+    LinkTable_parse_html(b2, b2->links[0]->url, "<a href=\"x.txt\"></a>");
+    LinkTable_replace(b, b2);
+    TEST_ASSERT_TRUE(LinkSystem_resident_bytes() > resident);
+    LinkTable_ref(b);
+
+    /* Only the table nobody holds a reference to can be evicted */
+    CONFIG.dir_mem_limit = 1;
+    LinkTable *a2 = LinkTable_alloc(a->links[0]->url);
+    LinkTable_replace(a, a2);
+    TEST_ASSERT_NULL(root->links[1]->next_table);
+    TEST_ASSERT_EQUAL_PTR(b, root->links[2]->next_table);
+    TEST_ASSERT_EQUAL_UINT(evictions + 1, LinkSystem_evictions());
+    TEST_ASSERT_EQUAL_INT(1, root->refcount);
+
+    CONFIG.dir_mem_limit = 0;
+    LinkTable_unref(b);
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(root);
+    TEST_ASSERT_EQUAL_UINT(resident, LinkSystem_resident_bytes());
+}
+
+void test_Link_probe_failed(void)
+{
+    LinkTable *linktbl = LinkTable_alloc("https://example.com/");
+    Link *link = LinkTable_add(linktbl, "broken", LINK_UNINITIALISED_FILE);
+
+    /* The delay doubles with each failure in a row */
+    time_t now = time(NULL);
+    Link_probe_failed(link);
+    TEST_ASSERT_EQUAL_INT(LINK_INVALID, link->type);
+    TEST_ASSERT_EQUAL_INT(1, link->probe_failures);
+    TEST_ASSERT_TRUE(link->probe_time >= now + CONFIG.http_wait_sec);
+    TEST_ASSERT_TRUE(link->probe_time <= time(NULL) + CONFIG.http_wait_sec);
+    Link_probe_failed(link);
+    TEST_ASSERT_TRUE(link->probe_time >= now + 2 * CONFIG.http_wait_sec);
+
+    /* It is capped at the refresh timeout */
+    for (int i = 0; i < 64; i++) {
+        Link_probe_failed(link);
+    }
+    TEST_ASSERT_TRUE(link->probe_time <= time(NULL) + CONFIG.refresh_timeout);
+    TEST_ASSERT_TRUE(link->probe_time >= now + CONFIG.refresh_timeout);
+
+    LinkTable_free(linktbl);
+}
+
+/** \brief A server which answers a single request with a canned response */
+typedef struct {
+    int fd;
+    const char *response;
+} ProbeServer;
+
+static void *probe_server_thread(void *arg)
+{
+    ProbeServer *server = arg;
+    int fd = accept(server->fd, NULL, NULL);
+    char req[4096];
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(req) - 1
+           && (n = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT((int)strlen(server->response),
+                          (int)write(fd, server->response,
+                                     strlen(server->response)));
+    close(fd);
+    return NULL;
+}
+
+/**
+ * \brief Start a local server which answers a single request with the
+ * response
+ * \param[out] url the URL of the server
+ */
+static void probe_server_start(ProbeServer *server, pthread_t *thread,
+                               char *url, size_t url_size)
+{
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL_INT(
+        0, bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(server->fd, 1));
+    getsockname(server->fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_create(thread, NULL, probe_server_thread, server);
+    snprintf(url, url_size, "http://127.0.0.1:%d/", ntohs(addr.sin_port));
+}
+
+/**
+ * \brief Send a HEAD request to a local server which gives the response
+ */
+static CURL *probe_response(const char *response)
+{
+    ProbeServer server = {.response = response};
+    pthread_t thread;
+    char base_url[64];
+    probe_server_start(&server, &thread, base_url, sizeof(base_url));
+    char url[80];
+    snprintf(url, sizeof(url), "%sbroken", base_url);
+
+    CURL *curl = curl_easy_init();
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    TEST_ASSERT_EQUAL_INT(CURLE_OK, curl_easy_perform(curl));
+    pthread_join(thread, NULL);
+    close(server.fd);
+    return curl;
+}
+
+void test_Link_set_file_stat_no_content_length(void)
+{
+    LinkTable *linktbl = LinkTable_alloc("http://localhost/");
+    Link *link = LinkTable_add(linktbl, "broken", LINK_UNINITIALISED_FILE);
+
+    /* A file without a size keeps failing, so its backoff keeps growing */
+    for (int i = 1; i <= 2; i++) {
+        CURL *curl = probe_response("HTTP/1.1 200 OK\r\n"
+                                    "Connection: close\r\n\r\n");
+        Link_set_file_stat(link, curl);
+        curl_easy_cleanup(curl);
+        TEST_ASSERT_EQUAL_INT(LINK_INVALID, link->type);
+        TEST_ASSERT_EQUAL_INT(i, link->probe_failures);
+        link->type = LINK_UNINITIALISED_FILE;
+    }
+
+    /* A successful probe resets it */
+    CURL *curl = probe_response("HTTP/1.1 200 OK\r\n"
+                                "Content-Length: 5\r\n\r\n");
+    Link_set_file_stat(link, curl);
+    curl_easy_cleanup(curl);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, link->type);
+    TEST_ASSERT_EQUAL_INT(5, link->content_length);
+    TEST_ASSERT_EQUAL_INT(0, link->probe_failures);
+
+    LinkTable_free(linktbl);
+}
+
+void test_Link_restat(void)
+{
+    ProbeServer server = {.response = "HTTP/1.1 200 OK\r\n"
+                                      "Content-Length: 7\r\n"
+                                      "Connection: close\r\n\r\n"};
+    pthread_t thread;
+    char url[64];
+    probe_server_start(&server, &thread, url, sizeof(url));
+
+    LinkTable *stale = LinkTable_alloc(url);
+    LinkTable_parse_html(stale, url, "<a href=\"f.txt\"></a>");
+    LinkTable_fill(stale, NULL);
+    stale->links[1]->content_length = 5;
+    stale->links[1]->type = LINK_FILE;
+
+    /* The refreshed listing keeps the size, but the file has to be checked */
+    LinkTable *linktbl = LinkTable_alloc(url);
+    LinkTable_parse_html(linktbl, url, "<a href=\"f.txt\"></a>");
+    LinkTable_fill(linktbl, stale);
+    Link *link = linktbl->links[1];
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, link->type);
+    TEST_ASSERT_EQUAL_INT(5, link->content_length);
+    TEST_ASSERT_TRUE(link->restat);
+
+    Link_restat(link);
+    pthread_join(thread, NULL);
+    close(server.fd);
+    TEST_ASSERT_EQUAL_INT(7, link->content_length);
+    TEST_ASSERT_FALSE(link->restat);
+
+    /* It is only stat'ed once, the server has gone */
+    Link_restat(link);
+    TEST_ASSERT_EQUAL_INT(7, link->content_length);
+
+    LinkTable_free(linktbl);
+    LinkTable_free(stale);
+}
+
+/**
+ * \brief A local server, which lists a directory with a single file in it
+ */
+typedef struct {
+    int fd;
+    pthread_t thread;
+    /** \brief The body of a directory listing */
+    const char *listing;
+    /** \brief The body of the file */
+    const char *file;
+    /** \brief How long each request waits before it is answered */
+    useconds_t delay;
+    pthread_mutex_t lock;
+    /** \brief The number of listings sent */
+    int n_listings;
+} ListingServer;
+
+static void listing_server_reply(ListingServer *server, int fd)
+{
+    char req[4096];
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(req) - 1
+           && (n = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    char method[8] = "";
+    char path[256] = "";
+    sscanf(req, "%7s %255s", method, path);
+    usleep(server->delay);
+
+    int is_listing = path[0] && path[strlen(path) - 1] == '/';
+    const char *body = is_listing ? server->listing : server->file;
+    int is_get = !strcmp(method, "GET");
+    if (is_get && is_listing) {
+        pthread_mutex_lock(&server->lock);
+        server->n_listings++;
+        pthread_mutex_unlock(&server->lock);
+    }
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+             strlen(body));
+    (void)!write(fd, head, strlen(head));
+    if (is_get) {
+        (void)!write(fd, body, strlen(body));
+    }
+}
+
+static void *listing_server_thread(void *arg)
+{
+    ListingServer *server = arg;
+    int fd;
+    while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+        listing_server_reply(server, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * \brief Start a ListingServer, and make a directory of it the root of the
+ * tree
+ * \return the root LinkTable, which lists the directory "d/"
+ */
+static LinkTable *listing_server_start(ListingServer *server)
+{
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL_INT(
+        0, bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(server->fd, 16));
+    getsockname(server->fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_create(&server->thread, NULL, listing_server_thread, server);
+
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", ntohs(addr.sin_port));
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"d/\"></a>");
+    LinkTable_fill(root, NULL);
+    root->links[1]->type = LINK_DIR;
+    return root;
+}
+
+static void listing_server_stop(ListingServer *server)
+{
+    /* This makes accept() fail */
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    pthread_mutex_destroy(&server->lock);
+}
+
+static void *path_to_LinkTable_thread(void *arg)
+{
+    (void)arg;
+    return path_to_LinkTable("/d/");
+}
+
+void test_LinkTable_build_single_flight(void)
+{
+    /* The listing is slow, so the threads all ask for it at once */
+    ListingServer server
+        = {.listing = "<p>empty</p>", .file = "", .delay = 200000};
+    LinkTable *root = listing_server_start(&server);
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL,
+                                                path_to_LinkTable_thread,
+                                                NULL));
+    }
+    LinkTable *tables[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], (void **)&tables[i]);
+    }
+
+    /* The listing is only downloaded once, every thread gets its table */
+    LinkTable *d = root->links[1]->next_table;
+    TEST_ASSERT_NOT_NULL(d);
+    TEST_ASSERT_EQUAL_INT(1, server.n_listings);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_PTR(d, tables[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(4, d->refcount);
+    for (int i = 0; i < 4; i++) {
+        LinkTable_unref(tables[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(0, d->refcount);
+    /* The only reference left to the root is the one of its child */
+    TEST_ASSERT_EQUAL_INT(1, root->refcount);
+
+    LinkSystem_cleanup();
+    ROOT_LINK_TBL = old_root_link_tbl;
+    listing_server_stop(&server);
+}
+
+void test_Link_wait_file_stat(void)
+{
+    /* The file is stat'ed slowly, so it is looked up before it has been */
+    ListingServer server = {.listing = "<a href=\"f.txt\"></a>",
+                            .file = "hello",
+                            .delay = 300000};
+    LinkTable *root = listing_server_start(&server);
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    Link *link = path_to_Link("/d/f.txt");
+    TEST_ASSERT_NOT_NULL(link);
+    TEST_ASSERT_EQUAL_INT(LINK_UNINITIALISED_FILE, link->type);
+
+    /* The size is only read once the fill worker has stat'ed the file */
+    Link_wait_file_stat(link);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, link->type);
+    TEST_ASSERT_EQUAL_INT(5, link->content_length);
+    LinkTable_unref(link->parent_table);
+
+    LinkSystem_cleanup();
+    ROOT_LINK_TBL = old_root_link_tbl;
+    listing_server_stop(&server);
+}
+
+static void *path_to_Link_thread(void *arg)
+{
+    LinkTable *sub = arg;
+    for (int i = 0; i < 1000; i++) {
+        Link *link = path_to_Link(i % 2 ? "/sub/b.txt" : "/a.txt");
+        if (!link) {
+            return NULL;
+        }
+        LinkTable_unref(link->parent_table);
+        if (i % 2 && link != sub->links[1]) {
+            return NULL;
+        }
+    }
+    return arg;
+}
+
+void test_path_to_Link_concurrent(void)
+{
+    const char *url = "https://example.com/";
+    LinkTable *root = LinkTable_alloc(url);
+    LinkTable_parse_html(root, url, "<a href=\"a.txt\"></a>"
+                                    "<a href=\"sub/\"></a>");
+    LinkTable *sub = attach_child_table(root, root->links[2]);
+    LinkTable_parse_html(sub, sub->links[0]->url, "<a href=\"b.txt\"></a>");
+
+    LinkTable *old_root_link_tbl = ROOT_LINK_TBL;
+    ROOT_LINK_TBL = root;
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL,
+                                                path_to_Link_thread, sub));
+    }
+    for (int i = 0; i < 4; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        TEST_ASSERT_EQUAL_PTR(sub, ret);
+    }
+    TEST_ASSERT_EQUAL_INT(1, root->refcount);
+    TEST_ASSERT_EQUAL_INT(0, sub->refcount);
+
+    /* b.txt only exists in the subdirectory */
+    TEST_ASSERT_NULL(path_to_Link("/b.txt"));
+    /* A missing name does not keep the references taken on the way */
+    TEST_ASSERT_NULL(path_to_Link("/sub/c.txt"));
+    TEST_ASSERT_NULL(path_to_Link("/missing/c.txt"));
+    TEST_ASSERT_EQUAL_INT(1, root->refcount);
+    TEST_ASSERT_EQUAL_INT(0, sub->refcount);
+
+    ROOT_LINK_TBL = old_root_link_tbl;
+    LinkTable_free(root);
+}
+
+/* ========================================================================= */
+/* JSON directory listing tests                                              */
+/* ========================================================================= */
+
+void test_LinkTable_parse_json(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/dir/");
+    const char *json
+        = "[\n"
+          "{ \"name\":\"sub dir\", \"type\":\"directory\", "
+          "\"mtime\":\"Mon, 02 Jan 2023 03:04:05 GMT\" },\n"
+          "{ \"name\":\"a.txt\", \"type\":\"file\", "
+          "\"mtime\":\"Mon, 02 Jan 2023 03:04:05 GMT\", \"size\":1234 },\n"
+          "{ \"name\":\"a.txt\", \"type\":\"file\", \"size\":1 },\n"
+          "{ \"name\":\"..\", \"type\":\"directory\" },\n"
+          "{ \"name\":\"link\", \"type\":\"other\" }\n"
+          "]\n";
+
+    TEST_ASSERT_EQUAL_INT(0, LinkTable_parse_json(table,
+                                                  "https://example.com/dir/",
+                                                  json, strlen(json)));
+    TEST_ASSERT_EQUAL_INT(4, table->size);
+
+    TEST_ASSERT_EQUAL_STRING("sub dir", table->links[1]->linkname);
+    TEST_ASSERT_EQUAL_INT(LINK_DIR, table->links[1]->type);
+    assert_Link_url("https://example.com/dir/sub%20dir/", table->links[1]);
+    TEST_ASSERT_EQUAL_INT64(1672628645, table->links[1]->time);
+
+    TEST_ASSERT_EQUAL_STRING("a.txt", table->links[2]->linkname);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, table->links[2]->type);
+    TEST_ASSERT_EQUAL_UINT64(1234, table->links[2]->content_length);
+    assert_Link_url("https://example.com/dir/a.txt", table->links[2]);
+
+    TEST_ASSERT_EQUAL_STRING("link", table->links[3]->linkname);
+    TEST_ASSERT_EQUAL_INT(LINK_UNINITIALISED_FILE, table->links[3]->type);
+
+    LinkTable_free(table);
+}
+
+void test_LinkTable_parse_json_not_json(void)
+{
+    LinkTable *table = LinkTable_alloc("https://example.com/dir/");
+    const char *html = "<html><a href=\"a.txt\">a.txt</a></html>";
+
+    TEST_ASSERT_EQUAL_INT(-1, LinkTable_parse_json(table,
+                                                   "https://example.com/dir/",
+                                                   html, strlen(html)));
+    TEST_ASSERT_EQUAL_INT(1, table->size);
+
+    LinkTable_free(table);
+}
+
+static void count_json_entry(void *userdata, const JsonEntry *entry)
+{
+    int *count = userdata;
+    TEST_ASSERT_EQUAL_STRING("\xc3\xa9t\xc3\xa9 \"1\" \xf0\x9f\x98\x80",
+                             entry->name);
+    TEST_ASSERT_EQUAL_INT64(42, entry->size);
+    (*count)++;
+}
+
+void test_JsonListing_feed_byte_by_byte(void)
+{
+    const char *json = " [{\"name\":\"\\u00e9t\\u00e9 \\\"1\\\" "
+                       "\\ud83d\\ude00\",\"extra\":{\"name\":\"x\"},"
+                       "\"type\":\"file\",\"size\":42}]";
+    int count = 0;
+    JsonListing *parser = JsonListing_new(count_json_entry, &count);
+    for (size_t i = 0; i < strlen(json); i++) {
+        TEST_ASSERT_EQUAL_INT(0, JsonListing_feed(parser, json + i, 1));
+    }
+    JsonListing_free(parser);
+    TEST_ASSERT_EQUAL_INT(1, count);
+}
+
 int main(void)
 {
+    Config_init();
+    NetworkSystem_init();
     UNITY_BEGIN();
 
     /* is_external_url */
@@ -637,6 +1571,8 @@ int main(void)
     RUN_TEST(test_HTML_external_link_dedup_first_wins);
     RUN_TEST(test_HTML_external_link_dot_and_dotdot);
     RUN_TEST(test_Link_preserves_preset_f_url);
+    RUN_TEST(test_Link_url_relative);
+    RUN_TEST(test_LinkTable_fill_escaped_href);
     /* url_to_cache_path */
     RUN_TEST(test_url_to_cache_path_null);
     RUN_TEST(test_url_to_cache_path_local);
@@ -646,9 +1582,31 @@ int main(void)
     RUN_TEST(test_LinkTable_alloc);
     RUN_TEST(test_LinkTable_add);
     RUN_TEST(test_Link_download_zero_length);
+    RUN_TEST(test_Link_download_async_zero_length);
     RUN_TEST(test_link_linknames_equal);
     RUN_TEST(test_link_hash_str);
     RUN_TEST(test_LinkHashSet);
+    RUN_TEST(test_LinkHashSet_get);
+    RUN_TEST(test_LinkTable_lookup);
     RUN_TEST(test_LinkTable_parse_html_duplicates);
+    RUN_TEST(test_LinkTable_parse_html_skips_non_markup);
+    RUN_TEST(test_HtmlLinks_feed_byte_by_byte);
+    RUN_TEST(test_LinkTable_replace);
+    RUN_TEST(test_LinkSystem_on_replace);
+    RUN_TEST(test_LinkSystem_on_replace_wait);
+    RUN_TEST(test_path_to_Link_cache);
+    RUN_TEST(test_Link_get_path);
+    RUN_TEST(test_LinkTable_evict);
+    RUN_TEST(test_Link_probe_failed);
+    RUN_TEST(test_Link_set_file_stat_no_content_length);
+    RUN_TEST(test_Link_restat);
+    RUN_TEST(test_path_to_Link_concurrent);
+    RUN_TEST(test_LinkTable_build_single_flight);
+    RUN_TEST(test_Link_wait_file_stat);
+
+    /* JSON directory listings */
+    RUN_TEST(test_LinkTable_parse_json);
+    RUN_TEST(test_LinkTable_parse_json_not_json);
+    RUN_TEST(test_JsonListing_feed_byte_by_byte);
     return UNITY_END();
 }
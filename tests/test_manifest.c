@@ -0,0 +1,159 @@
+/*
+ * HTTPDirFS - HTTP Directory Filesystem
+ *
+ * Copyright (C) 2020-2026 Fufu Fang <fangfufu2003@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library.
+ */
+
+
+/**
+ * \file test_manifest.c
+ * \brief Unit tests for manifest.c
+ */
+
+#include "../src/config.h"
+#include "../src/link.h"
+#include "../src/manifest.h"
+#include "../src/util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <zlib.h>
+
+#define BASE_URL "https://example.com/mirror/"
+
+static const char *MANIFEST_TXT
+    = "# path\tsize\tmtime\thash\n"
+      "a.txt\t10\t1000\tdeadbeef\n"
+      "sub dir/b.bin\t20\t2000\n"
+      "sub dir/deeper/c.iso\t30\t3000\r\n"
+      "./empty/\t0\t4000\n"
+      "a.txt\t99\t9999\n"
+      "../escape\t1\t1\n"
+      "a.txt/d\t1\t1\n"
+      "no_size\n"
+      "last\t40\t5000";
+
+void setUp(void)
+{
+    Config_init();
+}
+
+void tearDown(void)
+{
+}
+
+static void assert_Link_url(const char *expected, const Link *link)
+{
+    char *url = Link_get_url(link);
+    TEST_ASSERT_EQUAL_STRING(expected, url);
+    FREE(url);
+}
+
+static Link *find_link(LinkTable *linktbl, const char *name)
+{
+    for (int i = 1; i < linktbl->size; i++) {
+        if (!strcmp(linktbl->links[i]->linkname, name)) {
+            return linktbl->links[i];
+        }
+    }
+    return NULL;
+}
+
+static void check_tree(LinkTable *root)
+{
+    TEST_ASSERT_NOT_NULL(root);
+    /* head, a.txt, sub dir, empty, last */
+    TEST_ASSERT_EQUAL_INT(5, root->size);
+
+    Link *a = find_link(root, "a.txt");
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_EQUAL_INT(LINK_FILE, a->type);
+    TEST_ASSERT_EQUAL_INT(10, (int)a->content_length);
+    TEST_ASSERT_EQUAL_INT64(1000, a->time);
+    assert_Link_url(BASE_URL "a.txt", a);
+
+    Link *sub = find_link(root, "sub dir");
+    TEST_ASSERT_NOT_NULL(sub);
+    TEST_ASSERT_EQUAL_INT(LINK_DIR, sub->type);
+    assert_Link_url(BASE_URL "sub%20dir/", sub);
+    TEST_ASSERT_NOT_NULL(sub->next_table);
+    TEST_ASSERT_EQUAL_PTR(root, sub->next_table->parent_tbl);
+    TEST_ASSERT_EQUAL_PTR(sub, sub->next_table->parent_link);
+
+    Link *deeper = find_link(sub->next_table, "deeper");
+    TEST_ASSERT_NOT_NULL(deeper);
+    Link *c = find_link(deeper->next_table, "c.iso");
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_EQUAL_INT(30, (int)c->content_length);
+    assert_Link_url(BASE_URL "sub%20dir/deeper/c.iso", c);
+
+    Link *empty = find_link(root, "empty");
+    TEST_ASSERT_NOT_NULL(empty);
+    TEST_ASSERT_EQUAL_INT(LINK_DIR, empty->type);
+    TEST_ASSERT_EQUAL_INT64(4000, empty->time);
+    TEST_ASSERT_EQUAL_INT(1, empty->next_table->size);
+
+    Link *last = find_link(root, "last");
+    TEST_ASSERT_NOT_NULL(last);
+    TEST_ASSERT_EQUAL_INT(40, (int)last->content_length);
+}
+
+void test_manifest_parse_plain(void)
+{
+    LinkTable *root
+        = manifest_parse(BASE_URL, MANIFEST_TXT, strlen(MANIFEST_TXT));
+    check_tree(root);
+    LinkTable_free(root);
+}
+
+void test_manifest_parse_gzip(void)
+{
+    z_stream strm = {0};
+    /* 16 selects the gzip wrapper */
+    TEST_ASSERT_EQUAL_INT(Z_OK, deflateInit2(&strm, Z_DEFAULT_COMPRESSION,
+                                             Z_DEFLATED, 15 + 16, 8,
+                                             Z_DEFAULT_STRATEGY));
+    uLong bound = deflateBound(&strm, strlen(MANIFEST_TXT));
+    unsigned char *gz = CALLOC(bound, 1);
+    strm.next_in = (Bytef *)MANIFEST_TXT;
+    strm.avail_in = strlen(MANIFEST_TXT);
+    strm.next_out = gz;
+    strm.avail_out = bound;
+    TEST_ASSERT_EQUAL_INT(Z_STREAM_END, deflate(&strm, Z_FINISH));
+    size_t gz_len = bound - strm.avail_out;
+    deflateEnd(&strm);
+
+    LinkTable *root = manifest_parse(BASE_URL, (char *)gz, gz_len);
+    check_tree(root);
+    LinkTable_free(root);
+
+    /* A truncated archive is rejected */
+    TEST_ASSERT_NULL(manifest_parse(BASE_URL, (char *)gz, gz_len / 2));
+    FREE(gz);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_manifest_parse_plain);
+    RUN_TEST(test_manifest_parse_gzip);
+    return UNITY_END();
+}